@@ -14,9 +14,6 @@
 #include "inode.h"
 #include "util.h"
 
-#define INODE_SIZE 16		//Tamanho do i-node em numero de unsigned ints
-#define NUMBLOCKS_PERINODE 8	//No. de enderecos de bloco por i-node
-#define NUMITEMS_PERINODE (INODE_SIZE - 2)	//Numero de "itens" por i-node
 #define INODE_ITEM_BLOCKADDR 0		//Itens 0 a 7: Enderecos de bloco
 #define INODE_ITEM_FILETYPE (INODE_SIZE - 8)	//Item 8: Tipo de arquivo
 #define INODE_ITEM_FILESIZE (INODE_SIZE - 7)	//Item 9: Tamanho do arquivo
@@ -27,34 +24,144 @@
 
 #define INODE_BEGINSECTOR 2
 
-//Tipo para representacao de i-nodes
-struct inode {
+//Conteudo de um i-node, guardado no espaco opaco de struct inode
+typedef struct inode_data {
 	unsigned int inodeItem[NUMITEMS_PERINODE]; //Blocos e dados do i-node
 	unsigned int number; 	//Numero do i-node
 	unsigned int next;	//Numero do proximo i-node em caso de extensao
 	Disk *d; 		//Disco ao qual pertence o i-node
-};
-
-//Funcao interna que retorna a ultima extensao de um i-node. Retorna NULL
-//se nao houver extensoes do i-node fornecido.
-Inode* __inodeGetLastExtension (Inode *i) {
-	unsigned int niNumber = 0;
-	Disk *d = i->d;
-	if (i->next) {
-		niNumber = i->next;
-		i = inodeLoad (niNumber, d);
-		if (!i) return NULL;
-	} 
-	else return NULL;
-	while (i->next != 0) {
-		niNumber = i->next;
-		free (i);
-		i = inodeLoad (niNumber, d);
-		if (!i) return NULL;
+	Inode *nextFree;	//Proximo i-node livre no pool do disco
+	int pooled;		//1 se o i-node pertence ao pool do disco
+} InodeData;
+
+_Static_assert (sizeof (InodeData) <= INODE_STORAGESIZE,
+                "INODE_STORAGESIZE menor que o conteudo de um i-node");
+
+//Funcao interna que retorna o conteudo de um i-node
+InodeData* __inodeData (Inode *i) {
+	return (InodeData *) i->storage.bytes;
+}
+
+#define INODE_SLABSIZE 64	//No. de i-nodes alocados de uma vez pelo pool
+
+//Bloco de i-nodes alocado de uma so' vez para o pool de um disco
+typedef struct inode_slab {
+	struct inode_slab *next;	//Proximo slab do pool
+	Inode inodes[INODE_SLABSIZE];	//I-nodes do slab
+} InodeSlab;
+
+//Informacoes de i-nodes de um disco: pool (slabs e lista de i-nodes
+//livres), geometria da area de i-nodes e alocador de extensoes
+typedef struct inode_disk_info {
+	Disk *d;			//Disco ao qual pertencem as informacoes
+	InodeSlab *slabs;		//Slabs alocados para o pool
+	Inode *freeList;		//I-nodes livres para reuso
+	unsigned int inodesPerGroup;	//I-nodes por grupo (0: area contigua)
+	unsigned long sectorsPerGroup;	//Setores por grupo
+	unsigned int tableOffset;	//Setor da tabela de i-nodes no grupo
+	InodeAllocFn allocFn;		//Obtencao de i-nodes para extensoes
+	InodeReleaseFn releaseFn;	//Liberacao de i-nodes de extensoes
+	InodeSectorFn readFn;		//Leitura de setores de i-nodes
+	InodeSectorFn writeFn;		//Escrita de setores de i-nodes
+	struct inode_disk_info *next;	//Informacoes do proximo disco
+} InodeDiskInfo;
+
+InodeDiskInfo *inodeDiskInfos = NULL;	//Informacoes de i-nodes por disco
+
+//Funcao interna que retorna as informacoes de i-nodes de um disco,
+//criando-as se ainda nao existirem. Retorna NULL se nao houver memoria
+//suficiente
+InodeDiskInfo* __inodeGetDiskInfo (Disk *d) {
+	InodeDiskInfo *p, *prev = NULL;
+	for (p = inodeDiskInfos; p; prev = p, p = p->next)
+		if (p->d == d) break;
+	if (p) {
+		//Mantendo o disco mais recente no inicio da lista
+		if (prev) {
+			prev->next = p->next;
+			p->next = inodeDiskInfos;
+			inodeDiskInfos = p;
+		}
+		return p;
+	}
+	p = calloc (1, sizeof(InodeDiskInfo));
+	if (!p) return NULL;
+	p->d = d;
+	p->next = inodeDiskInfos;
+	inodeDiskInfos = p;
+	return p;
+}
+
+//Funcao interna que le o setor addr da area de i-nodes de um disco, pela
+//funcao de leitura definida para o disco, se houver. Retorna 0 se bem
+//sucedido ou -1, caso contrario
+int __inodeReadSector (Disk *d, unsigned long addr, unsigned char *sector) {
+	InodeDiskInfo *p = __inodeGetDiskInfo (d);
+	if (p && p->readFn) return p->readFn (d, addr, sector);
+	return diskReadSector (d, addr, sector);
+}
+
+//Funcao interna que grava o setor addr da area de i-nodes de um disco, pela
+//funcao de escrita definida para o disco, se houver. Retorna 0 se bem
+//sucedido ou -1, caso contrario
+int __inodeWriteSector (Disk *d, unsigned long addr, unsigned char *sector) {
+	InodeDiskInfo *p = __inodeGetDiskInfo (d);
+	if (p && p->writeFn) return p->writeFn (d, addr, sector);
+	return diskWriteSector (d, addr, sector);
+}
+
+//Funcao interna que retorna o endereco do setor onde fica o i-node de
+//numero number, conforme a geometria da area de i-nodes do disco
+unsigned long int __inodeSectorAddr (unsigned int number, Disk *d) {
+	InodeDiskInfo *p = __inodeGetDiskInfo (d);
+	if (p && p->inodesPerGroup) {
+		unsigned int group = (number - 1) / p->inodesPerGroup;
+		unsigned int index = (number - 1) % p->inodesPerGroup;
+		return group * p->sectorsPerGroup + p->tableOffset +
+		       index / inodeNumInodesPerSector ();
+	}
+	return INODE_BEGINSECTOR + (number - 1) * INODE_SIZE * 
+	       sizeof(unsigned int) / DISK_SECTORDATASIZE;
+}
+
+//Funcao interna que obtem um i-node livre do pool de um disco, alocando um
+//novo slab apenas quando a lista de livres estiver vazia
+Inode* __inodeAlloc (Disk *d) {
+	InodeDiskInfo *p = __inodeGetDiskInfo (d);
+	Inode *i;
+	if (!p) return NULL;
+	if (!p->freeList) {
+		InodeSlab *s = malloc (sizeof(InodeSlab));
+		if (!s) return NULL;
+		s->next = p->slabs;
+		p->slabs = s;
+		for (int a = 0; a < INODE_SLABSIZE; a++) {
+			__inodeData (&s->inodes[a])->d = d;
+			__inodeData (&s->inodes[a])->pooled = 1;
+			__inodeData (&s->inodes[a])->nextFree = p->freeList;
+			p->freeList = &s->inodes[a];
+		}
 	}
+	i = p->freeList;
+	p->freeList = __inodeData (i)->nextFree;
+	__inodeData (i)->nextFree = NULL;
 	return i;
 }
 
+//Funcao interna que retorna a ultima extensao de um i-node em *last.
+//Retorna 1 se encontrada, 0 se nao houver extensoes do i-node fornecido
+//ou -1 em caso de falha de leitura
+int __inodeGetLastExtension (Inode *i, Inode *last) {
+	unsigned int niNumber = __inodeData (i)->next;
+	if (!niNumber) return 0;
+	while (niNumber != 0) {
+		if ( inodeLoadInto (last, niNumber, __inodeData (i)->d) < 0 )
+			return -1;
+		niNumber = __inodeData (last)->next;
+	}
+	return 1;
+}
+
 //Funcao que retorna o numero de i-nodes por setor
 unsigned int inodeNumInodesPerSector ( void ) {
 	return DISK_SECTORDATASIZE / (INODE_SIZE * sizeof (unsigned int));
@@ -72,31 +179,52 @@ unsigned int inodeAreaBeginSector ( void ) {
 //existente
 Inode* inodeCreate (unsigned int number, Disk *d) {
 	if (number < 1) return NULL;
-	Inode *i = malloc (sizeof(Inode));
-	i->d = d;
-	i->number = number;
-	i->next = 0;
-	if ( inodeClear (i) == 0 ) return i;
-	else free (i);
-	return NULL;
+	Inode *i = __inodeAlloc (d);
+	if (!i) return NULL;
+	if ( inodeCreateInto (i, number, d) == 0 ) __inodeData (i)->pooled = 1;
+	else {
+		__inodeData (i)->pooled = 1;
+		inodeFree (i);
+		i = NULL;
+	}
+	return i;
+}
+
+//Funcao equivalente a inodeCreate, mas que usa o espaco fornecido pelo
+//chamador em *i, sem alocacao dinamica. Retorna 0 se bem sucedido ou -1,
+//caso contrario
+int inodeCreateInto (Inode *i, unsigned int number, Disk *d) {
+	if (!i || number < 1) return -1;
+	__inodeData (i)->d = d;
+	__inodeData (i)->pooled = 0;
+	__inodeData (i)->number = number;
+	__inodeData (i)->next = 0;
+	return inodeClear (i);
 }
 
 //Funcao que limpa todo o conteudo de um i-node. O i-node e' salvo em disco,
 //sobrescrevendo-o se ja existente. Retorna 0 se bem sucedido ou -1, caso contrario
 int inodeClear (Inode *i) {
 	if (i) {
-		if (i->next != 0) {
-			Inode* ni = inodeLoad (i->next, i->d);
-			if ( !ni ) return -1;
-			if ( inodeClear (ni) != 0 ) {
-				free (ni);
+		Inode ni;
+		InodeDiskInfo *p = __inodeGetDiskInfo (__inodeData (i)->d);
+		unsigned int niNumber = __inodeData (i)->next;
+		//Limpando as extensoes ao longo da cadeia, sem recursao
+		while (niNumber != 0) {
+			if ( inodeLoadInto (&ni, niNumber, __inodeData (i)->d) < 0 )
 				return -1;
-			}
-			free (ni);
-		}	
-		i->next = 0;
+			niNumber = __inodeData (&ni)->next;
+			__inodeData (&ni)->next = 0;
+			for (int a = 0; a < NUMITEMS_PERINODE; a++)
+				__inodeData (&ni)->inodeItem[a] = 0;
+			if ( inodeSave (&ni) < 0 ) return -1;
+			if (p && p->releaseFn)
+				p->releaseFn (__inodeData (i)->d,
+				              __inodeData (&ni)->number);
+		}
+		__inodeData (i)->next = 0;
 		for (int a = 0; a < NUMITEMS_PERINODE; a++)
-			i->inodeItem[a] = 0;
+			__inodeData (i)->inodeItem[a] = 0;
 		return inodeSave(i);
 	}
 	return -1;
@@ -112,96 +240,179 @@ int inodeSave (Inode *i) {
 		unsigned long int sizeUInt = sizeof(unsigned int);
 		//Endereco do setor no qual o i-node sera' salvo
 		unsigned long int inodeSectorAddr = 
-			INODE_BEGINSECTOR + (i->number - 1) * INODE_SIZE 
-			* sizeUInt / DISK_SECTORDATASIZE;
+			__inodeSectorAddr (__inodeData (i)->number, __inodeData (i)->d);
 		unsigned char sector[DISK_SECTORDATASIZE];
 
-		int ret = diskReadSector (i->d, inodeSectorAddr, sector);
+		int ret = __inodeReadSector (__inodeData (i)->d, inodeSectorAddr,
+		                             sector);
 		if (ret < 0) return ret;
 
 		//Posicao de inicio do i-node dentro do setor
-		unsigned long int offset = ((i->number - 1) % 
+		unsigned long int offset = ((__inodeData (i)->number - 1) % 
 			   (DISK_SECTORDATASIZE / (INODE_SIZE * sizeUInt)))
                            * INODE_SIZE * sizeUInt;
 
 		//Alterando enderecos de blocos e atributos do i-node no setor
 		for (int a=0; a < NUMITEMS_PERINODE; a++)
-			ul2char (i->inodeItem[a], 
+			ul2char (__inodeData (i)->inodeItem[a], 
 			         &sector[offset+a*sizeUInt]);
-		ul2char (i->number, 
+		ul2char (__inodeData (i)->number, 
 		         &sector[offset+(INODE_SIZE-2)*sizeUInt]);
-		ul2char (i->next, 
+		ul2char (__inodeData (i)->next, 
 			 &sector[offset+(INODE_SIZE-1)*sizeUInt]);
 
 		//Salvando todo o setor onde se encontra o i-node...
-		ret = diskWriteSector (i->d, inodeSectorAddr, sector);
+		ret = __inodeWriteSector (__inodeData (i)->d, inodeSectorAddr,
+		                          sector);
 		return ret;
 	}
 	return -1;
 }
 
 //Funcao que recupera um i-node a partir do disco. Retorna ponteiro para o
-//i-node lido ou NULL em caso de falha.
+//i-node lido ou NULL em caso de falha. O i-node e' obtido do pool do disco
+//e deve ser devolvido com inodeFree (nunca com free)
 Inode* inodeLoad (unsigned int number, Disk *d) {
+	Inode *i = __inodeAlloc (d);
+	if (!i) return NULL;
+	if ( inodeLoadInto (i, number, d) == 0 ) __inodeData (i)->pooled = 1;
+	else {
+		__inodeData (i)->pooled = 1;
+		inodeFree (i);
+		i = NULL;
+	}
+	return i;
+}
+
+//Funcao equivalente a inodeLoad, mas que le o i-node para o espaco fornecido
+//pelo chamador em *i, sem alocacao dinamica. Retorna 0 se bem sucedido ou -1,
+//caso contrario
+int inodeLoadInto (Inode *i, unsigned int number, Disk *d) {
 	unsigned long int sizeUInt = sizeof(unsigned int);
+	if (!i || number < 1) return -1;
 	//Endereco do setor do qual o i-node sera' lido
-	unsigned long int inodeSectorAddr = 
-		INODE_BEGINSECTOR + (number - 1) * INODE_SIZE * sizeUInt
-		    / DISK_SECTORDATASIZE;
+	unsigned long int inodeSectorAddr = __inodeSectorAddr (number, d);
 	unsigned char sector[DISK_SECTORDATASIZE];
-	Inode *i = NULL;
 
-	int ret = diskReadSector (d, inodeSectorAddr, sector);
-	if (ret < 0) return NULL;
+	int ret = __inodeReadSector (d, inodeSectorAddr, sector);
+	if (ret < 0) return -1;
 
 	//Posicao de inicio do i-node dentro do setor
 	unsigned long int offset = ((number - 1) % 
 		(DISK_SECTORDATASIZE / (INODE_SIZE * sizeUInt)))
 		* INODE_SIZE * sizeUInt;
 
-	i = malloc (sizeof(Inode));
-	if (i) {
-		i->d = d;
-		//Recuperando enderecos de blocos e atributos do i-node no setor
-		for (int a=0; a < NUMITEMS_PERINODE; a++)
-			char2ul (&sector[offset+a*sizeUInt],
-			         &(i->inodeItem[a]));
-		char2ul (&sector[offset+(INODE_SIZE-2)*sizeUInt],
-		         &(i->number));
-		char2ul (&sector[offset+(INODE_SIZE-1)*sizeUInt],
-		         &(i->next));
+	inodeLoadFrom (i, d, &sector[offset]);
+	return 0;
+}
+
+//Funcao equivalente a inodeLoadInto, mas que decodifica o i-node a partir
+//de uma copia de sua area no disco em data, sem ler o disco
+void inodeLoadFrom (Inode *i, Disk *d, unsigned char *data) {
+	unsigned long int sizeUInt = sizeof(unsigned int);
+	__inodeData (i)->d = d;
+	__inodeData (i)->pooled = 0;
+	//Recuperando enderecos de blocos e atributos do i-node
+	for (int a=0; a < NUMITEMS_PERINODE; a++)
+		char2ul (&data[a*sizeUInt], &(__inodeData (i)->inodeItem[a]));
+	char2ul (&data[(INODE_SIZE-2)*sizeUInt], &(__inodeData (i)->number));
+	char2ul (&data[(INODE_SIZE-1)*sizeUInt], &(__inodeData (i)->next));
+}
+
+//Funcao que devolve ao pool de seu disco um i-node obtido por inodeLoad ou
+//inodeCreate. I-nodes em espaco do chamador sao ignorados
+void inodeFree (Inode *i) {
+	InodeDiskInfo *p;
+	if (!i || !__inodeData (i)->pooled) return;
+	p = __inodeGetDiskInfo (__inodeData (i)->d);
+	if (!p) return;
+	__inodeData (i)->nextFree = p->freeList;
+	p->freeList = i;
+}
+
+//Funcao que libera toda a memoria do pool de i-nodes de um disco, bem como
+//sua geometria e alocador. Nenhum i-node do pool pode estar em uso. Deve ser
+//chamada ao desconectar o disco
+void inodePoolDestroy (Disk *d) {
+	InodeDiskInfo *p, *prev = NULL;
+	for (p = inodeDiskInfos; p; prev = p, p = p->next)
+		if (p->d == d) break;
+	if (!p) return;
+	if (prev) prev->next = p->next;
+	else inodeDiskInfos = p->next;
+	while (p->slabs) {
+		InodeSlab *s = p->slabs;
+		p->slabs = s->next;
+		free (s);
 	}
-	return i;
+	free (p);
+}
+
+//Funcao que define a geometria da area de i-nodes de um disco dividido em
+//grupos de sectorsPerGroup setores, cada um com inodesPerGroup i-nodes a
+//partir do setor tableOffset do grupo. Com inodesPerGroup igual a 0, os
+//i-nodes voltam a ser contiguos a partir de inodeAreaBeginSector. Retorna 0
+//se bem sucedido ou -1, caso contrario
+int inodeSetGeometry (Disk *d, unsigned int inodesPerGroup,
+                      unsigned long sectorsPerGroup, unsigned int tableOffset) {
+	InodeDiskInfo *p = __inodeGetDiskInfo (d);
+	if (!p) return -1;
+	if (inodesPerGroup && (sectorsPerGroup == 0 ||
+	    inodesPerGroup % inodeNumInodesPerSector () != 0)) return -1;
+	p->inodesPerGroup = inodesPerGroup;
+	p->sectorsPerGroup = sectorsPerGroup;
+	p->tableOffset = tableOffset;
+	return 0;
+}
+
+//Funcao que define as funcoes usadas por inodeAddBlock para obter i-nodes
+//de extensao e por inodeClear para libera-los. Sem alocador definido (NULL),
+//extensoes sao obtidas com inodeFindFreeInode e nao ha liberacao
+void inodeSetAllocator (Disk *d, InodeAllocFn allocFn,
+                        InodeReleaseFn releaseFn) {
+	InodeDiskInfo *p = __inodeGetDiskInfo (d);
+	if (!p) return;
+	p->allocFn = allocFn;
+	p->releaseFn = releaseFn;
+}
+
+//Funcao que define as funcoes usadas para ler e gravar os setores da area de
+//i-nodes de um disco, como as de um journal. NULL restaura o acesso direto
+void inodeSetSectorIO (Disk *d, InodeSectorFn readFn, InodeSectorFn writeFn) {
+	InodeDiskInfo *p = __inodeGetDiskInfo (d);
+	if (!p) return;
+	p->readFn = readFn;
+	p->writeFn = writeFn;
 }
 
 //Funcao que modifica o tipo de arquivo referente a um i-node
 void inodeSetFileType (Inode *i, unsigned int fileType) {
-	if (i) i->inodeItem[INODE_ITEM_FILETYPE] = fileType;
+	if (i) __inodeData (i)->inodeItem[INODE_ITEM_FILETYPE] = fileType;
 }
 
 //Funcao que modifica o tamanho do arquivo referente a um i-node, em bytes
 void inodeSetFileSize (Inode *i, unsigned int fileSize) {
-	if (i) i->inodeItem[INODE_ITEM_FILESIZE] = fileSize;
+	if (i) __inodeData (i)->inodeItem[INODE_ITEM_FILESIZE] = fileSize;
 }
 
 //Funcao que modifica o proprietario do arquivo referente a um i-node
 void inodeSetOwner (Inode *i, unsigned int owner) {
-	if (i) i->inodeItem[INODE_ITEM_OWNER] = owner;
+	if (i) __inodeData (i)->inodeItem[INODE_ITEM_OWNER] = owner;
 }
 
 //Funcao que modifica o grupo proprietario do arquivo referente a um i-node
 void inodeSetGroupOwner (Inode *i, unsigned int groupOwner) {
-	if (i) i->inodeItem[INODE_ITEM_GROUPOWNER] = groupOwner;
+	if (i) __inodeData (i)->inodeItem[INODE_ITEM_GROUPOWNER] = groupOwner;
 }
 
 //Funcao que modifica as permissoes de acesso ao arquivo referente a um i-node
 void inodeSetPermission (Inode *i, unsigned int permission) {
-	if (i) i->inodeItem[INODE_ITEM_PERMISSION] = permission;
+	if (i) __inodeData (i)->inodeItem[INODE_ITEM_PERMISSION] = permission;
 }
 
 //Funcao que modifica o contador de referencia do arquivo referente a um i-node
 void inodeSetRefCount (Inode *i, unsigned int refCount) {
-	if (i) i->inodeItem[INODE_ITEM_REFCOUNT] = refCount;
+	if (i) __inodeData (i)->inodeItem[INODE_ITEM_REFCOUNT] = refCount;
 }
 
 //Funcao que adiciona um endereco ao fim do array de blocos de um i-node
@@ -209,93 +420,163 @@ void inodeSetRefCount (Inode *i, unsigned int refCount) {
 //E' a unica funcao que salva automaticamente o i-node em disco
 int inodeAddBlock (Inode *i, unsigned int blockAddr) {
 	if (i) {
-		Disk *d = i->d;
+		Disk *d = __inodeData (i)->d;
+		InodeDiskInfo *p;
+		Inode ext;
 		Inode* lastInodeExt = NULL;
 		unsigned int niNumber;
 		int ret, numblocks = NUMBLOCKS_PERINODE;
-		lastInodeExt = __inodeGetLastExtension (i);
-		if (lastInodeExt) {
+		ret = __inodeGetLastExtension (i, &ext);
+		if (ret < 0) return -1;
+		if (ret > 0) {
+			lastInodeExt = &ext;
 			numblocks = NUMITEMS_PERINODE;
 			if ( inodeSave (i) < 0 ) return -1;
 		}
-		else if (i->next != 0) return -1;
 		else lastInodeExt = i;
 
 		for (int a = 0; a < numblocks; a++)
 			//Encontrar bloco sem endereco
-			if (lastInodeExt->inodeItem[a] == 0) {
-				lastInodeExt->inodeItem[a] = blockAddr;
-				ret = inodeSave(lastInodeExt);
-				if (numblocks != NUMBLOCKS_PERINODE) 
-					free (lastInodeExt);
-				return ret;
+			if (__inodeData (lastInodeExt)->inodeItem[a] == 0) {
+				__inodeData (lastInodeExt)->inodeItem[a] = blockAddr;
+				return inodeSave(lastInodeExt);
 			}
 		//i-node esta' sem bloco a preencher. Obter nova extensao
-		niNumber = inodeFindFreeInode (lastInodeExt->number, d);
-		if (niNumber) {
-			lastInodeExt->next = niNumber;
-			ret = inodeSave (lastInodeExt);
-			if (numblocks != NUMBLOCKS_PERINODE) 
-				free (lastInodeExt);
-			if (ret < 0) return ret;
+		p = __inodeGetDiskInfo (d);
+		if (p && p->allocFn)
+			niNumber = p->allocFn (d, __inodeData (lastInodeExt)->number);
+		else niNumber = inodeFindFreeInode (
+			__inodeData (lastInodeExt)->number, d);
+		if (!niNumber) return -1;
+		__inodeData (lastInodeExt)->next = niNumber;
+		ret = inodeSave (lastInodeExt);
+		if (ret < 0) return ret;
+		//A nova extensao e' montada em memoria e salva uma unica vez
+		__inodeData (&ext)->d = d;
+		__inodeData (&ext)->pooled = 0;
+		__inodeData (&ext)->number = niNumber;
+		__inodeData (&ext)->next = 0;
+		for (int a = 0; a < NUMITEMS_PERINODE; a++)
+			__inodeData (&ext)->inodeItem[a] = 0;
+		__inodeData (&ext)->inodeItem[0] = blockAddr;
+		return inodeSave (&ext);
+	}
+	return -1;
+}
+
+//Funcao que adiciona count enderecos ao fim do array de blocos de um i-node,
+//percorrendo a cadeia de extensoes uma unica vez e salvando cada i-node
+//alterado uma unica vez. Retorna -1 caso a inclusao de algum endereco nao
+//seja bem sucedida
+int inodeAddBlocks (Inode *i, const unsigned int *addrs, unsigned int count) {
+	if (i && addrs) {
+		Disk *d = __inodeData (i)->d;
+		InodeDiskInfo *p = __inodeGetDiskInfo (d);
+		Inode ext;
+		Inode* cur = i;
+		unsigned int n = 0, a = 0, niNumber;
+		unsigned int numblocks = NUMBLOCKS_PERINODE;
+		int ret;
+		ret = __inodeGetLastExtension (i, &ext);
+		if (ret < 0) return -1;
+		if (ret > 0) {
+			cur = &ext;
+			numblocks = NUMITEMS_PERINODE;
 		}
-		else {
-			if (numblocks != NUMBLOCKS_PERINODE)
-				free (lastInodeExt);
-			return -1;
+		//Primeiro item sem endereco no ultimo i-node da cadeia
+		while (a < numblocks && __inodeData (cur)->inodeItem[a] != 0) a++;
+		while (n < count) {
+			if (a < numblocks) {
+				__inodeData (cur)->inodeItem[a++] = addrs[n++];
+				continue;
+			}
+			//i-node cheio. Obter nova extensao, montada em memoria
+			if (p && p->allocFn)
+				niNumber = p->allocFn (d, __inodeData (cur)->number);
+			else {
+				//A busca por i-nodes livres depende do disco atualizado
+				if ( inodeSave (cur) < 0 ) return -1;
+				niNumber = inodeFindFreeInode (__inodeData (cur)->number, d);
+			}
+			if (!niNumber) break;
+			__inodeData (cur)->next = niNumber;
+			if ( cur != i && inodeSave (cur) < 0 ) return -1;
+			__inodeData (&ext)->d = d;
+			__inodeData (&ext)->pooled = 0;
+			__inodeData (&ext)->number = niNumber;
+			__inodeData (&ext)->next = 0;
+			for (int b = 0; b < NUMITEMS_PERINODE; b++)
+				__inodeData (&ext)->inodeItem[b] = 0;
+			cur = &ext;
+			numblocks = NUMITEMS_PERINODE;
+			a = 0;
 		}
-		lastInodeExt = inodeLoad (niNumber, d);
-		if (!lastInodeExt) return -1;
-		lastInodeExt->inodeItem[0] = blockAddr;
-		ret = inodeSave (lastInodeExt);
-		free (lastInodeExt);
-		return ret;
+		if ( cur != i && inodeSave (cur) < 0 ) return -1;
+		if ( inodeSave (i) < 0 ) return -1;
+		return (n == count ? 0 : -1);
 	}
 	return -1;
 }
 
 //Funcao que retorna o numero de um i-node.
 unsigned int inodeGetNumber (Inode *i) {
-	return (i ? i->number : 0);
+	return (i ? __inodeData (i)->number : 0);
 }
 
 //Funcao que retorna o numero de um i-node.
 unsigned int inodeGetNextNumber (Inode *i) {
-	return (i ? i->next : 0);
+	return (i ? __inodeData (i)->next : 0);
+}
+
+//Funcao que modifica o numero do proximo i-node da cadeia de um i-node
+void inodeSetNextNumber (Inode *i, unsigned int next) {
+	if (i) __inodeData (i)->next = next;
+}
+
+//Funcao que retorna o item (0 a NUMITEMS_PERINODE-1) de um i-node
+unsigned int inodeGetItem (Inode *i, unsigned int item) {
+	return (i && item < NUMITEMS_PERINODE ?
+	        __inodeData (i)->inodeItem[item] : 0);
+}
+
+//Funcao que modifica o item (0 a NUMITEMS_PERINODE-1) de um i-node
+void inodeSetItem (Inode *i, unsigned int item, unsigned int value) {
+	if (i && item < NUMITEMS_PERINODE)
+		__inodeData (i)->inodeItem[item] = value;
 }
 
 
 //Funcao que retorna o tipo de arquivo referente a um i-node.
 unsigned int inodeGetFileType (Inode *i) {
-	return (i ? i->inodeItem[INODE_ITEM_FILETYPE] : 0);
+	return (i ? __inodeData (i)->inodeItem[INODE_ITEM_FILETYPE] : 0);
 }
 
 //Funcao que retorna o tamanho do arquivo referente ao i-node, em bytes
 unsigned int inodeGetFileSize (Inode *i) {
-	return (i ? i->inodeItem[INODE_ITEM_FILESIZE] : 0);
+	return (i ? __inodeData (i)->inodeItem[INODE_ITEM_FILESIZE] : 0);
 }
 
 
 //Funcao que retorna o prorprietario do arquivo referente a um i-node
 unsigned int inodeGetOwner (Inode *i) {
-	return (i ? i->inodeItem[INODE_ITEM_OWNER] : 0);
+	return (i ? __inodeData (i)->inodeItem[INODE_ITEM_OWNER] : 0);
 }
 
 
 //Funcao que retorna o grupo proprietario do arquivo referente a um i-node
 unsigned int inodeGetGroupOwner (Inode *i) {
-	return (i ? i->inodeItem[INODE_ITEM_GROUPOWNER] : 0);
+	return (i ? __inodeData (i)->inodeItem[INODE_ITEM_GROUPOWNER] : 0);
 }
 
 
 //Funcao que retorna as permissoes de acesso do arquivo referente a um i-node
 unsigned int inodeGetPermission (Inode *i) {
-	return (i ? i->inodeItem[INODE_ITEM_PERMISSION] : 0);
+	return (i ? __inodeData (i)->inodeItem[INODE_ITEM_PERMISSION] : 0);
 }
 
 //Funcao que retorna o contador de referencias do arquivo referente a um i-node
 unsigned int inodeGetRefCount (Inode *i) {
-	return (i ? i->inodeItem[INODE_ITEM_REFCOUNT] : 0);
+	return (i ? __inodeData (i)->inodeItem[INODE_ITEM_REFCOUNT] : 0);
 }
 
 
@@ -303,41 +584,103 @@ unsigned int inodeGetRefCount (Inode *i) {
 //de blocos de um i-node. O i-node precisa ser o primeiro de sua cadeia.
 //Retorna 0 se o bloco nao possuir endereco em blockNum
 unsigned int inodeGetBlockAddr (Inode *i, unsigned int blockNum) {
-	unsigned int numblocks = NUMBLOCKS_PERINODE;
 	if (i) {
 		if (blockNum < NUMBLOCKS_PERINODE)
-			return i->inodeItem[blockNum];
+			return __inodeData (i)->inodeItem[blockNum];
 		else {
 			unsigned int extNum = 1 + 
 			                      (blockNum - NUMBLOCKS_PERINODE) 
 			                      / NUMITEMS_PERINODE;
 			unsigned int offset = (blockNum - NUMBLOCKS_PERINODE)
 			                      % NUMITEMS_PERINODE;
-			Inode *ni = inodeLoad (i->next, i->d);
-			for (int a = 1; a < extNum; a++) {
-				Disk *d = ni->d;
-				unsigned int niNumber = ni->next;
-				free (ni);
-				ni = inodeLoad (niNumber, d);
+			unsigned int niNumber = __inodeData (i)->next;
+			Inode ni;
+			for (unsigned int a = 0; a < extNum; a++) {
+				if (niNumber == 0) return 0;
+				if ( inodeLoadInto (&ni, niNumber, __inodeData (i)->d) < 0 )
+					return 0;
+				niNumber = __inodeData (&ni)->next;
 			}
-			return ni->inodeItem[offset];
+			return __inodeData (&ni)->inodeItem[offset];
 		}
 	}
 	return 0;
 }
 
+//Funcao que copia para addrs os enderecos dos blocos first a first+count-1
+//de um i-node, lendo cada i-node de extensao da cadeia uma unica vez. O
+//i-node precisa ser o primeiro de sua cadeia. Retorna o numero de enderecos
+//copiados, menor que count se a cadeia terminar antes
+unsigned int inodeGetBlockAddrs (Inode *i, unsigned int first,
+                                 unsigned int count, unsigned int *addrs) {
+	unsigned int n = 0, b = first, base = 0, items = NUMBLOCKS_PERINODE;
+	unsigned int niNumber;
+	Inode ni, *cur = i;
+	if (!i || !addrs) return 0;
+	niNumber = __inodeData (i)->next;
+	while (n < count) {
+		if (b < base + items) {
+			addrs[n++] = __inodeData (cur)->inodeItem[b - base];
+			b++;
+			continue;
+		}
+		//Proximo i-node da cadeia, cujos itens sao todos enderecos
+		if (niNumber == 0) break;
+		if ( inodeLoadInto (&ni, niNumber, __inodeData (i)->d) < 0 ) break;
+		niNumber = __inodeData (&ni)->next;
+		cur = &ni;
+		base += items;
+		items = NUMITEMS_PERINODE;
+	}
+	return n;
+}
+
+//Funcao que substitui os enderecos dos blocos first a first+count-1 de um
+//i-node pelos de addrs, como ao mover os blocos de lugar, salvando uma unica
+//vez cada i-node alterado da cadeia. O i-node precisa ser o primeiro de sua
+//cadeia e os blocos precisam existir. Retorna 0 se bem sucedido ou -1, caso
+//contrario
+int inodeSetBlockAddrs (Inode *i, unsigned int first, unsigned int count,
+                        const unsigned int *addrs) {
+	unsigned int n = 0, b = first, base = 0, items = NUMBLOCKS_PERINODE;
+	unsigned int niNumber;
+	int changed = 0;
+	Inode ni, *cur = i;
+	if (!i || !addrs) return -1;
+	niNumber = __inodeData (i)->next;
+	while (n < count) {
+		if (b < base + items) {
+			if (__inodeData (cur)->inodeItem[b - base] == 0) break;
+			__inodeData (cur)->inodeItem[b - base] = addrs[n++];
+			b++;
+			changed = 1;
+			continue;
+		}
+		if (changed && inodeSave (cur) < 0) return -1;
+		changed = 0;
+		//Proximo i-node da cadeia, cujos itens sao todos enderecos
+		if (niNumber == 0) break;
+		if ( inodeLoadInto (&ni, niNumber, __inodeData (i)->d) < 0 )
+			return -1;
+		niNumber = __inodeData (&ni)->next;
+		cur = &ni;
+		base += items;
+		items = NUMITEMS_PERINODE;
+	}
+	if (changed && inodeSave (cur) < 0) return -1;
+	return (n == count ? 0 : -1);
+}
+
 //Funcao que encontra um i-node livre em um disco, a partir do i-node de numero
 //startFrom. Retorna o numero do inode livre encontrado ou 0 se nao encontrado.
 unsigned int inodeFindFreeInode (unsigned int startFrom, Disk *d) {
-	Inode *i = NULL;
+	Inode i;
 	unsigned int number = 0;
 	if (startFrom < 1) return 0;
 	for (unsigned int a = startFrom; number == 0; a++) {
-		i = inodeLoad (a, d);
-		if (!i) break;
-		if (inodeGetBlockAddr(i, 0) == 0)
-			number = inodeGetNumber(i);
-		free (i);
+		if ( inodeLoadInto (&i, a, d) < 0 ) break;
+		if (inodeGetBlockAddr(&i, 0) == 0)
+			number = inodeGetNumber(&i);
 	}
 	return number;
 }
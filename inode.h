@@ -15,15 +15,66 @@
 
 #include "disk.h"
 
+#define INODE_SIZE 16		//Tamanho do i-node em numero de unsigned ints
+#define NUMBLOCKS_PERINODE 8	//No. de enderecos de bloco por i-node
+#define NUMITEMS_PERINODE (INODE_SIZE - 2)	//Numero de "itens" por i-node
+
 //Tipo para representacao de i-nodes
 typedef struct inode Inode;
 
+//Tamanho, em bytes, do espaco ocupado por um i-node em memoria
+#define INODE_STORAGESIZE (INODE_SIZE * sizeof (unsigned int) + \
+                           3 * sizeof (void *))
+
+//Estrutura para a representacao de i-nodes. E' exposta apenas como espaco
+//opaco, para que o chamador possa reservar um i-node (p.ex. na pilha) e usar
+//inodeLoadInto/inodeCreateInto sem alocacao dinamica. Seu conteudo e'
+//privado, portanto use as funcoes externalizadas por inode.h.
+struct inode {
+	union {
+		unsigned char bytes[INODE_STORAGESIZE];
+		void *align;
+	} storage;		//Espaco interpretado apenas por inode.c
+};
+
+//Tipo de funcao usada por inodeAddBlock para obter um i-node livre, a ser
+//usado como extensao, proximo ao i-node de numero near. Retorna o numero do
+//i-node obtido ou 0 se nao houver i-node livre
+typedef unsigned int (*InodeAllocFn) (Disk *d, unsigned int near);
+
+//Tipo de funcao usada por inodeClear para liberar um i-node de extensao
+typedef void (*InodeReleaseFn) (Disk *d, unsigned int number);
+
+//Tipo das funcoes usadas para ler ou gravar um setor (addr) da area de
+//i-nodes de um disco. Retornam 0 se bem sucedidas ou -1, caso contrario
+typedef int (*InodeSectorFn) (Disk *d, unsigned long addr,
+                              unsigned char *sector);
+
 //Funcao que retorna o numero de i-nodes por setor
 unsigned int inodeNumInodesPerSector ( void );
 
 //Funcao que retorna o numero do primeiro setor da area de i-nodes
 unsigned int inodeAreaBeginSector ( void );
 
+//Funcao que define a geometria da area de i-nodes de um disco dividido em
+//grupos de sectorsPerGroup setores, cada um com inodesPerGroup i-nodes a
+//partir do setor tableOffset do grupo. Com inodesPerGroup igual a 0, os
+//i-nodes voltam a ser contiguos a partir de inodeAreaBeginSector. Retorna 0
+//se bem sucedido ou -1, caso contrario
+int inodeSetGeometry (Disk *d, unsigned int inodesPerGroup,
+                      unsigned long sectorsPerGroup, unsigned int tableOffset);
+
+//Funcao que define as funcoes usadas por inodeAddBlock para obter i-nodes
+//de extensao e por inodeClear para libera-los. Sem alocador definido (NULL),
+//extensoes sao obtidas com inodeFindFreeInode e nao ha liberacao
+void inodeSetAllocator (Disk *d, InodeAllocFn allocFn,
+                        InodeReleaseFn releaseFn);
+
+//Funcao que define as funcoes usadas para ler e gravar os setores da area de
+//i-nodes de um disco, como as de um journal. Sem funcoes definidas (NULL),
+//os setores sao lidos e gravados diretamente no disco
+void inodeSetSectorIO (Disk *d, InodeSectorFn readFn, InodeSectorFn writeFn);
+
 //Funcao que cria um i-node vazio, identificado pelo seu numero (number),
 //que deve ser unico no sistema de arquivos. Retorna ponteiro para o i-node
 //criado ou NULL se nao houver memoria suficiente ou number invalido. A funcao
@@ -31,6 +82,11 @@ unsigned int inodeAreaBeginSector ( void );
 //existente
 Inode* inodeCreate (unsigned int number, Disk *d);
 
+//Funcao equivalente a inodeCreate, mas que usa o espaco fornecido pelo
+//chamador em *i, sem alocacao dinamica. Retorna 0 se bem sucedido ou -1,
+//caso contrario
+int inodeCreateInto (Inode *i, unsigned int number, Disk *d);
+
 //Funcao que limpa todo o conteudo de um i-node. O i-node e' salvo em disco,
 //sobrescrevendo-o se ja existente. Retorna 0 se bem sucedido ou -1, caso
 //contrario
@@ -42,9 +98,29 @@ int inodeClear (Inode *i);
 int inodeSave (Inode *i);
 
 //Funcao que recupera um i-node a partir do disco. Retorna ponteiro para o
-//i-node lido ou NULL em caso de falha.
+//i-node lido ou NULL em caso de falha. O i-node e' obtido do pool do disco
+//e deve ser devolvido com inodeFree (nunca com free)
 Inode* inodeLoad (unsigned int number, Disk *d);
 
+//Funcao equivalente a inodeLoad, mas que le o i-node para o espaco fornecido
+//pelo chamador em *i, sem alocacao dinamica. Retorna 0 se bem sucedido ou -1,
+//caso contrario
+int inodeLoadInto (Inode *i, unsigned int number, Disk *d);
+
+//Funcao equivalente a inodeLoadInto, mas que decodifica o i-node a partir
+//de uma copia de sua area no disco em data (INODE_SIZE unsigned ints no
+//formato gravado em disco), sem ler o disco
+void inodeLoadFrom (Inode *i, Disk *d, unsigned char *data);
+
+//Funcao que devolve ao pool de seu disco um i-node obtido por inodeLoad ou
+//inodeCreate. I-nodes em espaco do chamador sao ignorados
+void inodeFree (Inode *i);
+
+//Funcao que libera toda a memoria do pool de i-nodes de um disco, bem como
+//sua geometria e alocador. Nenhum i-node do pool pode estar em uso. Deve ser
+//chamada ao desconectar o disco
+void inodePoolDestroy (Disk *d);
+
 //Funcao que modifica o tipo de arquivo referente a um i-node
 void inodeSetFileType (Inode *i, unsigned int fileType);
 
@@ -68,12 +144,28 @@ void inodeSetRefCount (Inode *i, unsigned int refCount);
 //E' a unica funcao que salva automaticamente o i-node em disco
 int inodeAddBlock (Inode *i, unsigned int blockAddr);
 
+//Funcao que adiciona count enderecos ao fim do array de blocos de um i-node,
+//salvando cada i-node da cadeia alterado uma unica vez. Retorna -1 caso a
+//inclusao de algum endereco nao seja bem sucedida
+int inodeAddBlocks (Inode *i, const unsigned int *addrs, unsigned int count);
+
 //Funcao que retorna o numero de um i-node.
 unsigned int inodeGetNumber (Inode *i);
 
 //Funcao que retorna o numero de um i-node.
 unsigned int inodeGetNextNumber (Inode *i);
 
+//Funcao que modifica o numero do proximo i-node da cadeia de um i-node (0:
+//sem extensoes). O i-node de extensao em si nao e' alterado
+void inodeSetNextNumber (Inode *i, unsigned int next);
+
+//Funcao que retorna o item (0 a NUMITEMS_PERINODE-1) de um i-node. Em um
+//i-node de extensao, todos os itens sao enderecos de bloco
+unsigned int inodeGetItem (Inode *i, unsigned int item);
+
+//Funcao que modifica o item (0 a NUMITEMS_PERINODE-1) de um i-node
+void inodeSetItem (Inode *i, unsigned int item, unsigned int value);
+
 //Funcao que retorna o tipo de arquivo referente a um i-node.
 unsigned int inodeGetFileType (Inode *i);
 
@@ -97,6 +189,20 @@ unsigned int inodeGetRefCount (Inode *i);
 //Retorna 0 se o bloco nao possuir endereco em blockNum
 unsigned int inodeGetBlockAddr (Inode *i, unsigned int blockNum);
 
+//Funcao que copia para addrs os enderecos dos blocos first a first+count-1
+//de um i-node, lendo cada i-node de extensao da cadeia uma unica vez. O
+//i-node precisa ser o primeiro de sua cadeia. Retorna o numero de enderecos
+//copiados, menor que count se a cadeia terminar antes
+unsigned int inodeGetBlockAddrs (Inode *i, unsigned int first,
+                                 unsigned int count, unsigned int *addrs);
+
+//Funcao que substitui os enderecos dos blocos first a first+count-1 de um
+//i-node pelos de addrs, salvando uma unica vez cada i-node alterado da
+//cadeia. O i-node precisa ser o primeiro de sua cadeia e os blocos precisam
+//existir. Retorna 0 se bem sucedido ou -1, caso contrario
+int inodeSetBlockAddrs (Inode *i, unsigned int first, unsigned int count,
+                        const unsigned int *addrs);
+
 //Funcao que encontra um i-node livre em um disco, a partir do i-node de numero
 //startFrom. Retorna o numero do inode livre encontrado ou 0 se nao encontrado.
 unsigned int inodeFindFreeInode (unsigned int startFrom, Disk *d);
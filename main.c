@@ -23,6 +23,8 @@
 
 #define NO_ID -1
 
+#define DIRLIST_BATCH 64 //Entradas lidas por chamada na listagem de diretorios
+
 //Tipo para manter dados sobre descritores de arquivos
 typedef struct fd {
 	int status; //Status do descritor de arquivos: 0 fechado, 1 aberto
@@ -183,6 +185,7 @@ void doDiskDisconnect ( int id ) {
 			        "disconnect the root filesystem disk\n");
 		else {
 			printf ("\n-- Disconnecting... "); fflush (stdout);
+			inodePoolDestroy (disks[id]);
 			if ( diskDisconnect (disks[id]) > -1 ) {
 				printf ("Disk %d successfully disconnected."
 					"\n", id);
@@ -235,6 +238,59 @@ void doFSFormat (void) {
 	SLEEP (RESULT_MSGDELAY);
 }
 
+//Interface para verificar (e opcionalmente corrigir) a consistencia do
+//sistema de arquivos de um disco conectado que nao seja o raiz
+void doFSCheck (void) {
+	if ( !connectedDisks )
+		printf ("\n!! FSCheck: FAILED. No connected disks!\n");
+	else {
+		int id;
+		printf ("\n>> FSCheck: Disk ID: ");
+		scanf (" %u", &id);
+		if ( id > MAX_CONNECTEDDISKS - 1 || !disks[id])
+			printf ("\n!! FSCheck: FAILED. "
+			        "Invalid identifier!\n");
+		else if (disks[id] == rd) 
+			printf ("\n!! FSCheck: FAILED. "
+			        "Cannot check the root filesystem disk\n");
+		else {
+			int fsid;
+			char repair;
+			FSCheckInfo info;
+			printf (">> FSCheck: Filesystem ID: ");
+			scanf (" %u", &fsid);
+			printf (">> FSCheck: Repair errors (y/n): ");
+			scanf (" %c", &repair);
+			printf ("\n-- Checking... "); fflush (stdout);
+			if ( vfsCheck (disks[id], fsid, &info,
+			               repair == 'Y' || repair == 'y') > -1 ) {
+				printf ("%u files and directories checked.\n",
+				        info.inodes);
+				printf ("-- Blocks: %u bad; %u shared; %u map "
+				        "errors; %u reference count errors; %u "
+				        "fragment errors\n", info.badBlocks,
+				        info.dupBlocks, info.blockMapErrors,
+				        info.refCountErrors, info.fragErrors);
+				printf ("-- I-nodes: %u bad chains; %u bad sizes; "
+				        "%u map errors; %u link count errors; "
+				        "%u orphans\n", info.badChains,
+				        info.badSizes, info.inodeMapErrors,
+				        info.linkErrors, info.orphans);
+				printf ("-- Directories: %u bad entries; "
+				        "Counters: %u errors\n", info.badEntries,
+				        info.counterErrors);
+				printf ("-- %u errors found; %u fixed\n",
+				        info.errors, info.fixed);
+			}
+			else
+				printf ("\n!! FSCheck: FAILED. Filesystem "
+				        "not supported, disk in use or "
+				        "operation failed!\n");
+		}
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
 //Interface para montar um disco conectado ao sistema operacional hipotetico,
 //para atuar como sistema de arquivos raiz
 void doFSMountRoot (void) {
@@ -293,6 +349,57 @@ void doFSShowFDs (void) {
 }
 
 
+//Interface para desfragmentar o sistema de arquivos raiz, mostrando os
+//trechos contiguos dos arquivos antes e depois e os seeks economizados
+void doFSDefrag (void) {
+	FSDefragInfo info;
+	if ( !rd )
+		printf ("\n!! Defrag: FAILED. No root filesystem mounted!\n");
+	else {
+		printf ("\n-- Defragmenting... "); fflush (stdout);
+		if ( vfsDefrag (&info) > -1 ) {
+			printf ("Disk %d successfully defragmented.\n",
+			        diskGetId(rd));
+			printf ("-- Files: %u; Moved: %u; Busy (open): %u\n",
+			        info.files, info.filesMoved, info.filesBusy);
+			printf ("-- Extents: %u before; %u after\n",
+			        info.extentsBefore, info.extentsAfter);
+			printf ("-- Free space runs: %u before; %u after\n",
+			        info.freeRunsBefore, info.freeRunsAfter);
+			printf ("-- Reading every file once saves about %u "
+			        "seeks and %lu cylinder moves\n",
+			        info.extentsBefore - info.extentsAfter,
+			        (info.cylsBefore > info.cylsAfter
+			         ? info.cylsBefore - info.cylsAfter : 0));
+		}
+		else
+			printf ("\n!! Defrag: FAILED. Filesystem does not "
+			        "support it or operation failed!\n");
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
+//Interface para mostrar as estatisticas de uso do sistema de arquivos raiz
+void doFSStatfs (void) {
+	FSStatInfo info;
+	if ( !rd )
+		printf ("\n!! Statfs: FAILED. No root filesystem mounted!\n");
+	else if ( vfsStatfs (&info) > -1 ) {
+		printf ("\n-- Statfs: Disk %d, block size %u bytes\n",
+		        diskGetId(rd), info.blockSize);
+		printf ("-- Blocks: %u total; %u free; %u available\n",
+		        info.totalBlocks, info.freeBlocks, info.availBlocks);
+		printf ("-- I-nodes: %u total; %u free\n",
+		        info.totalInodes, info.freeInodes);
+		printf ("-- Bytes in files and directories: %llu\n",
+		        info.usedBytes);
+	}
+	else
+		printf ("\n!! Statfs: FAILED. Filesystem does not "
+		        "support it or operation failed!\n");
+	SLEEP (RESULT_MSGDELAY);
+}
+
 //Interface para desmontar o atual sistema de arquivos raiz
 void doFSUnmountRoot (void) {
 	if ( !rd )
@@ -407,6 +514,96 @@ void doFileWrite (void) {
 	SLEEP (RESULT_MSGDELAY);
 }
 
+//Interface para posicionar o cursor de um arquivo aberto
+void doFileSeek (void) {
+	if ( !rd )
+		printf ("\n!! FileSeek: FAILED. No root filesystem "
+		        "mounted!\n");
+	else {
+		int fd;
+		unsigned int offset;
+		printf ("\n>> FileSeek: File descriptor (#): ");
+		scanf (" %u", &fd);
+		printf (">> FileSeek: Offset in bytes (may be past the end): ");
+		scanf (" %u", &offset);
+		if ( vfsSeek (fd, offset) > -1 )
+			printf ("\n-- File %s cursor moved to byte %u.\n",
+			        fds[fd-1].path, offset);
+		else
+			printf ("\n!! FileSeek: FAILED. Invalid file "
+			        "descriptor or seek not supported!\n");
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
+//Interface para ligar ou desligar a compressao dos blocos de um arquivo aberto
+void doFileCompress (void) {
+	if ( !rd )
+		printf ("\n!! FileCompress: FAILED. No root filesystem "
+		        "mounted!\n");
+	else {
+		int fd, on;
+		printf ("\n>> FileCompress: File descriptor (#): ");
+		scanf (" %u", &fd);
+		printf (">> FileCompress: Compress blocks (1) or not (0): ");
+		scanf (" %d", &on);
+		if ( vfsSetCompression (fd, on) > -1 )
+			printf ("\n-- File %s compression turned %s.\n",
+			        fds[fd-1].path, (on ? "on" : "off"));
+		else
+			printf ("\n!! FileCompress: FAILED. Invalid file "
+			        "descriptor, no space or compression not "
+			        "supported!\n");
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
+//Interface para ligar ou desligar a deduplicacao dos blocos de um arquivo
+//aberto
+void doFileDedup (void) {
+	if ( !rd )
+		printf ("\n!! FileDedup: FAILED. No root filesystem "
+		        "mounted!\n");
+	else {
+		int fd, on;
+		printf ("\n>> FileDedup: File descriptor (#): ");
+		scanf (" %u", &fd);
+		printf (">> FileDedup: Share duplicate blocks (1) or not (0): ");
+		scanf (" %d", &on);
+		if ( vfsSetDedup (fd, on) > -1 )
+			printf ("\n-- File %s deduplication turned %s.\n",
+			        fds[fd-1].path, (on ? "on" : "off"));
+		else
+			printf ("\n!! FileDedup: FAILED. Invalid file "
+			        "descriptor or deduplication not "
+			        "supported!\n");
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
+//Interface para clonar um arquivo, sem copiar seus dados, em um novo arquivo
+void doFileClone (void) {
+	if ( !rd )
+		printf ("\n!! FileClone: FAILED. No root filesystem "
+		        "mounted!\n");
+	else {
+		char srcPath[MAX_FILENAME_LENGTH+1];
+		char dstPath[MAX_FILENAME_LENGTH+1];
+		printf ("\n>> FileClone: Source file path (e.g. /home/moreno/doc1): ");
+		scanf (" %s", srcPath);
+		printf (">> FileClone: New file path (e.g. /home/moreno/doc2): ");
+		scanf (" %s", dstPath);
+		printf ("\n-- Cloning... "); fflush (stdout);
+		if ( vfsClone (srcPath, dstPath) > -1 )
+			printf ("File %s successfully cloned as %s.\n",
+			        srcPath, dstPath);
+		else
+			printf ("\n!! FileClone: FAILED. Invalid paths, new "
+				"path exists or clone not supported!\n");
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
 //Interface para fechar um arquivo aberto
 void doFileClose (int fd) {
 	if ( !rd )
@@ -471,10 +668,24 @@ void doDirList (void) {
 		int fd, res;
 		char entryname[MAX_FILENAME_LENGTH+1];
 		unsigned int inumber;
+		FSDirEntry *entries = malloc (DIRLIST_BATCH * sizeof(FSDirEntry));
 		printf ("\n>> DirList: Directory descriptor (#): ");
 		scanf (" %u", &fd);
 		printf ("\n-- DirList: Listing...\n"); fflush (stdout);
-		res = vfsReaddir (fd, entryname, &inumber);
+		//Em lote, com atributos, se o sistema de arquivos permitir
+		res = (entries ? vfsReaddirPlus (fd, entries, DIRLIST_BATCH) : -1);
+		while ( res > 0 ) {
+			for (int a=0; a<res; a++)
+				printf ("-- Inode #: %5u %s Size: %10u Refs: %3u "
+				        "Name: %s\n", entries[a].inumber,
+				        (entries[a].type == FILETYPE_DIR ? "dir " :
+				         "file"), entries[a].size,
+				        entries[a].refCount, entries[a].name);
+			res = vfsReaddirPlus (fd, entries, DIRLIST_BATCH);
+		}
+		free (entries);
+		if ( res == -1 )
+			res = vfsReaddir (fd, entryname, &inumber);
 		while ( res > 0 ) {
 			printf ("-- Inode #: %5d     Name: %s\n",
 			        inumber, entryname);
@@ -591,6 +802,27 @@ char sanitizeBeforeQuit () {
 	return 'q';
 }
 
+//Interface para remover um diretorio (ou arquivo) e tudo o que houver abaixo
+//dele
+void doDirRemoveTree (void) {
+	if ( !rd )
+		printf ("\n!! DirRemoveTree: FAILED. No root filesystem "
+		        "mounted!\n");
+	else {
+		char path[MAX_FILENAME_LENGTH+1];
+		printf ("\n>> DirRemoveTree: Path (e.g. /home/moreno): ");
+		scanf (" %s", path);
+		printf ("\n-- Removing... "); fflush (stdout);
+		if ( vfsRemoveTree (path) == 0 )
+			printf ("%s and everything below it successfully "
+			        "removed.\n", path);
+		else
+			printf ("\n!! DirRemoveTree: FAILED. Invalid path, "
+			        "directory in use or removal not supported!\n");
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
 //Interface para o menu de selecao de operacoes sobre diretorios
 void dirMenuSelection (void) {
 	char choice = ' ';
@@ -601,6 +833,7 @@ void dirMenuSelection (void) {
 		          "     [L]ist directory entries\n"
 		          "     [A]dd a new entry to directory (Link)\n"
 			  "     [R]emove an entry from directory (Unlink)\n"
+		          "     [D]elete a directory tree (recursive)\n"
 		          "     [C]lose directory\n"
 		          "     [<]back to MAIN menu\n"
 		          "\n>> Your selection: ", connectedDisks,
@@ -611,6 +844,7 @@ void dirMenuSelection (void) {
 			case 'L': case 'l': doDirList(); break;
 			case 'A': case 'a': doDirLink(); break;
 			case 'R': case 'r': doDirUnlink(); break;
+			case 'D': case 'd': doDirRemoveTree(); break;
 			case 'C': case 'c': doDirClose(NO_ID); break;
 		}
 	}
@@ -626,6 +860,10 @@ void fileMenuSelection (void) {
 			  "     [O]pen file\n"
 		          "     [R]ead bytes from file\n"
 		          "     [W]rite bytes to file\n"
+		          "     [S]eek to byte offset\n"
+		          "    clo[N]e file\n"
+		          "     [Z]ip (compress) file blocks on/off\n"
+		          "     [D]eduplicate file blocks on/off\n"
 			  "     [C]lose file\n"
 		          "     [<]back to MAIN menu\n"
 		          "\n>> Your selection: ", connectedDisks,
@@ -635,6 +873,10 @@ void fileMenuSelection (void) {
 			case 'O': case 'o': doFileOpen(); break;
 			case 'R': case 'r': doFileReadPrint(); break;
 			case 'W': case 'w': doFileWrite(); break;
+			case 'S': case 's': doFileSeek(); break;
+			case 'N': case 'n': doFileClone(); break;
+			case 'Z': case 'z': doFileCompress(); break;
+			case 'D': case 'd': doFileDedup(); break;
 			case 'C': case 'c': doFileClose(NO_ID); break;
 		}
 	}
@@ -649,8 +891,11 @@ void fsMenuSelection (void) {
 			  "               Disks: %u / Root Disk: %d\n"
 			  "     [L]ist supported filesystems\n"
 		          "     [F]ormat a disk (high-level format)\n"
+		          "     [C]heck a disk (fsck)\n"
 		          "     [M]ount root filesystem\n"
 		          "     [S]how file descriptors in use\n"
+		          "     [D]efragment root filesystem\n"
+		          "     s[T]atistics of root filesystem usage\n"
 			  "     [U]mount root filesystem\n"
 		          "     [<]back to MAIN menu\n"
 		          "\n>> Your selection: ", connectedDisks,
@@ -661,8 +906,11 @@ void fsMenuSelection (void) {
 			                    SLEEP(RESULT_MSGDELAY);
 					    break;
 			case 'F': case 'f': doFSFormat(); break;
+			case 'C': case 'c': doFSCheck(); break;
 			case 'M': case 'm': doFSMountRoot(); break;
 			case 'S': case 's': doFSShowFDs(); break;
+			case 'D': case 'd': doFSDefrag(); break;
+			case 'T': case 't': doFSStatfs(); break;
 			case 'U': case 'u': doFSUnmountRoot(); break;
 		}
 	}
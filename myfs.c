@@ -8,24 +8,6444 @@
  *
  */
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "myfs.h"
 #include "vfs.h"
 #include "inode.h"
 #include "util.h"
 
+#define MYFS_MAGIC 0x4D794653 // Assinatura do superbloco ("MyFS")
+#define MYFS_SUPERBLOCK_SECTOR 0
+#define MYFS_MAX_DISKS 4	   // Numero maximo de discos com MyFS carregado
+#define MYFS_INODE_RATIO 4	   // Um i-node para cada MYFS_INODE_RATIO blocos
+#define MYFS_ROOT_INODE 1	   // Numero do i-node do diretorio raiz
+#define MYFS_GROUP_CYLINDERS 16 // Cilindros por grupo de cilindros
+#define MYFS_NODE_HASH 64	   // Listas da tabela de i-nodes em memoria
+#define MYFS_DCACHE_SIZE 512	   // Entradas no cache de nomes
+#define MYFS_DCACHE_HASH 256	   // Listas do cache de nomes
+#define MYFS_RA_INITIAL 4		   // Janela inicial de leitura antecipada
+#define MYFS_RA_MAX_BYTES 262144   // Janela maxima de leitura antecipada
+#define MYFS_WB_MAX_BYTES 1048576  // Dados pendentes por arquivo
+#define MYFS_WB_TOTAL_BYTES 4194304 // Dados pendentes por disco
+#define MYFS_JOURNAL_SECTORS 2048  // Tamanho desejado do journal, em setores
+#define MYFS_JOURNAL_MIN 64		   // Tamanho minimo do journal, em setores
+#define MYFS_JOURNAL_HASH 256	   // Listas dos setores do journal em memoria
+#define MYFS_JOURNAL_INTERVAL 5	   // Segundos maximos entre commits
+#define MYFS_DEFRAG_BYTES 262144   // Dados copiados de uma vez na desfragmentacao
+#define MYFS_DEFRAG_PASSES 3	   // Passadas sobre os arquivos na desfragmentacao
+#define MYFS_ITABLE_CHUNK 16	   // Setores de i-nodes zerados de uma vez
+#define MYFS_FILL_BYTES 262144	   // Dados gravados de uma vez em buracos
+#define MYFS_READDIR_GAP 16		   // Setores de i-nodes pulados em uma leitura
+#define MYFS_FRAG_OPEN 32		   // Blocos de fragmentos com espaco em memoria
+#define MYFS_FRAG_MAX_SPB 64	   // Setores por bloco com fragmentos, no maximo
+#define MYFS_CHECK_THREADS 4	   // Threads da verificacao de consistencia
+
+// Arquivos esparsos: um endereco de bloco de i-node com o bit MYFS_HOLE e'
+// um buraco, isto e', uma sequencia de blocos nao alocados, lidos como
+// zeros, cujo tamanho sao os demais bits. No vetor de enderecos em memoria,
+// cada bloco de um buraco vale MYFS_HOLE
+#define MYFS_HOLE 0x80000000u
+
+// Fim de arquivo em fragmento: o ultimo bloco incompleto de um arquivo pode
+// ocupar apenas os setores de que precisa em um bloco de fragmentos,
+// compartilhado com os fins de outros arquivos. Seu endereco e' o do
+// primeiro setor do fragmento (bloco e deslocamento) com o bit MYFS_TAIL, e
+// o numero de setores vem do tamanho do arquivo. O primeiro setor de um
+// bloco de fragmentos e' seu cabecalho: magic e mapa dos setores em uso
+#define MYFS_TAIL 0x40000000u
+#define MYFS_FRAG_MAGIC 0x47464D59 // Cabecalho de bloco de fragmentos ("YMFG")
+
+// Compressao: nos arquivos com MYFS_PERM_COMPRESS no item de permissoes,
+// cada bloco e' comprimido (LZ) ao ser gravado e vai para um fragmento se
+// ocupar comprimido ao menos dois setores a menos que um bloco; os demais
+// ficam em blocos proprios. Nesses arquivos, todo endereco com MYFS_TAIL e'
+// de um bloco comprimido, com o numero de setores menos 1 a partir do bit
+// MYFS_ZIP_SHIFT (o disco deve ter menos de 2^MYFS_ZIP_SHIFT setores), de
+// modo que qualquer bloco e' lido sem ler os outros. Os dados de um bloco
+// comprimido comecam com os tamanhos comprimido e original, de 16 bits
+// cada; tamanhos iguais indicam dados guardados sem compressao (o ultimo
+// bloco, incompleto, que nao comprima)
+#define MYFS_PERM_COMPRESS 0x80000000u
+#define MYFS_ZIP_SHIFT 24
+#define MYFS_ZIP_HEADER 4	   // Tamanhos comprimido e original
+#define MYFS_LZ_HASH_BITS 12 // Posicoes lembradas pelo compressor
+#define MYFS_LZ_MIN_MATCH 4  // Menor repeticao codificada
+
+// Blocos compartilhados: com MYFS_FEAT_REFCOUNT, cada grupo guarda, logo
+// depois do mapa de bits de blocos, um contador de um byte por bloco com as
+// referencias alem da primeira. Um bloco com contador 0 pertence a um unico
+// arquivo; liberar um bloco compartilhado apenas decrementa o contador, e
+// escrever nele grava antes uma copia propria do arquivo (copy-on-write)
+#define MYFS_FEAT_REFCOUNT 0x1 // Contadores de referencias de blocos
+#define MYFS_FEAT_USAGE 0x2	   // Bytes em uso mantidos no superbloco
+#define MYFS_REFCOUNT_MAX 255  // Referencias extras de um bloco, no maximo
+
+// Deduplicacao: com MYFS_FEAT_DEDUP, cada grupo guarda, depois dos
+// contadores de referencias, a impressao (hash de 32 bits; 0: nenhuma) do
+// conteudo de cada bloco gravado inteiro por um arquivo com MYFS_PERM_DEDUP
+// no item de permissoes. Um bloco completo desses arquivos com o mesmo
+// conteudo de um bloco ja' gravado (conferido byte a byte) passa a
+// compartilha-lo, como um clone, em vez de ocupar um bloco novo. As
+// impressoes ficam em memoria, com um indice montado no primeiro uso; a de
+// um bloco e' apagada quando ele e' alocado de novo
+#define MYFS_FEAT_DEDUP 0x4		   // Impressoes do conteudo dos blocos
+#define MYFS_PERM_DEDUP 0x40000000u
+#define MYFS_DEDUP_PROBES 4		   // Blocos conferidos por busca, no maximo
+
+// Remocao adiada: um arquivo ou diretorio que perde a ultima referencia
+// entra na lista de orfaos, com MYFS_PERM_ORPHAN no item de permissoes e o
+// proximo da lista no item de dono; o primeiro fica no superbloco. Seu
+// espaco e' liberado depois, aos poucos, ao fim das operacoes seguintes: uma
+// extensao da cadeia por vez e, por fim, o proprio i-node. A lista e'
+// esvaziada de vez quando o disco fica ocioso ou falta espaco, e sobrevive
+// a uma queda, sendo retomada depois da montagem
+#define MYFS_PERM_ORPHAN 0x20000000u
+#define MYFS_ORPHAN_BATCH 16 // Extensoes liberadas ao fim de uma operacao
+#define MYFS_TREE_BATCH 64	 // Entradas lidas de uma vez ao remover subarvores
+
+// Layout de cada grupo de cilindros, em setores a partir do inicio do grupo:
+// copia do superbloco (o original fica no grupo 0), descritor do grupo,
+// tabela de i-nodes (a partir de inodeAreaBeginSector), mapa de bits de
+// i-nodes, mapa de bits de blocos, contadores de referencias dos blocos (se
+// houver) e, enfim, os blocos de dados do grupo.
+// Grupos e tabelas de i-nodes sao gravados em disco apenas no primeiro uso,
+// de modo que a formatacao so' grava o grupo 0
+#define MYFS_GROUP_SBCOPY 0
+#define MYFS_GROUP_DESC 1
+
+#define MYFS_BITS_PER_WORD 64
+#define MYFS_BITS_PER_SECTOR (DISK_SECTORDATASIZE * 8)
+#define MYFS_WORDS_PER_SECTOR (MYFS_BITS_PER_SECTOR / MYFS_BITS_PER_WORD)
+#define MYFS_WORD_FULL (~0ULL)
+
+// Contagem de zeros a direita de uma palavra de 64 bits nao nula e contagem
+// de bits em 1 de uma palavra de 64 bits
+#if defined(__GNUC__) || defined(__clang__)
+#define MYFS_CTZ64(x) ((unsigned int)__builtin_ctzll(x))
+#define MYFS_POPCOUNT64(x) ((unsigned int)__builtin_popcountll(x))
+#else
+static unsigned int MYFS_CTZ64(unsigned long long x)
+{
+	unsigned int n = 0;
+	while (!(x & 1ULL))
+	{
+		x >>= 1;
+		n++;
+	}
+	return n;
+}
+
+static unsigned int MYFS_POPCOUNT64(unsigned long long x)
+{
+	unsigned int n = 0;
+	for (; x; x &= x - 1)
+		n++;
+	return n;
+}
+#endif
+
+// Mapa de bits em memoria (1: ocupado), com um resumo de um bit por palavra
+// (1: palavra cheia) para pular regioes cheias nas buscas
+typedef struct myfs_bitmap
+{
+	unsigned long long *words;
+	unsigned long long *summary;
+	unsigned int numBits;
+	unsigned int numWords;
+	unsigned int numSummaryWords;
+} MyFSBitmap;
+
+// Bloco de fragmentos com setores livres, mantido em memoria para receber
+// novos fragmentos. used tem um bit por setor do bloco (1: em uso), e o do
+// cabecalho esta' sempre em uso
+typedef struct myfs_frag
+{
+	unsigned int block;		 // Numero do bloco
+	unsigned long long used; // Setores em uso
+} MyFSFrag;
+
+// Contadores de um grupo de cilindros, persistidos no descritor do grupo
+typedef struct myfs_group
+{
+	unsigned int freeBlocks; // Blocos livres no grupo
+	unsigned int freeInodes; // I-nodes livres no grupo
+	unsigned int numDirs;	 // Diretorios cujo i-node esta' no grupo
+	unsigned int itableUnused; // Setores finais da tabela de i-nodes ainda
+							   // nao zerados
+	int unread; // Mapas ainda nao lidos (montagem rapida): parecem cheios
+	int hot;	// Mapas usados desde a montagem
+	int warm;	// Mapas a ler antecipadamente (aquecimento)
+} MyFSGroup;
+
+// Diretorios sao tabelas de hashing extensivel. O bloco logico 0 e' o
+// cabecalho: profundidade global e, enquanto couberem, as entradas da tabela
+// (numeros de blocos logicos de folhas); depois disso, os numeros dos blocos
+// de indice que guardam a tabela. Cada folha guarda entradas cujo hash do
+// nome tem os mesmos localDepth bits menos significativos. Folhas na
+// profundidade maxima podem ser encadeadas em blocos de transbordo. Folhas
+// que esvaziam sao juntadas 'a irma; blocos que deixam de ser usados formam
+// uma lista de blocos livres do diretorio, cujo inicio fica nos ultimos
+// bytes do cabecalho, e sao reaproveitados antes de o diretorio crescer
+#define MYFS_DIR_HDR_MAGIC 0x48444D59  // Cabecalho ("YMDH")
+#define MYFS_DIR_IDX_MAGIC 0x49444D59  // Bloco de indice ("YMDI")
+#define MYFS_DIR_LEAF_MAGIC 0x4C444D59 // Folha ("YMDL")
+#define MYFS_DIR_FREE_MAGIC 0x46444D59 // Bloco livre ("YMDF")
+#define MYFS_DIR_HDR_SIZE 12  // magic, globalDepth, numIndexBlocks
+#define MYFS_DIR_HDR_TAIL 4	  // Primeiro bloco livre, no fim do cabecalho
+#define MYFS_DIR_IDX_SIZE 4	  // magic
+#define MYFS_DIR_LEAF_SIZE 20 // magic, localDepth, numEntries, used, next
+#define MYFS_DIR_ENTRY_SIZE 5 // Numero do i-node e tamanho do nome
+#define MYFS_DIR_LEAF_DEPTH 4 // Posicoes dos campos na folha, em bytes
+#define MYFS_DIR_LEAF_COUNT 8
+#define MYFS_DIR_LEAF_USED 12
+#define MYFS_DIR_LEAF_NEXT 16
+
+// Journal de metadados: regiao circular de setores contiguos no grupo 0. O
+// primeiro setor e' o superbloco do journal (magic, id, inicio do log e
+// sequencia da transacao que comeca ali); os demais formam o log. Cada
+// transacao e' gravada no log como descritores (magic, id, sequencia,
+// quantidade e setores home), cada um seguido dos setores que descreve, e
+// termina com um setor de commit (magic, id, sequencia e checksum)
+#define MYFS_JSB_MAGIC 0x534A594D	   // Superbloco do journal ("MYJS")
+#define MYFS_JDESC_MAGIC 0x444A594D   // Descritor ("MYJD")
+#define MYFS_JCOMMIT_MAGIC 0x434A594D // Commit ("MYJC")
+#define MYFS_JDESC_SIZE 16			   // magic, id, seq, count
+#define MYFS_JTAGS_PER_DESC ((DISK_SECTORDATASIZE - MYFS_JDESC_SIZE) / \
+							 sizeof(unsigned int))
+
+// Montagem rapida: ao desmontar, com o journal vazio, o estado do alocador
+// (contadores de cada grupo, bloco a partir do qual buscar espaco e blocos
+// de fragmentos com espaco) e' gravado no log, na posicao em que a
+// recuperacao comecaria, e o superbloco passa a indicar seu tamanho. Se a
+// montagem seguinte nao tiver transacoes a refazer, o resumo e' lido em uma
+// unica transferencia e os mapas de cada grupo so' sao lidos no primeiro uso
+// do grupo. A primeira alteracao de metadados depois do resumo o invalida no
+// superbloco; sem ele, como apos uma queda, todos os grupos sao lidos e
+// recontados na montagem. O primeiro setor do resumo tem magic, id e
+// sequencia do journal, checksum dos demais dados, numero de grupos, bloco
+// de busca, setores de aquecimento e os blocos de fragmentos (bloco e
+// setores em uso); os seguintes, os contadores dos grupos e, por fim, os
+// setores de aquecimento.
+// Aquecimento: o resumo leva tambem o que estava quente ao desmontar. As
+// entradas mais recentes do cache de nomes (pai, i-node, tamanho e nome,
+// da mais antiga para a mais recente) voltam ao cache na montagem rapida,
+// sem ler diretorios. Os grupos cujos mapas foram usados na sessao sao
+// lidos antecipadamente, em ordem crescente de grupo (e de setor), alguns a
+// cada abertura de arquivo ou fim de operacao, em vez de um a um no meio do
+// acesso aos dados
+#define MYFS_SUMMARY_MAGIC 0x4D53594D // Resumo do alocador ("MYSM")
+#define MYFS_SUMMARY_HEADER 8		  // Palavras antes dos fragmentos
+#define MYFS_SUMMARY_GROUP 5		  // Palavras por grupo
+#define MYFS_SB_SUMMARY 15			  // Palavra do superbloco com seu tamanho
+#define MYFS_WARM_SECTORS 16		  // Maximo de setores para o cache de nomes
+#define MYFS_WARM_BATCH 4			  // Grupos lidos antecipadamente por vez
+
+struct myfs_node;
+
+// Setor de metadados alterado e ainda nao gravado no lugar (setor home). Se
+// running, a alteracao pertence 'a transacao em andamento; caso contrario,
+// a uma transacao ja' gravada no log
+typedef struct myfs_jsector
+{
+	unsigned long sector;					 // Setor home
+	unsigned char data[DISK_SECTORDATASIZE]; // Conteudo mais recente
+	int running;							 // Alterado desde o ultimo commit
+	struct myfs_jsector *next;				 // Proximo setor na mesma lista
+	struct myfs_jsector *listNext;			 // Proximo setor em memoria
+} MyFSJSector;
+
+// Entrada do cache de nomes: associa (diretorio pai, nome) ao numero do
+// i-node, ou a 0 se o nome sabidamente nao existe no diretorio. Entradas
+// com parent igual a 0 estao livres
+typedef struct myfs_dentry
+{
+	unsigned int parent;				 // I-node do diretorio pai
+	unsigned int inumber;				 // I-node da entrada (0: negativa)
+	unsigned int hash;					 // Hash de (parent, name)
+	char name[MAX_FILENAME_LENGTH + 1];	 // Nome da entrada
+	struct myfs_dentry *next;			 // Proxima entrada na mesma lista
+	struct myfs_dentry *lruPrev, *lruNext; // Vizinhos na ordem de uso
+} MyFSDentry;
+
+// Estrutura com as informacoes de um disco formatado com MyFS, mantida em
+// memoria enquanto o disco estiver em uso. Os campos ate features sao
+// persistidos no superbloco, assim como os contadores de uso (blocos e
+// i-nodes livres e bytes em uso), gravados a cada commit em que mudam, o
+// inicio da lista de orfaos e o tamanho do resumo gravado ao desmontar; os
+// demais sao derivados ou lidos dos grupos
+typedef struct myfs_info
+{
+	Disk *d;					  // Disco ao qual pertencem as informacoes
+	unsigned int blockSize;		  // Tamanho do bloco, em bytes
+	unsigned int numBlocks;		  // Numero total de blocos do disco
+	unsigned int numGroups;		  // Numero de grupos de cilindros
+	unsigned int blocksPerGroup;  // Blocos por grupo (multiplo de 64)
+	unsigned int inodesPerGroup;  // I-nodes por grupo (multiplo de 64)
+	unsigned int journalStart;	  // Primeiro setor do journal
+	unsigned int journalSectors;  // Setores do journal (0: sem journal)
+	unsigned int uninitGroups;	  // Grupos finais ainda nao gravados
+	unsigned int features;		  // Recursos do formato (MYFS_FEAT_*)
+
+	unsigned int sectorsPerBlock;
+	unsigned int numInodes;			 // Numero total de i-nodes
+	unsigned int inodeBitmapOffset;	 // Setor do mapa de i-nodes no grupo
+	unsigned int inodeBitmapSectors;
+	unsigned int blockBitmapOffset;	 // Setor do mapa de blocos no grupo
+	unsigned int blockBitmapSectors;
+	unsigned int refCountOffset;	 // Setor dos contadores no grupo
+	unsigned int refCountSectors;	 // (0: sem contadores)
+	unsigned int dedupOffset;		 // Setor das impressoes no grupo
+	unsigned int dedupSectors;		 // (0: sem deduplicacao)
+	unsigned int groupDataStart;	 // Primeiro bloco de dados no grupo
+	unsigned int freeBlocks;		 // Numero de blocos livres
+	unsigned int freeInodes;		 // Numero de i-nodes livres
+	unsigned long long usedBytes;	 // Bytes em arquivos e diretorios
+	unsigned int sbFreeBlocks;		 // Contadores de uso como gravados
+	unsigned int sbFreeInodes;		 // no superbloco
+	unsigned long long sbUsedBytes;
+	unsigned int orphanHead;		 // Primeiro orfao a liberar (0: nenhum)
+	unsigned int summarySectors;	 // Resumo do alocador no log (0: nenhum)
+	unsigned int itableSectors;		 // Setores da tabela de i-nodes do grupo
+	unsigned int initGroups;		 // Grupos ja' gravados em disco
+
+	MyFSBitmap blockMap; // Mapa de bits de blocos, de todos os grupos
+	MyFSBitmap inodeMap; // Mapa de bits de i-nodes (bit n-1: i-node n)
+	unsigned char *refCounts; // Referencias extras de cada bloco (ou NULL)
+	unsigned int *dedupFps;	  // Impressao de cada bloco (ou NULL)
+	unsigned int *dedupHeads; // Listas do indice de impressoes (NULL: nao
+							  // montado), com 0 no fim
+	unsigned int *dedupNext;  // Bloco seguinte na mesma lista do indice
+	unsigned int dedupMask;	  // Numero de listas do indice menos 1
+	MyFSGroup *groups;	 // Contadores de cada grupo
+	unsigned int unreadGroups; // Grupos com mapas ainda nao lidos
+	unsigned int warmGroups;   // Grupos ainda a ler antecipadamente
+	unsigned int warmNext;	   // Proximo grupo a examinar no aquecimento
+	unsigned int allocHint; // Bloco a partir do qual buscar espaco livre
+	struct myfs_node *nodes[MYFS_NODE_HASH]; // I-nodes em memoria
+	MyFSDentry *dentries;					 // Entradas do cache de nomes
+	MyFSDentry *dcache[MYFS_DCACHE_HASH];	 // Listas do cache de nomes
+	MyFSDentry *lruFirst, *lruLast;			 // Mais e menos recentes
+	unsigned int numOpen;					 // Descritores abertos no disco
+	unsigned int dirtyBytes;				 // Dados pendentes de gravacao
+	unsigned int reservedBlocks;			 // Blocos reservados para eles
+	unsigned char *itBuf;					 // Setores de i-nodes lidos em lote
+	unsigned long itFirst;					 // Primeiro setor em itBuf
+	unsigned int itCount;					 // Setores em itBuf
+	MyFSFrag frags[MYFS_FRAG_OPEN];			 // Blocos de fragmentos com espaco
+	unsigned int numFrags;					 // Blocos em frags
+	MyFSJSector *jHash[MYFS_JOURNAL_HASH];	 // Setores alterados, por setor
+	MyFSJSector *jList;						 // Todos os setores alterados
+	unsigned int jCount;					 // Setores alterados em memoria
+	unsigned int jRunning;					 // Setores da transacao corrente
+	unsigned int jMaxTxn;					 // Maximo por transacao (0: inativo)
+	unsigned int jTail;						 // Posicao no log da proxima
+	unsigned int jUsed;						 // Setores do log em uso
+	unsigned int jSeq;						 // Sequencia da proxima transacao
+	unsigned int jId;						 // Identificador do journal
+	unsigned int jFreedFirst, jFreedEnd;	 // Blocos liberados na transacao
+	unsigned int *jRevoked;					 // Liberacoes adiadas (inicio, numero)
+	unsigned int jNumRevoked, jRevokedSize;	 // Pares em jRevoked e capacidade
+	time_t jLastCommit;						 // Momento do ultimo commit
+} MyFSInfo;
+
+// I-node em memoria, compartilhado por todos os descritores e operacoes que
+// o utilizam, de modo que ha uma unica copia de cada i-node em uso
+typedef struct myfs_node
+{
+	MyFSInfo *fs;			  // Sistema de arquivos do i-node
+	unsigned int number;	  // Numero do i-node
+	Inode inode;			  // Copia em memoria do i-node
+	int refs;				  // Referencias em uso
+	unsigned char *dirHeader; // Diretorios: bloco de cabecalho em memoria
+	unsigned int *blocks;	  // Enderecos dos blocos (NULL: nao lidos)
+	unsigned int numMapped;	  // Enderecos em blocks
+	unsigned int mapSize;	  // Capacidade de blocks
+	unsigned int gen;		  // Incrementado a cada escrita no arquivo
+	unsigned char *wbBuf;	  // Fim do arquivo ainda nao gravado em disco
+	unsigned int wbFirst;	  // Bloco logico do inicio de wbBuf
+	unsigned int wbLen;		  // Bytes validos em wbBuf
+	unsigned int wbCap;		  // Capacidade de wbBuf
+	unsigned int wbReserved;  // Blocos livres reservados para wbBuf
+	struct myfs_node *next;	  // Proximo i-node na mesma lista
+} MyFSNode;
+
+// Descritor de arquivo ou diretorio aberto. Guarda o ultimo bloco acessado
+// e seu endereco, de modo que acessos sequenciais continuem de onde parou,
+// e os blocos lidos antecipadamente enquanto a leitura for sequencial
+typedef struct myfs_fd
+{
+	MyFSNode *node;			   // I-node aberto (NULL: descritor livre)
+	unsigned int cursor;	   // Arquivo: posicao em bytes; dir.: bloco logico
+	unsigned int dirOffset;	   // Diretorio: posicao na folha corrente
+	unsigned int curBlock;	   // Arquivo: bloco logico do ultimo acesso
+	unsigned int curAddr;	   // Endereco de curBlock (0: nenhum)
+	unsigned char *raBuf;	   // Blocos lidos antecipadamente
+	unsigned int raFirst;	   // Bloco logico do inicio de raBuf
+	unsigned int raCount;	   // Blocos validos em raBuf
+	unsigned int raGen;		   // node->gen quando raBuf foi lido
+	unsigned int raWindow;	   // Janela atual, em blocos (0: acesso aleatorio)
+	unsigned int raNext;	   // Cursor esperado para a proxima leitura
+	struct myfs_fd *nextFree;  // Proximo descritor na lista de livres
+} MyFSFd;
+
+// Verificacao de consistencia (offline): as tabelas de i-nodes dos grupos
+// sao lidas inteiras para a memoria, cada uma em uma unica transferencia e
+// em ordem de disco, enquanto as ja' lidas sao decodificadas. Depois, cada
+// thread percorre os arquivos dos i-nodes de uma faixa de grupos, seguindo
+// as cadeias de extensoes na copia em memoria, e le os blocos de seus
+// diretorios. Uma extensao fica com a primeira cadeia que chegar a ela. O
+// que cada thread encontra fica em sua parte; as partes sao juntadas e
+// comparadas aos mapas e contadores gravados em uma unica thread, que
+// tambem faz as correcoes, pelo journal
+#define MYFS_CHECK_EXT 1  // Tipo de i-node: extensao de uma cadeia
+#define MYFS_CHECK_FILE 2 // Tipo de i-node: arquivo regular
+#define MYFS_CHECK_DIR 3  // Tipo de i-node: diretorio
+
+#define MYFS_CHECK_NEXT NUMITEMS_PERINODE		// Correcao: proximo da cadeia
+#define MYFS_CHECK_SIZE (NUMITEMS_PERINODE + 1) // Correcao: tamanho
+
+// Lista de unsigned ints que cresce conforme a necessidade
+typedef struct myfs_list
+{
+	unsigned int *items;
+	unsigned int count;
+	unsigned int cap;
+} MyFSList;
+
+struct myfs_check;
+
+// Parte da verificacao feita por uma thread: arquivos e diretorios cujos
+// i-nodes estao nos grupos de firstGroup a endGroup-1
+typedef struct myfs_check_part
+{
+	struct myfs_check *ck;		  // Verificacao da qual faz parte
+	unsigned int firstGroup;	  // Faixa de grupos da parte
+	unsigned int endGroup;
+	unsigned short *uses;		  // Referencias a cada bloco
+	unsigned int *links;		  // Entradas que apontam para cada i-node
+	MyFSList fixes;				  // Correcoes: (i-node, item, valor)
+	MyFSList tails;				  // Fragmentos finais: (setores, setor)
+	MyFSList dirs;				  // Diretorios com entradas invalidas
+	MyFSList walk;				  // Cadeia corrente: (i-node, item, valor)
+	unsigned long long usedBytes; // Bytes dos arquivos da parte
+	FSCheckInfo info;			  // Inconsistencias encontradas
+	int failed;					  // Falha de leitura ou de memoria
+} MyFSCheckPart;
+
+// Estado de uma verificacao de consistencia
+typedef struct myfs_check
+{
+	MyFSInfo *fs;							 // Sistema de arquivos verificado
+	unsigned char *img;						 // Tabelas de i-nodes dos grupos
+	unsigned char *kind;					 // Tipos dos i-nodes (MYFS_CHECK_*)
+	pthread_mutex_t io;						 // Acesso ao disco
+	unsigned int nextGroup;					 // Proxima tabela a ser lida
+	unsigned int numParts;					 // Partes (threads) da verificacao
+	MyFSCheckPart parts[MYFS_CHECK_THREADS]; // Partes da verificacao
+} MyFSCheck;
+
 // Declaracoes globais
 char fsid = 3;						// Identificador do tipo de sistema de arquivos
 char *fsname = "LarissaFileSystem"; // Nome do tipo de sistema de arquivos
 int myFSslot;
+MyFSInfo *myFSInfos[MYFS_MAX_DISKS]; // Discos com MyFS carregado em memoria
+MyFSFd myFSFds[MAX_FDS];			 // Descritores; fd n usa myFSFds[n-1]
+MyFSFd *myFSFreeFds;				 // Descritores liberados
+int myFSFdsUsed;					 // Descritores ja' usados alguma vez
+
+// Funcao interna que le count setores consecutivos do disco d, a partir do
+// setor addr, para buf, um a um. O simulador so' cobra o deslocamento entre
+// cilindros, de modo que a sequencia custa o mesmo que uma unica
+// transferencia. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSReadSectors(Disk *d, unsigned long addr, unsigned long count,
+					  unsigned char *buf)
+{
+	for (unsigned long a = 0; a < count; a++)
+		if (diskReadSector(d, addr + a, &buf[a * DISK_SECTORDATASIZE]) < 0)
+			return -1;
+	return 0;
+}
+
+// Funcao interna que grava count setores consecutivos no disco d, a partir
+// do setor addr, um a um, como __myFSReadSectors. Retorna 0 se bem sucedido
+// ou -1, caso contrario
+int __myFSWriteSectors(Disk *d, unsigned long addr, unsigned long count,
+					   unsigned char *buf)
+{
+	for (unsigned long a = 0; a < count; a++)
+		if (diskWriteSector(d, addr + a, &buf[a * DISK_SECTORDATASIZE]) < 0)
+			return -1;
+	return 0;
+}
+
+// Funcao interna que aloca um mapa de bits com numBits bits livres. Bits
+// alem de numBits, na ultima palavra, ficam ocupados. Retorna 0 se bem
+// sucedido ou -1, caso contrario
+int __myFSBitmapInit(MyFSBitmap *bm, unsigned int numBits)
+{
+	bm->numBits = numBits;
+	bm->numWords = (numBits + MYFS_BITS_PER_WORD - 1) / MYFS_BITS_PER_WORD;
+	bm->numSummaryWords = (bm->numWords + MYFS_BITS_PER_WORD - 1) /
+						  MYFS_BITS_PER_WORD;
+	bm->words = calloc(bm->numWords, sizeof(unsigned long long));
+	bm->summary = calloc(bm->numSummaryWords, sizeof(unsigned long long));
+	if (!bm->words || !bm->summary)
+		return -1;
+	if (numBits % MYFS_BITS_PER_WORD)
+		bm->words[bm->numWords - 1] = MYFS_WORD_FULL
+									  << (numBits % MYFS_BITS_PER_WORD);
+	return 0;
+}
+
+// Funcao interna que libera a memoria de um mapa de bits
+void __myFSBitmapFree(MyFSBitmap *bm)
+{
+	free(bm->words);
+	free(bm->summary);
+	bm->words = bm->summary = NULL;
+}
+
+// Funcao interna que atualiza o bit do resumo correspondente 'a palavra w
+void __myFSBitmapUpdateSummary(MyFSBitmap *bm, unsigned int w)
+{
+	unsigned long long bit = 1ULL << (w % MYFS_BITS_PER_WORD);
+	if (bm->words[w] == MYFS_WORD_FULL)
+		bm->summary[w / MYFS_BITS_PER_WORD] |= bit;
+	else
+		bm->summary[w / MYFS_BITS_PER_WORD] &= ~bit;
+}
+
+// Funcao interna que retorna 1 se o bit b estiver ocupado ou 0, caso contrario
+int __myFSBitmapTest(MyFSBitmap *bm, unsigned int b)
+{
+	return (bm->words[b / MYFS_BITS_PER_WORD] >> (b % MYFS_BITS_PER_WORD)) & 1;
+}
+
+// Funcao interna que marca os bits de first ate first+count-1 como ocupados
+// (used = 1) ou livres (used = 0). Retorna quantos bits mudaram de estado
+unsigned int __myFSBitmapMark(MyFSBitmap *bm, unsigned int first,
+							  unsigned int count, int used)
+{
+	unsigned int b = first, end = first + count, changed = 0;
+	while (b < end)
+	{
+		unsigned int w = b / MYFS_BITS_PER_WORD;
+		unsigned int off = b % MYFS_BITS_PER_WORD;
+		unsigned int n = MYFS_BITS_PER_WORD - off;
+		unsigned long long mask, old = bm->words[w];
+		if (n > end - b)
+			n = end - b;
+		mask = (n == MYFS_BITS_PER_WORD ? MYFS_WORD_FULL
+										: ((1ULL << n) - 1) << off);
+		if (used)
+		{
+			bm->words[w] |= mask;
+			changed += MYFS_POPCOUNT64(~old & mask);
+		}
+		else
+		{
+			bm->words[w] &= ~mask;
+			changed += MYFS_POPCOUNT64(old & mask);
+		}
+		__myFSBitmapUpdateSummary(bm, w);
+		b += n;
+	}
+	return changed;
+}
+
+// Funcao interna que retorna o primeiro bit livre a partir de from, ou
+// numBits se nao houver. Palavras cheias sao puladas pelo resumo
+unsigned int __myFSBitmapFindFree(MyFSBitmap *bm, unsigned int from)
+{
+	unsigned int w = from / MYFS_BITS_PER_WORD;
+	unsigned long long x;
+	if (from >= bm->numBits)
+		return bm->numBits;
+	x = ~bm->words[w] & (MYFS_WORD_FULL << (from % MYFS_BITS_PER_WORD));
+	if (x)
+		return w * MYFS_BITS_PER_WORD + MYFS_CTZ64(x);
+	// Proxima palavra nao cheia, segundo o resumo
+	for (unsigned int sw = (w + 1) / MYFS_BITS_PER_WORD;
+		 sw < bm->numSummaryWords; sw++)
+	{
+		unsigned long long notFull = ~bm->summary[sw];
+		if (sw == (w + 1) / MYFS_BITS_PER_WORD)
+			notFull &= MYFS_WORD_FULL << ((w + 1) % MYFS_BITS_PER_WORD);
+		if (!notFull)
+			continue;
+		w = sw * MYFS_BITS_PER_WORD + MYFS_CTZ64(notFull);
+		if (w >= bm->numWords)
+			break;
+		return w * MYFS_BITS_PER_WORD + MYFS_CTZ64(~bm->words[w]);
+	}
+	return bm->numBits;
+}
+
+// Funcao interna que retorna quantos bits livres consecutivos existem a
+// partir do bit b, limitado a max
+unsigned int __myFSBitmapRunLength(MyFSBitmap *bm, unsigned int b,
+								   unsigned int max)
+{
+	unsigned int n = 0;
+	while (n < max && b < bm->numBits)
+	{
+		unsigned int off = b % MYFS_BITS_PER_WORD;
+		unsigned int avail = MYFS_BITS_PER_WORD - off;
+		unsigned long long used = bm->words[b / MYFS_BITS_PER_WORD] >> off;
+		unsigned int run = (used ? MYFS_CTZ64(used) : avail);
+		if (run > avail)
+			run = avail;
+		n += run;
+		b += run;
+		if (run < avail)
+			break;
+	}
+	return (n < max ? n : max);
+}
+
+// Funcao interna que grava em sector os bits de count palavras de bm, a
+// partir da palavra w (uma ou mais palavras, ate um setor)
+void __myFSBitmapPack(MyFSBitmap *bm, unsigned int w, unsigned int count,
+					  unsigned char *sector)
+{
+	memset(sector, 0, DISK_SECTORDATASIZE);
+	for (unsigned int a = 0; a < count; a++)
+		for (int b = 0; b < 8; b++)
+			sector[a * 8 + b] = (bm->words[w + a] >> (b * 8)) & 0xFF;
+}
+
+// Funcao interna que recupera de sector count palavras de bm, a partir da
+// palavra w
+void __myFSBitmapUnpack(MyFSBitmap *bm, unsigned int w, unsigned int count,
+						unsigned char *sector)
+{
+	for (unsigned int a = 0; a < count; a++)
+	{
+		bm->words[w + a] = 0;
+		for (int b = 0; b < 8; b++)
+			bm->words[w + a] |= (unsigned long long)sector[a * 8 + b]
+								<< (b * 8);
+		__myFSBitmapUpdateSummary(bm, w + a);
+	}
+}
+
+// Funcao interna que retorna o endereco do primeiro setor do grupo g
+unsigned long __myFSGroupSector(MyFSInfo *fs, unsigned int g)
+{
+	return (unsigned long)g * fs->blocksPerGroup * fs->sectorsPerBlock;
+}
+
+// Funcao interna que retorna o grupo ao qual pertence o bloco b
+unsigned int __myFSBlockGroup(MyFSInfo *fs, unsigned int b)
+{
+	return b / fs->blocksPerGroup;
+}
+
+// Funcao interna que retorna o grupo ao qual pertence o i-node number
+unsigned int __myFSInodeGroup(MyFSInfo *fs, unsigned int number)
+{
+	return (number - 1) / fs->inodesPerGroup;
+}
+
+// Funcao interna que retorna o primeiro bloco de dados do grupo g, usado
+// como objetivo de alocacao para arquivos cujo i-node esta' no grupo
+unsigned int __myFSGroupDataGoal(MyFSInfo *fs, unsigned int g)
+{
+	return g * fs->blocksPerGroup + fs->groupDataStart;
+}
+
+// Funcao interna que calcula os campos derivados de fs a partir dos campos
+// do superbloco. Retorna 0 se o layout resultante for valido ou -1, caso
+// contrario
+int __myFSComputeLayout(MyFSInfo *fs)
+{
+	unsigned int metaSectors;
+	if (fs->blockSize < DISK_SECTORDATASIZE ||
+		fs->blockSize % DISK_SECTORDATASIZE || fs->numGroups == 0 ||
+		fs->blocksPerGroup % MYFS_BITS_PER_WORD ||
+		fs->inodesPerGroup % MYFS_BITS_PER_WORD || fs->inodesPerGroup == 0 ||
+		(fs->features &
+		 ~(MYFS_FEAT_REFCOUNT | MYFS_FEAT_USAGE | MYFS_FEAT_DEDUP)) ||
+		((fs->features & MYFS_FEAT_DEDUP) && !(fs->features & MYFS_FEAT_REFCOUNT)))
+		return -1;
+	fs->sectorsPerBlock = fs->blockSize / DISK_SECTORDATASIZE;
+	fs->numInodes = fs->numGroups * fs->inodesPerGroup;
+	fs->itableSectors = fs->inodesPerGroup / inodeNumInodesPerSector();
+	fs->inodeBitmapOffset = inodeAreaBeginSector() + fs->itableSectors;
+	fs->inodeBitmapSectors = (fs->inodesPerGroup + MYFS_BITS_PER_SECTOR - 1) /
+							 MYFS_BITS_PER_SECTOR;
+	fs->blockBitmapOffset = fs->inodeBitmapOffset + fs->inodeBitmapSectors;
+	fs->blockBitmapSectors = (fs->blocksPerGroup + MYFS_BITS_PER_SECTOR - 1) /
+							 MYFS_BITS_PER_SECTOR;
+	fs->refCountOffset = fs->blockBitmapOffset + fs->blockBitmapSectors;
+	fs->refCountSectors = (fs->features & MYFS_FEAT_REFCOUNT
+							   ? (fs->blocksPerGroup + DISK_SECTORDATASIZE - 1) /
+									 DISK_SECTORDATASIZE
+							   : 0);
+	fs->dedupOffset = fs->refCountOffset + fs->refCountSectors;
+	fs->dedupSectors = (fs->features & MYFS_FEAT_DEDUP
+							? (fs->blocksPerGroup * sizeof(unsigned int) +
+							   DISK_SECTORDATASIZE - 1) /
+								  DISK_SECTORDATASIZE
+							: 0);
+	metaSectors = fs->dedupOffset + fs->dedupSectors;
+	fs->groupDataStart = (metaSectors + fs->sectorsPerBlock - 1) /
+						 fs->sectorsPerBlock;
+	if (fs->groupDataStart >= fs->blocksPerGroup ||
+		fs->numBlocks <= (fs->numGroups - 1) * fs->blocksPerGroup +
+							 fs->groupDataStart ||
+		fs->numBlocks > fs->numGroups * fs->blocksPerGroup ||
+		(unsigned long)fs->numBlocks * fs->sectorsPerBlock > MYFS_TAIL ||
+		fs->uninitGroups >= fs->numGroups)
+		return -1;
+	fs->initGroups = fs->numGroups - fs->uninitGroups;
+	return 0;
+}
+
+// Funcao interna que serializa o superbloco de fs em sector
+void __myFSPackSuperblock(MyFSInfo *fs, unsigned char *sector)
+{
+	unsigned int items[] = {MYFS_MAGIC, fs->blockSize, fs->numBlocks,
+							fs->numGroups, fs->blocksPerGroup,
+							fs->inodesPerGroup, fs->journalStart,
+							fs->journalSectors, fs->uninitGroups,
+							fs->features, fs->freeBlocks, fs->freeInodes,
+							(unsigned int)(fs->usedBytes & 0xFFFFFFFFu),
+							(unsigned int)(fs->usedBytes >> 32),
+							fs->orphanHead, fs->summarySectors};
+	memset(sector, 0, DISK_SECTORDATASIZE);
+	for (unsigned int a = 0; a < sizeof(items) / sizeof(items[0]); a++)
+		ul2char(items[a], &sector[a * sizeof(unsigned int)]);
+}
+
+// Funcao interna que recupera o superbloco de sector para fs. Retorna 0 se
+// o setor contiver um superbloco MyFS valido ou -1, caso contrario
+int __myFSUnpackSuperblock(MyFSInfo *fs, unsigned char *sector)
+{
+	unsigned int *fields[] = {&fs->blockSize, &fs->numBlocks, &fs->numGroups,
+							  &fs->blocksPerGroup, &fs->inodesPerGroup,
+							  &fs->journalStart, &fs->journalSectors,
+							  &fs->uninitGroups, &fs->features};
+	unsigned int magic, n = sizeof(fields) / sizeof(fields[0]), lo, hi;
+	char2ul(sector, &magic);
+	if (magic != MYFS_MAGIC)
+		return -1;
+	for (unsigned int a = 0; a < n; a++)
+		char2ul(&sector[(a + 1) * sizeof(unsigned int)], fields[a]);
+	// Contadores de uso, seguidos dos bytes em uso em duas palavras
+	char2ul(&sector[(n + 1) * sizeof(unsigned int)], &fs->sbFreeBlocks);
+	char2ul(&sector[(n + 2) * sizeof(unsigned int)], &fs->sbFreeInodes);
+	char2ul(&sector[(n + 3) * sizeof(unsigned int)], &lo);
+	char2ul(&sector[(n + 4) * sizeof(unsigned int)], &hi);
+	fs->sbUsedBytes = fs->usedBytes = ((unsigned long long)hi << 32) | lo;
+	// Discos anteriores 'a lista de orfaos e ao resumo tem 0 (lista vazia,
+	// sem resumo) nestas posicoes
+	char2ul(&sector[(n + 5) * sizeof(unsigned int)], &fs->orphanHead);
+	char2ul(&sector[MYFS_SB_SUMMARY * sizeof(unsigned int)],
+			&fs->summarySectors);
+	return __myFSComputeLayout(fs);
+}
+
+// Funcao interna que acumula em h o hash (FNV-1a) de n bytes de buf
+unsigned int __myFSChecksum(unsigned int h, const unsigned char *buf,
+							unsigned int n)
+{
+	for (unsigned int a = 0; a < n; a++)
+	{
+		h ^= buf[a];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// Funcao interna que retorna o numero de setores do log ocupados por uma
+// transacao de n setores: descritores, dados e commit
+unsigned int __myFSJournalFootprint(unsigned int n)
+{
+	return n + (n + MYFS_JTAGS_PER_DESC - 1) / MYFS_JTAGS_PER_DESC + 1;
+}
+
+// Funcao interna que retorna o numero de setores do log de fs
+unsigned int __myFSJournalLogSize(MyFSInfo *fs)
+{
+	return fs->journalSectors - 1;
+}
+
+// Funcao interna que le (write = 0) ou grava (write = 1) count setores do
+// log, a partir da posicao pos, dando a volta no fim do log se preciso.
+// Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSJournalLogIO(MyFSInfo *fs, unsigned int pos, unsigned int count,
+					   unsigned char *buf, int write)
+{
+	unsigned int logSize = __myFSJournalLogSize(fs);
+	while (count > 0)
+	{
+		unsigned int n = logSize - pos;
+		unsigned long addr = fs->journalStart + 1 + pos;
+		int ret;
+		if (n > count)
+			n = count;
+		ret = (write ? __myFSWriteSectors(fs->d, addr, n, buf)
+					 : __myFSReadSectors(fs->d, addr, n, buf));
+		if (ret < 0)
+			return -1;
+		buf += n * DISK_SECTORDATASIZE;
+		count -= n;
+		pos = 0;
+	}
+	return 0;
+}
+
+// Funcao interna que grava o superbloco do journal, marcando a posicao
+// corrente do log como inicio das transacoes a recuperar. Retorna 0 se bem
+// sucedido ou -1, caso contrario
+int __myFSJournalWriteSb(MyFSInfo *fs)
+{
+	unsigned char sector[DISK_SECTORDATASIZE];
+	unsigned int items[] = {MYFS_JSB_MAGIC, fs->jId, fs->jTail, fs->jSeq};
+	memset(sector, 0, DISK_SECTORDATASIZE);
+	for (unsigned int a = 0; a < sizeof(items) / sizeof(items[0]); a++)
+		ul2char(items[a], &sector[a * sizeof(unsigned int)]);
+	return diskWriteSector(fs->d, fs->journalStart, sector);
+}
+
+// Funcao interna que define o tamanho maximo de uma transacao: metade do
+// log, de modo que sempre caiba uma transacao depois de outra
+void __myFSJournalSetLimits(MyFSInfo *fs)
+{
+	unsigned int half = __myFSJournalLogSize(fs) / 2, n = half;
+	while (n > 0 && __myFSJournalFootprint(n) > half)
+		n--;
+	fs->jMaxTxn = n;
+	fs->jLastCommit = time(NULL);
+}
+
+// Funcao interna que procura o setor home sector entre os setores alterados.
+// Retorna o setor em memoria ou NULL se nao estiver alterado
+MyFSJSector *__myFSJournalFind(MyFSInfo *fs, unsigned long sector)
+{
+	MyFSJSector *e;
+	for (e = fs->jHash[sector % MYFS_JOURNAL_HASH]; e; e = e->next)
+		if (e->sector == sector)
+			return e;
+	return NULL;
+}
+
+// Funcao interna que libera os setores alterados em memoria, sem grava-los
+void __myFSJournalFree(MyFSInfo *fs)
+{
+	while (fs->jList)
+	{
+		MyFSJSector *e = fs->jList;
+		fs->jList = e->listNext;
+		free(e);
+	}
+}
+
+// Funcao interna de comparacao de setores alterados pelo setor home, para
+// ordena-los com qsort
+int __myFSJournalCompare(const void *a, const void *b)
+{
+	unsigned long sa = (*(MyFSJSector *const *)a)->sector;
+	unsigned long sb = (*(MyFSJSector *const *)b)->sector;
+	return (sa > sb) - (sa < sb);
+}
+
+// Funcao interna que retorna um vetor, alocado, com os setores alterados
+// (apenas os da transacao corrente, se running) em ordem de setor home. O
+// numero de setores e' escrito em *count. Retorna NULL em caso de falha
+MyFSJSector **__myFSJournalSorted(MyFSInfo *fs, int running,
+								  unsigned int *count)
+{
+	MyFSJSector **v = malloc((fs->jCount ? fs->jCount : 1) *
+							 sizeof(MyFSJSector *));
+	unsigned int n = 0;
+	if (!v)
+		return NULL;
+	for (MyFSJSector *e = fs->jList; e; e = e->listNext)
+		if (!running || e->running)
+			v[n++] = e;
+	qsort(v, n, sizeof(MyFSJSector *), __myFSJournalCompare);
+	*count = n;
+	return v;
+}
+
+// Funcao interna que grava nos setores home, em ordem crescente de setor e
+// com uma unica transferencia para cada trecho contiguo, todos os setores
+// de transacoes ja' gravadas no log, liberando o log. Nao pode haver
+// transacao em andamento. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSJournalWriteHome(MyFSInfo *fs)
+{
+	MyFSJSector **v;
+	unsigned char *buf;
+	unsigned int n, a = 0;
+	int ret = 0;
+	if (fs->jCount == 0)
+		return 0;
+	v = __myFSJournalSorted(fs, 0, &n);
+	buf = malloc(n * DISK_SECTORDATASIZE);
+	if (!v || !buf)
+	{
+		free(v);
+		free(buf);
+		return -1;
+	}
+	while (a < n && ret == 0)
+	{
+		unsigned int run = 1;
+		memcpy(buf, v[a]->data, DISK_SECTORDATASIZE);
+		while (a + run < n && v[a + run]->sector == v[a]->sector + run)
+		{
+			memcpy(&buf[run * DISK_SECTORDATASIZE], v[a + run]->data,
+				   DISK_SECTORDATASIZE);
+			run++;
+		}
+		ret = __myFSWriteSectors(fs->d, v[a]->sector, run, buf);
+		a += run;
+	}
+	free(buf);
+	free(v);
+	if (ret < 0)
+		return -1;
+	__myFSJournalFree(fs);
+	memset(fs->jHash, 0, sizeof(fs->jHash));
+	fs->jCount = 0;
+	fs->jUsed = 0;
+	return __myFSJournalWriteSb(fs);
+}
+
+int __myFSSyncCounts(MyFSInfo *fs);
+
+// Funcao interna que grava no log, com uma unica escrita sequencial, a
+// transacao corrente: todos os setores alterados desde o ultimo commit. Se
+// o log nao tiver espaco para a proxima transacao, os setores sao gravados
+// nos lugares. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSJournalCommit(MyFSInfo *fs)
+{
+	MyFSJSector **v;
+	unsigned char *buf, *p;
+	unsigned int n, total, h = 2166136261u;
+	int ret;
+	// Contadores de uso alterados vao junto, no superbloco. A gravacao pode
+	// ter feito o commit
+	if (__myFSSyncCounts(fs) < 0)
+		return -1;
+	if (fs->jRunning == 0)
+	{
+		// Liberacoes registradas depois do ultimo commit ja' estao no log
+		fs->jFreedFirst = fs->jFreedEnd = 0;
+		return 0;
+	}
+	v = __myFSJournalSorted(fs, 1, &n);
+	total = __myFSJournalFootprint(n);
+	buf = calloc(total, DISK_SECTORDATASIZE);
+	if (!v || !buf)
+	{
+		free(v);
+		free(buf);
+		return -1;
+	}
+	p = buf;
+	for (unsigned int a = 0; a < n; a += MYFS_JTAGS_PER_DESC)
+	{
+		unsigned int k = n - a;
+		if (k > MYFS_JTAGS_PER_DESC)
+			k = MYFS_JTAGS_PER_DESC;
+		ul2char(MYFS_JDESC_MAGIC, &p[0]);
+		ul2char(fs->jId, &p[4]);
+		ul2char(fs->jSeq, &p[8]);
+		ul2char(k, &p[12]);
+		for (unsigned int t = 0; t < k; t++)
+			ul2char((unsigned int)v[a + t]->sector,
+					&p[MYFS_JDESC_SIZE + t * sizeof(unsigned int)]);
+		h = __myFSChecksum(h, p, DISK_SECTORDATASIZE);
+		p += DISK_SECTORDATASIZE;
+		for (unsigned int t = 0; t < k; t++)
+		{
+			memcpy(p, v[a + t]->data, DISK_SECTORDATASIZE);
+			h = __myFSChecksum(h, p, DISK_SECTORDATASIZE);
+			p += DISK_SECTORDATASIZE;
+		}
+	}
+	ul2char(MYFS_JCOMMIT_MAGIC, &p[0]);
+	ul2char(fs->jId, &p[4]);
+	ul2char(fs->jSeq, &p[8]);
+	ul2char(h, &p[12]);
+	ret = __myFSJournalLogIO(fs, fs->jTail, total, buf, 1);
+	free(buf);
+	free(v);
+	if (ret < 0)
+		return -1;
+	for (MyFSJSector *e = fs->jList; e; e = e->listNext)
+		e->running = 0;
+	fs->jRunning = 0;
+	fs->jFreedFirst = fs->jFreedEnd = 0;
+	fs->jTail = (fs->jTail + total) % __myFSJournalLogSize(fs);
+	fs->jUsed += total;
+	fs->jSeq++;
+	fs->jLastCommit = time(NULL);
+	if (__myFSJournalLogSize(fs) - fs->jUsed <
+		__myFSJournalFootprint(fs->jMaxTxn))
+		return __myFSJournalWriteHome(fs);
+	return 0;
+}
+
+int __myFSUnmarkBlocks(MyFSInfo *fs, unsigned int first, unsigned int count);
+
+// Funcao interna que grava nos lugares todos os metadados alterados,
+// passando antes pelo log. As liberacoes adiadas por __myFSJournalRevoke
+// entram antes na transacao corrente, e os blocos so' voltam a ser usados
+// depois que seus setores pendentes foram gravados. Retorna 0 se bem
+// sucedido ou -1, caso contrario
+int __myFSJournalCheckpoint(MyFSInfo *fs)
+{
+	if (!fs->jMaxTxn)
+		return __myFSSyncCounts(fs);
+	while (fs->jNumRevoked > 0)
+	{
+		unsigned int *r = &fs->jRevoked[2 * (fs->jNumRevoked - 1)];
+		if (__myFSUnmarkBlocks(fs, r[0], r[1]) < 0)
+			return -1;
+		fs->jNumRevoked--;
+	}
+	if (__myFSJournalCommit(fs) < 0)
+		return -1;
+	return __myFSJournalWriteHome(fs);
+}
+
+int __myFSOrphanReclaim(MyFSInfo *fs, unsigned int steps);
+int __myFSOrphanDrain(MyFSInfo *fs);
+void __myFSWarmStep(MyFSInfo *fs, unsigned int count);
+
+// Funcao interna chamada ao fim de cada operacao que altera metadados. Os
+// orfaos pendentes sao liberados e os grupos quentes, lidos aos poucos,
+// entao. As alteracoes de varias
+// operacoes sao agrupadas em um unico commit, feito quando a transacao
+// corrente chega a metade do maximo ou quando o ultimo commit ficou antigo
+void __myFSJournalOpEnd(MyFSInfo *fs)
+{
+	if (fs->orphanHead)
+		__myFSOrphanReclaim(fs, MYFS_ORPHAN_BATCH);
+	if (fs->warmGroups > 0)
+		__myFSWarmStep(fs, MYFS_WARM_BATCH);
+	// Sem journal, os contadores de uso sao gravados a cada operacao
+	if (!fs->jMaxTxn)
+		__myFSSyncCounts(fs);
+	// Liberacoes adiadas sao feitas na mesma transacao que a operacao
+	if (fs->jNumRevoked > 0)
+		__myFSJournalCheckpoint(fs);
+	if (fs->jRunning > 0 &&
+		(fs->jRunning >= fs->jMaxTxn / 2 ||
+		 time(NULL) - fs->jLastCommit >= MYFS_JOURNAL_INTERVAL))
+		__myFSJournalCommit(fs);
+}
+
+// Funcao interna que le o setor de metadados sector, em sua versao mais
+// recente. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSMetaRead(MyFSInfo *fs, unsigned long sector, unsigned char *data)
+{
+	MyFSJSector *e = __myFSJournalFind(fs, sector);
+	if (!e)
+		return diskReadSector(fs->d, sector, data);
+	memcpy(data, e->data, DISK_SECTORDATASIZE);
+	return 0;
+}
+
+int __myFSWriteSuperblock(MyFSInfo *fs);
+
+// Funcao interna que grava no superbloco, pela transacao corrente como as
+// demais alteracoes dele, o tamanho sectors do resumo do alocador (0: sem
+// resumo). Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSSummarySetSize(MyFSInfo *fs, unsigned int sectors)
+{
+	fs->summarySectors = sectors;
+	return __myFSWriteSuperblock(fs);
+}
+
+// Funcao interna que grava o setor de metadados sector: sem journal, direto
+// no disco; com journal, na transacao corrente, em memoria. Retorna 0 se
+// bem sucedido ou -1, caso contrario
+int __myFSMetaWrite(MyFSInfo *fs, unsigned long sector, unsigned char *data)
+{
+	MyFSJSector *e;
+	// A primeira alteracao depois de gravado o resumo o invalida, com o
+	// superbloco na mesma transacao
+	if (fs->summarySectors && sector != MYFS_SUPERBLOCK_SECTOR &&
+		__myFSSummarySetSize(fs, 0) < 0)
+		return -1;
+	if (!fs->jMaxTxn)
+		return diskWriteSector(fs->d, sector, data);
+	e = __myFSJournalFind(fs, sector);
+	if (!e)
+	{
+		e = malloc(sizeof(MyFSJSector));
+		if (!e)
+			return -1;
+		e->sector = sector;
+		e->running = 0;
+		e->next = fs->jHash[sector % MYFS_JOURNAL_HASH];
+		fs->jHash[sector % MYFS_JOURNAL_HASH] = e;
+		e->listNext = fs->jList;
+		fs->jList = e;
+		fs->jCount++;
+	}
+	memcpy(e->data, data, DISK_SECTORDATASIZE);
+	if (!e->running)
+	{
+		e->running = 1;
+		fs->jRunning++;
+	}
+	if (fs->jRunning >= fs->jMaxTxn)
+		return __myFSJournalCommit(fs);
+	return 0;
+}
+
+// Funcao interna que registra a liberacao dos count blocos a partir de
+// first (ou de setores deles) na transacao corrente, que sao guardados em
+// um unico intervalo
+void __myFSJournalFreed(MyFSInfo *fs, unsigned int first, unsigned int count)
+{
+	if (!fs->jMaxTxn || count == 0)
+		return;
+	if (fs->jFreedFirst == fs->jFreedEnd)
+	{
+		fs->jFreedFirst = first;
+		fs->jFreedEnd = first + count;
+		return;
+	}
+	if (first < fs->jFreedFirst)
+		fs->jFreedFirst = first;
+	if (first + count > fs->jFreedEnd)
+		fs->jFreedEnd = first + count;
+}
+
+// Funcao interna que indica se algum dos count blocos a partir de first foi
+// liberado na transacao corrente. Ate' que ela seja gravada no log, eles nao
+// podem receber conteudo gravado diretamente no disco: em uma queda, a
+// transacao se perderia e os metadados antigos voltariam a apontar para um
+// bloco ja' sobrescrito. Retorna 1 se algum foi liberado ou 0, caso contrario
+int __myFSJournalWasFreed(MyFSInfo *fs, unsigned int first, unsigned int count)
+{
+	return first < fs->jFreedEnd && first + count > fs->jFreedFirst;
+}
+
+// Funcao interna chamada antes de liberar os count blocos a partir de
+// first. Se algum de seus setores tiver alteracoes pendentes (blocos de
+// diretorio ou de fragmentos), elas sobrescreveriam depois os dados de quem
+// viesse a reutilizar os blocos: a liberacao e' entao adiada para o proximo
+// checkpoint, guardada em jRevoked, sem gravar no meio de uma operacao uma
+// transacao incompleta. Retorna 1 se a liberacao foi adiada, 0 se os blocos
+// podem ser liberados ja' ou -1, em caso de falha
+int __myFSJournalRevoke(MyFSInfo *fs, unsigned int first, unsigned int count)
+{
+	unsigned long start = (unsigned long)first * fs->sectorsPerBlock;
+	unsigned long n = (unsigned long)count * fs->sectorsPerBlock;
+	int found = 0;
+	if (!fs->jMaxTxn || fs->jCount == 0)
+		return 0;
+	if (n < fs->jCount)
+	{
+		for (unsigned long s = start; s < start + n && !found; s++)
+			found = (__myFSJournalFind(fs, s) != NULL);
+	}
+	else
+		for (MyFSJSector *e = fs->jList; e && !found; e = e->listNext)
+			found = (e->sector >= start && e->sector < start + n);
+	if (!found)
+		return 0;
+	if (fs->jNumRevoked == fs->jRevokedSize)
+	{
+		unsigned int size = (fs->jRevokedSize ? 2 * fs->jRevokedSize : 8);
+		unsigned int *v = realloc(fs->jRevoked, 2 * size * sizeof(unsigned int));
+		if (!v)
+			return -1;
+		fs->jRevoked = v;
+		fs->jRevokedSize = size;
+	}
+	fs->jRevoked[2 * fs->jNumRevoked] = first;
+	fs->jRevoked[2 * fs->jNumRevoked + 1] = count;
+	fs->jNumRevoked++;
+	return 1;
+}
+
+// Funcao interna que refaz nos lugares as transacoes completas gravadas no
+// log a partir da posicao indicada pelo superbloco do journal, em ordem de
+// sequencia, parando na primeira incompleta, corrompida ou de outro
+// journal. Ativa o journal de fs em seguida. Retorna o numero de transacoes
+// refeitas se bem sucedido ou -1, caso contrario
+int __myFSJournalRecover(MyFSInfo *fs)
+{
+	unsigned char sector[DISK_SECTORDATASIZE], *data;
+	unsigned int logSize, magic, pos, scanned = 0, replayed = 0, *tags;
+	int ret = 0;
+	if (fs->journalSectors == 0)
+		return 0;
+	if (fs->journalSectors < MYFS_JOURNAL_MIN ||
+		fs->journalStart + fs->journalSectors >
+			(unsigned long)fs->numBlocks * fs->sectorsPerBlock ||
+		diskReadSector(fs->d, fs->journalStart, sector) < 0)
+		return -1;
+	char2ul(&sector[0], &magic);
+	char2ul(&sector[4], &fs->jId);
+	char2ul(&sector[8], &fs->jTail);
+	char2ul(&sector[12], &fs->jSeq);
+	logSize = __myFSJournalLogSize(fs);
+	if (magic != MYFS_JSB_MAGIC || fs->jTail >= logSize)
+		return -1;
+	data = malloc(logSize * DISK_SECTORDATASIZE);
+	tags = malloc(logSize * sizeof(unsigned int));
+	if (!data || !tags)
+	{
+		free(data);
+		free(tags);
+		return -1;
+	}
+	pos = fs->jTail;
+	while (ret == 0 && scanned < logSize)
+	{
+		unsigned int n = 0, start = pos, h = 2166136261u, id, seq, field;
+		int done = 0;
+		// Descritores e dados da transacao, ate' o commit
+		while (!done && scanned < logSize)
+		{
+			if (__myFSJournalLogIO(fs, pos, 1, sector, 0) < 0)
+				break;
+			scanned++;
+			pos = (pos + 1) % logSize;
+			char2ul(&sector[0], &magic);
+			char2ul(&sector[4], &id);
+			char2ul(&sector[8], &seq);
+			char2ul(&sector[12], &field);
+			if (id != fs->jId || seq != fs->jSeq)
+				break;
+			if (magic == MYFS_JCOMMIT_MAGIC)
+				done = (n > 0 && field == h ? 1 : -1);
+			else if (magic == MYFS_JDESC_MAGIC && field > 0 &&
+					 field <= MYFS_JTAGS_PER_DESC && n + field <= logSize &&
+					 scanned + field < logSize)
+			{
+				h = __myFSChecksum(h, sector, DISK_SECTORDATASIZE);
+				for (unsigned int t = 0; t < field; t++)
+					char2ul(&sector[MYFS_JDESC_SIZE + t * sizeof(unsigned int)],
+							&tags[n + t]);
+				if (__myFSJournalLogIO(fs, pos, field,
+									   &data[n * DISK_SECTORDATASIZE], 0) < 0)
+					break;
+				h = __myFSChecksum(h, &data[n * DISK_SECTORDATASIZE],
+								   field * DISK_SECTORDATASIZE);
+				scanned += field;
+				pos = (pos + field) % logSize;
+				n += field;
+			}
+			else
+				break;
+		}
+		if (done != 1)
+		{
+			pos = start;
+			break;
+		}
+		for (unsigned int a = 0; a < n && ret == 0; a++)
+			ret = diskWriteSector(fs->d, tags[a], &data[a * DISK_SECTORDATASIZE]);
+		fs->jSeq++;
+		replayed++;
+	}
+	free(data);
+	free(tags);
+	if (ret < 0)
+		return -1;
+	fs->jTail = pos;
+	fs->jUsed = 0;
+	__myFSJournalSetLimits(fs);
+	if (replayed > 0 && __myFSJournalWriteSb(fs) < 0)
+		return -1;
+	return replayed;
+}
+
+// Funcao interna que serializa o descritor do grupo g em sector
+void __myFSPackGroupDesc(MyFSInfo *fs, unsigned int g, unsigned char *sector)
+{
+	memset(sector, 0, DISK_SECTORDATASIZE);
+	ul2char(fs->groups[g].freeBlocks, &sector[0]);
+	ul2char(fs->groups[g].freeInodes, &sector[sizeof(unsigned int)]);
+	ul2char(fs->groups[g].numDirs, &sector[2 * sizeof(unsigned int)]);
+	ul2char(fs->groups[g].itableUnused, &sector[3 * sizeof(unsigned int)]);
+}
+
+// Funcao interna que serializa em sector o setor s do mapa bm do grupo g,
+// que tem bitsPerGroup bits
+void __myFSPackGroupBitmap(MyFSBitmap *bm, unsigned int g,
+						   unsigned int bitsPerGroup, unsigned int s,
+						   unsigned char *sector)
+{
+	unsigned int wordsPerGroup = bitsPerGroup / MYFS_BITS_PER_WORD;
+	unsigned int w = s * MYFS_WORDS_PER_SECTOR;
+	unsigned int n = wordsPerGroup - w;
+	if (n > MYFS_WORDS_PER_SECTOR)
+		n = MYFS_WORDS_PER_SECTOR;
+	__myFSBitmapPack(bm, g * wordsPerGroup + w, n, sector);
+}
+
+// Funcao interna que serializa em buf os n setores de contadores de
+// referencias do grupo g a partir do setor s dos contadores do grupo
+void __myFSPackRefCounts(MyFSInfo *fs, unsigned int g, unsigned int s,
+						 unsigned int n, unsigned char *buf)
+{
+	unsigned int first = s * DISK_SECTORDATASIZE, len = n * DISK_SECTORDATASIZE;
+	memset(buf, 0, len);
+	if (first + len > fs->blocksPerGroup)
+		len = fs->blocksPerGroup - first;
+	memcpy(buf, &fs->refCounts[g * fs->blocksPerGroup + first], len);
+}
+
+// Funcao interna que serializa em buf os setores s ate s+n-1 das impressoes
+// dos blocos do grupo g
+void __myFSPackDedup(MyFSInfo *fs, unsigned int g, unsigned int s,
+					 unsigned int n, unsigned char *buf)
+{
+	unsigned int per = DISK_SECTORDATASIZE / sizeof(unsigned int);
+	for (unsigned int a = 0, b = s * per; a < n * per; a++, b++)
+		ul2char(b < fs->blocksPerGroup ? fs->dedupFps[g * fs->blocksPerGroup + b]
+									   : 0,
+				&buf[a * sizeof(unsigned int)]);
+}
+
+// Funcao interna que grava o superbloco de fs. Retorna 0 se bem sucedido ou
+// -1, caso contrario
+int __myFSWriteSuperblock(MyFSInfo *fs)
+{
+	unsigned char sector[DISK_SECTORDATASIZE];
+	__myFSPackSuperblock(fs, sector);
+	fs->sbFreeBlocks = fs->freeBlocks;
+	fs->sbFreeInodes = fs->freeInodes;
+	fs->sbUsedBytes = fs->usedBytes;
+	return __myFSMetaWrite(fs, MYFS_SUPERBLOCK_SECTOR, sector);
+}
+
+// Funcao interna que grava o superbloco de fs se os contadores de uso
+// tiverem mudado desde a ultima gravacao. Retorna 0 se bem sucedido ou -1,
+// caso contrario
+int __myFSSyncCounts(MyFSInfo *fs)
+{
+	if (fs->freeBlocks == fs->sbFreeBlocks &&
+		fs->freeInodes == fs->sbFreeInodes && fs->usedBytes == fs->sbUsedBytes)
+		return 0;
+	return __myFSWriteSuperblock(fs);
+}
+
+// Funcao interna que prepara em memoria o grupo g como recem-formatado:
+// blocos de metadados (e alem do fim do disco) ocupados, todo o resto
+// livre e a tabela de i-nodes por zerar
+void __myFSGroupDefaults(MyFSInfo *fs, unsigned int g)
+{
+	unsigned int first = g * fs->blocksPerGroup;
+	unsigned int end = first + fs->blocksPerGroup;
+	__myFSBitmapMark(&fs->blockMap, first, fs->groupDataStart, 1);
+	if (end > fs->numBlocks)
+		__myFSBitmapMark(&fs->blockMap, fs->numBlocks, end - fs->numBlocks, 1);
+	fs->groups[g].freeBlocks = (end > fs->numBlocks ? fs->numBlocks : end) -
+							   first - fs->groupDataStart;
+	fs->groups[g].freeInodes = fs->inodesPerGroup;
+	fs->groups[g].numDirs = 0;
+	fs->groups[g].itableUnused = fs->itableSectors;
+}
+
+// Funcao interna que grava em disco, com seu estado em memoria, os grupos
+// ainda nao gravados ate' o grupo last: copia do superbloco e descritor em
+// uma transferencia e os dois mapas de bits, os contadores de referencias e
+// as impressoes, adjacentes, em outra. A tabela
+// de i-nodes continua por zerar. O novo numero de grupos gravados vai para o
+// superbloco. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSInitGroups(MyFSInfo *fs, unsigned int last)
+{
+	unsigned int nmap = fs->inodeBitmapSectors + fs->blockBitmapSectors +
+						fs->refCountSectors + fs->dedupSectors;
+	unsigned char head[2 * DISK_SECTORDATASIZE], *maps;
+	if (last < fs->initGroups)
+		return 0;
+	maps = malloc(nmap * DISK_SECTORDATASIZE);
+	if (!maps)
+		return -1;
+	while (fs->initGroups <= last)
+	{
+		unsigned int g = fs->initGroups;
+		unsigned long gs = __myFSGroupSector(fs, g);
+		fs->initGroups++;
+		fs->uninitGroups--;
+		__myFSPackSuperblock(fs, &head[MYFS_GROUP_SBCOPY * DISK_SECTORDATASIZE]);
+		__myFSPackGroupDesc(fs, g, &head[MYFS_GROUP_DESC * DISK_SECTORDATASIZE]);
+		for (unsigned int a = 0; a < fs->inodeBitmapSectors; a++)
+			__myFSPackGroupBitmap(&fs->inodeMap, g, fs->inodesPerGroup, a,
+								  &maps[a * DISK_SECTORDATASIZE]);
+		for (unsigned int a = 0; a < fs->blockBitmapSectors; a++)
+			__myFSPackGroupBitmap(&fs->blockMap, g, fs->blocksPerGroup, a,
+								  &maps[(fs->inodeBitmapSectors + a) *
+										DISK_SECTORDATASIZE]);
+		if (fs->refCountSectors)
+			__myFSPackRefCounts(fs, g, 0, fs->refCountSectors,
+								&maps[(fs->refCountOffset - fs->inodeBitmapOffset) *
+									  DISK_SECTORDATASIZE]);
+		if (fs->dedupSectors)
+			__myFSPackDedup(fs, g, 0, fs->dedupSectors,
+							&maps[(fs->dedupOffset - fs->inodeBitmapOffset) *
+								  DISK_SECTORDATASIZE]);
+		if (__myFSWriteSectors(fs->d, gs, 2, head) < 0 ||
+			__myFSWriteSectors(fs->d, gs + fs->inodeBitmapOffset, nmap, maps) < 0)
+		{
+			fs->initGroups--;
+			fs->uninitGroups++;
+			free(maps);
+			return -1;
+		}
+	}
+	free(maps);
+	return __myFSWriteSuperblock(fs);
+}
+
+// Funcao interna que grava o descritor do grupo g em disco. Retorna 0 se bem
+// sucedido ou -1, caso contrario
+int __myFSWriteGroupDesc(MyFSInfo *fs, unsigned int g)
+{
+	unsigned char sector[DISK_SECTORDATASIZE];
+	// Um grupo ainda nao gravado e' gravado inteiro, ja' com a alteracao
+	if (g >= fs->initGroups)
+		return __myFSInitGroups(fs, g);
+	__myFSPackGroupDesc(fs, g, sector);
+	return __myFSMetaWrite(fs, __myFSGroupSector(fs, g) + MYFS_GROUP_DESC,
+						   sector);
+}
+
+// Funcao interna que grava em disco os setores do mapa bm do grupo g que
+// cobrem os bits first ate first+count-1 (relativos ao grupo), seguido do
+// descritor do grupo. O mapa do grupo tem bitsPerGroup bits e comeca no
+// setor offset do grupo. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSWriteGroupBitmap(MyFSInfo *fs, MyFSBitmap *bm, unsigned int g,
+						   unsigned int bitsPerGroup, unsigned int offset,
+						   unsigned int first, unsigned int count)
+{
+	unsigned char sector[DISK_SECTORDATASIZE];
+	unsigned int s0 = first / MYFS_BITS_PER_SECTOR;
+	unsigned int s1 = (first + count - 1) / MYFS_BITS_PER_SECTOR;
+	if (g >= fs->initGroups)
+		return __myFSInitGroups(fs, g);
+	for (unsigned int s = s0; s <= s1; s++)
+	{
+		__myFSPackGroupBitmap(bm, g, bitsPerGroup, s, sector);
+		if (__myFSMetaWrite(fs, __myFSGroupSector(fs, g) + offset + s,
+							sector) < 0)
+			return -1;
+	}
+	return __myFSWriteGroupDesc(fs, g);
+}
+
+// Funcao interna que grava em disco os setores de contadores de referencias
+// que cobrem os blocos first ate first+count-1, de um ou mais grupos.
+// Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSWriteRefCounts(MyFSInfo *fs, unsigned int first, unsigned int count)
+{
+	unsigned char sector[DISK_SECTORDATASIZE];
+	unsigned int b = first, end = first + count;
+	while (b < end)
+	{
+		unsigned int g = __myFSBlockGroup(fs, b);
+		unsigned int gEnd = (g + 1) * fs->blocksPerGroup;
+		unsigned int last = (end < gEnd ? end : gEnd) - 1;
+		if (g >= fs->initGroups)
+		{
+			if (__myFSInitGroups(fs, g) < 0)
+				return -1;
+		}
+		else
+			for (unsigned int s = (b % fs->blocksPerGroup) / DISK_SECTORDATASIZE;
+				 s <= (last % fs->blocksPerGroup) / DISK_SECTORDATASIZE; s++)
+			{
+				__myFSPackRefCounts(fs, g, s, 1, sector);
+				if (__myFSMetaWrite(fs, __myFSGroupSector(fs, g) +
+											fs->refCountOffset + s,
+									sector) < 0)
+					return -1;
+			}
+		b = last + 1;
+	}
+	return 0;
+}
+
+// Funcao interna que retira o bloco b, se estiver la', da lista do indice de
+// impressoes correspondente 'a impressao fp
+void __myFSDedupUnlink(MyFSInfo *fs, unsigned int b, unsigned int fp)
+{
+	unsigned int *p = &fs->dedupHeads[fp & fs->dedupMask];
+	while (*p && *p != b)
+		p = &fs->dedupNext[*p];
+	if (*p)
+		*p = fs->dedupNext[b];
+}
+
+// Funcao interna que muda para fp a impressao do bloco b, em memoria, no
+// indice (se montado) e em disco. Retorna 0 se bem sucedido ou -1, caso
+// contrario
+int __myFSDedupSet(MyFSInfo *fs, unsigned int b, unsigned int fp)
+{
+	unsigned char sector[DISK_SECTORDATASIZE];
+	unsigned int g = __myFSBlockGroup(fs, b);
+	unsigned int s = (b % fs->blocksPerGroup) * sizeof(unsigned int) /
+					 DISK_SECTORDATASIZE;
+	if (fs->dedupFps[b] == fp)
+		return 0;
+	if (fs->dedupHeads)
+	{
+		if (fs->dedupFps[b])
+			__myFSDedupUnlink(fs, b, fs->dedupFps[b]);
+		if (fp)
+		{
+			fs->dedupNext[b] = fs->dedupHeads[fp & fs->dedupMask];
+			fs->dedupHeads[fp & fs->dedupMask] = b;
+		}
+	}
+	fs->dedupFps[b] = fp;
+	if (g >= fs->initGroups)
+		return __myFSInitGroups(fs, g);
+	__myFSPackDedup(fs, g, s, 1, sector);
+	return __myFSMetaWrite(fs, __myFSGroupSector(fs, g) + fs->dedupOffset + s,
+						   sector);
+}
+
+int __myFSGroupsLoadAll(MyFSInfo *fs);
+
+// Funcao interna que monta, se ainda nao montado, o indice das impressoes
+// dos blocos em uso. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSDedupIndex(MyFSInfo *fs)
+{
+	unsigned int n = fs->numGroups * fs->blocksPerGroup, lists = 64;
+	if (fs->dedupHeads)
+		return 0;
+	if (__myFSGroupsLoadAll(fs) < 0)
+		return -1;
+	while (lists < n / 4)
+		lists *= 2;
+	fs->dedupHeads = calloc(lists, sizeof(unsigned int));
+	fs->dedupNext = calloc(n, sizeof(unsigned int));
+	if (!fs->dedupHeads || !fs->dedupNext)
+	{
+		free(fs->dedupHeads);
+		free(fs->dedupNext);
+		fs->dedupHeads = fs->dedupNext = NULL;
+		return -1;
+	}
+	fs->dedupMask = lists - 1;
+	// O bloco 0 (superbloco) nunca tem impressao e marca o fim das listas
+	for (unsigned int b = n; b-- > 1;)
+		if (fs->dedupFps[b] && __myFSBitmapTest(&fs->blockMap, b))
+		{
+			unsigned int *head = &fs->dedupHeads[fs->dedupFps[b] & fs->dedupMask];
+			fs->dedupNext[b] = *head;
+			*head = b;
+		}
+	return 0;
+}
+
+// Funcao interna que retorna a impressao (hash FNV-1a, palavra a palavra,
+// nunca 0) do conteudo de um bloco
+unsigned int __myFSDedupHash(MyFSInfo *fs, const unsigned char *data)
+{
+	unsigned int h = 2166136261u, w;
+	for (unsigned int a = 0; a < fs->blockSize; a += sizeof(unsigned int))
+	{
+		memcpy(&w, &data[a], sizeof(unsigned int));
+		h = (h ^ w) * 16777619u;
+	}
+	return (h ? h : 1);
+}
+
+// Funcao interna que procura um bloco em uso com o conteudo data, de
+// impressao fp, que ainda possa ser compartilhado, conferindo o conteudo
+// dos candidatos, lidos para buf. Retorna o numero do bloco ou 0 se nao
+// houver
+unsigned int __myFSDedupFind(MyFSInfo *fs, const unsigned char *data,
+							 unsigned int fp, unsigned char *buf)
+{
+	unsigned int probes = 0;
+	if (__myFSDedupIndex(fs) < 0)
+		return 0;
+	for (unsigned int b = fs->dedupHeads[fp & fs->dedupMask];
+		 b && probes < MYFS_DEDUP_PROBES; b = fs->dedupNext[b])
+	{
+		if (fs->dedupFps[b] != fp || !__myFSBitmapTest(&fs->blockMap, b) ||
+			fs->refCounts[b] >= MYFS_REFCOUNT_MAX)
+			continue;
+		probes++;
+		if (__myFSReadSectors(fs->d, (unsigned long)b * fs->sectorsPerBlock,
+							  fs->sectorsPerBlock, buf) == 0 &&
+			memcmp(buf, data, fs->blockSize) == 0)
+			return b;
+	}
+	return 0;
+}
+
+// Funcao interna que zera em disco os setores da tabela de i-nodes do grupo
+// g, ainda nao zerados, ate' o que contem o i-node de indice idx no grupo,
+// MYFS_ITABLE_CHUNK setores de cada vez. Cabe ao chamador gravar o
+// descritor. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSInitInodeTable(MyFSInfo *fs, unsigned int g, unsigned int idx)
+{
+	unsigned int sector = idx / inodeNumInodesPerSector();
+	unsigned int init = fs->itableSectors - fs->groups[g].itableUnused;
+	unsigned int n;
+	unsigned char *zero;
+	if (sector < init)
+		return 0;
+	n = (sector + 1 - init + MYFS_ITABLE_CHUNK - 1) / MYFS_ITABLE_CHUNK *
+		MYFS_ITABLE_CHUNK;
+	if (n > fs->groups[g].itableUnused)
+		n = fs->groups[g].itableUnused;
+	zero = calloc(n, DISK_SECTORDATASIZE);
+	if (!zero)
+		return -1;
+	// Nenhum i-node destes setores esta' em uso, nem no journal
+	if (__myFSWriteSectors(fs->d, __myFSGroupSector(fs, g) +
+									   inodeAreaBeginSector() + init,
+							n, zero) < 0)
+	{
+		free(zero);
+		return -1;
+	}
+	free(zero);
+	fs->groups[g].itableUnused -= n;
+	return 0;
+}
+
+// Funcao interna que le do disco, em uma unica transferencia, os mapas de
+// bits, os contadores de referencias e as impressoes dos blocos do grupo g,
+// valendo para cada setor a versao do journal, se houver, e reconta os
+// blocos e i-nodes livres do grupo. Retorna 0 se bem sucedido ou -1, caso
+// contrario
+int __myFSGroupReadMaps(MyFSInfo *fs, unsigned int g)
+{
+	unsigned int nmap = fs->inodeBitmapSectors + fs->blockBitmapSectors +
+						fs->refCountSectors + fs->dedupSectors;
+	unsigned long first = __myFSGroupSector(fs, g) + fs->inodeBitmapOffset;
+	MyFSBitmap *maps[] = {&fs->inodeMap, &fs->blockMap};
+	unsigned int bits[] = {fs->inodesPerGroup, fs->blocksPerGroup};
+	unsigned int offsets[] = {fs->inodeBitmapOffset, fs->blockBitmapOffset};
+	unsigned int nsectors[] = {fs->inodeBitmapSectors, fs->blockBitmapSectors};
+	unsigned int freeCount[2] = {0, 0};
+	unsigned char *buf = malloc(nmap * DISK_SECTORDATASIZE), *sector;
+
+	if (!buf || __myFSReadSectors(fs->d, first, nmap, buf) < 0)
+	{
+		free(buf);
+		return -1;
+	}
+	for (unsigned int s = 0; s < nmap && fs->jCount > 0; s++)
+	{
+		MyFSJSector *e = __myFSJournalFind(fs, first + s);
+		if (e)
+			memcpy(&buf[s * DISK_SECTORDATASIZE], e->data, DISK_SECTORDATASIZE);
+	}
+	for (int m = 0; m < 2; m++)
+	{
+		unsigned int wordsPerGroup = bits[m] / MYFS_BITS_PER_WORD;
+		for (unsigned int s = 0; s < nsectors[m]; s++)
+		{
+			unsigned int w = s * MYFS_WORDS_PER_SECTOR;
+			unsigned int n = wordsPerGroup - w;
+			if (n > MYFS_WORDS_PER_SECTOR)
+				n = MYFS_WORDS_PER_SECTOR;
+			sector = &buf[(offsets[m] - fs->inodeBitmapOffset + s) *
+						  DISK_SECTORDATASIZE];
+			__myFSBitmapUnpack(maps[m], g * wordsPerGroup + w, n, sector);
+			for (unsigned int a = 0; a < n; a++)
+				freeCount[m] += MYFS_BITS_PER_WORD -
+								MYFS_POPCOUNT64(
+									maps[m]->words[g * wordsPerGroup + w + a]);
+		}
+	}
+	fs->groups[g].freeInodes = freeCount[0];
+	fs->groups[g].freeBlocks = freeCount[1];
+	for (unsigned int s = 0; s < fs->refCountSectors; s++)
+	{
+		unsigned int from = s * DISK_SECTORDATASIZE, n = DISK_SECTORDATASIZE;
+		sector = &buf[(fs->refCountOffset - fs->inodeBitmapOffset + s) *
+					  DISK_SECTORDATASIZE];
+		if (from + n > fs->blocksPerGroup)
+			n = fs->blocksPerGroup - from;
+		memcpy(&fs->refCounts[g * fs->blocksPerGroup + from], sector, n);
+	}
+	for (unsigned int s = 0; s < fs->dedupSectors; s++)
+	{
+		unsigned int per = DISK_SECTORDATASIZE / sizeof(unsigned int);
+		sector = &buf[(fs->dedupOffset - fs->inodeBitmapOffset + s) *
+					  DISK_SECTORDATASIZE];
+		for (unsigned int a = 0; a < per && s * per + a < fs->blocksPerGroup; a++)
+			char2ul(&sector[a * sizeof(unsigned int)],
+					&fs->dedupFps[g * fs->blocksPerGroup + s * per + a]);
+	}
+	free(buf);
+	return 0;
+}
+
+// Funcao interna que le do disco o descritor e os mapas do grupo g (ver
+// __myFSGroupReadMaps). Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSReadGroup(MyFSInfo *fs, unsigned int g)
+{
+	unsigned char sector[DISK_SECTORDATASIZE];
+	if (diskReadSector(fs->d, __myFSGroupSector(fs, g) + MYFS_GROUP_DESC,
+					   sector) < 0)
+		return -1;
+	char2ul(&sector[2 * sizeof(unsigned int)], &fs->groups[g].numDirs);
+	char2ul(&sector[3 * sizeof(unsigned int)], &fs->groups[g].itableUnused);
+	if (fs->groups[g].itableUnused > fs->itableSectors)
+		return -1;
+	return __myFSGroupReadMaps(fs, g);
+}
+
+// Funcao interna que le os mapas do grupo g, se ainda nao lidos depois de
+// uma montagem rapida, acertando os totais de livres pela recontagem.
+// Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSGroupFetch(MyFSInfo *fs, unsigned int g)
+{
+	unsigned int freeBlocks, freeInodes;
+	if (g >= fs->numGroups || !fs->groups[g].unread)
+		return 0;
+	freeBlocks = fs->groups[g].freeBlocks;
+	freeInodes = fs->groups[g].freeInodes;
+	if (__myFSGroupReadMaps(fs, g) < 0)
+		return -1;
+	fs->freeBlocks += fs->groups[g].freeBlocks - freeBlocks;
+	fs->freeInodes += fs->groups[g].freeInodes - freeInodes;
+	fs->groups[g].unread = 0;
+	fs->unreadGroups--;
+	return 0;
+}
+
+// Funcao interna que le os mapas do grupo g, se ainda nao lidos, para uso:
+// o grupo passa a ser quente (ver MYFS_SUMMARY_MAGIC). Retorna 0 se bem
+// sucedido ou -1, caso contrario
+int __myFSGroupLoad(MyFSInfo *fs, unsigned int g)
+{
+	if (g < fs->numGroups)
+		fs->groups[g].hot = 1;
+	return __myFSGroupFetch(fs, g);
+}
+
+// Funcao interna que le, para uso, os mapas dos grupos dos blocos de first
+// ate first+count-1. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSGroupsLoadBlocks(MyFSInfo *fs, unsigned int first, unsigned int count)
+{
+	if (count == 0)
+		return 0;
+	for (unsigned int g = __myFSBlockGroup(fs, first);
+		 g <= __myFSBlockGroup(fs, first + count - 1); g++)
+		if (__myFSGroupLoad(fs, g) < 0)
+			return -1;
+	return 0;
+}
+
+// Funcao interna que le os mapas de todos os grupos ainda nao lidos, para
+// quem percorre os mapas do disco inteiro. Retorna 0 se bem sucedido ou -1,
+// caso contrario
+int __myFSGroupsLoadAll(MyFSInfo *fs)
+{
+	for (unsigned int g = 0; g < fs->numGroups && fs->unreadGroups > 0; g++)
+		if (__myFSGroupFetch(fs, g) < 0)
+			return -1;
+	return 0;
+}
+
+// Funcao interna que retorna o primeiro grupo, a partir de g e dando a volta
+// no disco, com mapas ainda nao lidos e mais de min blocos livres (ou
+// i-nodes livres, se inodes), ou numGroups se nao houver
+unsigned int __myFSGroupPending(MyFSInfo *fs, unsigned int g, unsigned int min,
+								int inodes)
+{
+	for (unsigned int a = 0; a < fs->numGroups && fs->unreadGroups > 0; a++)
+	{
+		MyFSGroup *gr = &fs->groups[(g + a) % fs->numGroups];
+		if (gr->unread && (inodes ? gr->freeInodes : gr->freeBlocks) > min)
+			return (g + a) % fs->numGroups;
+	}
+	return fs->numGroups;
+}
+
+// Funcao interna que le antecipadamente os mapas de ate' count dos grupos
+// quentes na ultima desmontagem, seguindo em ordem crescente de grupo a
+// partir de onde a chamada anterior parou. Grupos ja' lidos sao pulados
+void __myFSWarmStep(MyFSInfo *fs, unsigned int count)
+{
+	while (fs->warmGroups > 0 && count > 0 && fs->warmNext < fs->numGroups)
+	{
+		unsigned int g = fs->warmNext++;
+		if (!fs->groups[g].warm)
+			continue;
+		fs->groups[g].warm = 0;
+		fs->warmGroups--;
+		if (fs->groups[g].unread)
+		{
+			if (__myFSGroupFetch(fs, g) < 0)
+				return;
+			count--;
+		}
+	}
+}
+
+// Funcao interna que marca como ocupados os count blocos livres a partir de
+// first, todos do mesmo grupo. Retorna 0 se bem sucedido ou -1, caso
+// contrario
+int __myFSMarkBlocks(MyFSInfo *fs, unsigned int first, unsigned int count)
+{
+	unsigned int g = __myFSBlockGroup(fs, first);
+	if (__myFSGroupLoad(fs, g) < 0)
+		return -1;
+	__myFSBitmapMark(&fs->blockMap, first, count, 1);
+	fs->groups[g].freeBlocks -= count;
+	fs->freeBlocks -= count;
+	if (__myFSWriteGroupBitmap(fs, &fs->blockMap, g, fs->blocksPerGroup,
+							   fs->blockBitmapOffset,
+							   first % fs->blocksPerGroup, count) < 0)
+	{
+		__myFSBitmapMark(&fs->blockMap, first, count, 0);
+		fs->groups[g].freeBlocks += count;
+		fs->freeBlocks += count;
+		return -1;
+	}
+	// Impressoes de conteudos anteriores nao valem para o novo uso
+	for (unsigned int b = first; fs->dedupFps && b < first + count; b++)
+		if (fs->dedupFps[b] && __myFSDedupSet(fs, b, 0) < 0)
+			return -1;
+	return 0;
+}
+
+// Funcao interna que retorna o primeiro bloco de uma sequencia de want
+// blocos livres contida em [from, end), ou end se nao houver
+unsigned int __myFSFindRun(MyFSInfo *fs, unsigned int from, unsigned int end,
+						   unsigned int want)
+{
+	unsigned int b = from;
+	while (b < end)
+	{
+		unsigned int f = __myFSBitmapFindFree(&fs->blockMap, b), len;
+		if (f >= end)
+			break;
+		len = __myFSBitmapRunLength(&fs->blockMap, f, want);
+		if (len == want)
+			return (f + want <= end ? f : end);
+		b = f + len;
+	}
+	return end;
+}
+
+// Funcao interna que aloca ate want blocos contiguos, preferencialmente a
+// partir do bloco goal (0: sem preferencia). Se nao houver uma sequencia de
+// want blocos livres, aloca a maior sequencia encontrada, desde que tenha
+// ao menos min blocos. O primeiro bloco alocado e' escrito em *first.
+// Retorna o numero de blocos alocados ou 0 se nao houver espaco
+unsigned int __myFSAllocBlocks(MyFSInfo *fs, unsigned int goal,
+							   unsigned int want, unsigned int min,
+							   unsigned int *first)
+{
+	MyFSBitmap *bm = &fs->blockMap;
+	unsigned int start, bestStart = 0, bestLen = 0;
+	if (want == 0)
+		return 0;
+	if (min == 0)
+		min = 1;
+	if (fs->freeBlocks < min)
+		return (__myFSOrphanDrain(fs) ? __myFSAllocBlocks(fs, goal, want, min, first)
+									  : 0);
+	start = (goal ? goal : fs->allocHint);
+	if (start >= fs->numBlocks)
+		start = 0;
+	if (__myFSGroupLoad(fs, __myFSBlockGroup(fs, start)) < 0)
+		return 0;
+	// Percorre [start, numBlocks) e depois [0, start). Os blocos de
+	// metadados dos grupos estao marcados e separam as sequencias livres,
+	// de modo que uma sequencia nunca cruza o limite de um grupo
+	for (int pass = 0; pass < 2 && bestLen < want; pass++)
+	{
+		unsigned int b = (pass == 0 ? start : 0);
+		unsigned int end = (pass == 0 ? fs->numBlocks : start);
+		while (b < end)
+		{
+			unsigned int f = __myFSBitmapFindFree(bm, b), len;
+			if (f >= end)
+				break;
+			// Os blocos liberados na transacao corrente sao evitados
+			if (__myFSJournalWasFreed(fs, f, 1))
+			{
+				b = fs->jFreedEnd;
+				continue;
+			}
+			len = __myFSBitmapRunLength(bm, f, want);
+			if (__myFSJournalWasFreed(fs, f, len))
+				len = fs->jFreedFirst - f;
+			if (len > bestLen)
+			{
+				bestStart = f;
+				bestLen = len;
+				if (len == want)
+					break;
+			}
+			b = f + len;
+		}
+	}
+	// Depois de uma montagem rapida, um grupo ainda nao lido que possa ter
+	// uma sequencia maior e' lido e a busca, refeita
+	if (bestLen < want)
+	{
+		unsigned int g = __myFSGroupPending(fs, __myFSBlockGroup(fs, start),
+											bestLen, 0);
+		if (g < fs->numGroups)
+			return (__myFSGroupLoad(fs, g) < 0
+						? 0
+						: __myFSAllocBlocks(fs, goal, want, min, first));
+	}
+	// Sem espaco, a transacao corrente e' gravada no log, tornando
+	// reutilizaveis os blocos que ela liberou, ou os orfaos pendentes sao
+	// liberados, e a busca e' refeita
+	if (bestLen < min && fs->jFreedFirst != fs->jFreedEnd)
+		return (__myFSJournalCommit(fs) < 0
+					? 0
+					: __myFSAllocBlocks(fs, goal, want, min, first));
+	if (bestLen < min)
+		return (__myFSOrphanDrain(fs) ? __myFSAllocBlocks(fs, goal, want, min, first)
+									  : 0);
+	if (__myFSMarkBlocks(fs, bestStart, bestLen) < 0)
+		return 0;
+	fs->allocHint = bestStart + bestLen;
+	*first = bestStart;
+	return bestLen;
+}
+
+// Funcao interna que marca como livres, no mapa de bits, os blocos de first
+// ate first+count-1, que podem se estender por mais de um grupo. Blocos de
+// metadados nunca sao liberados. Retorna 0 se bem sucedido ou -1, caso
+// contrario
+int __myFSReleaseBlocks(MyFSInfo *fs, unsigned int first, unsigned int count)
+{
+	unsigned int end = first + count;
+	int revoked;
+	if (count == 0 || end > fs->numBlocks || end < first ||
+		(revoked = __myFSJournalRevoke(fs, first, count)) < 0)
+		return -1;
+	// Blocos com setores pendentes no journal ficam para o checkpoint
+	if (revoked)
+		return 0;
+	return __myFSUnmarkBlocks(fs, first, count);
+}
+
+// Funcao interna que faz a liberacao de __myFSReleaseBlocks, sem passar por
+// __myFSJournalRevoke. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSUnmarkBlocks(MyFSInfo *fs, unsigned int first, unsigned int count)
+{
+	unsigned int b = first, end = first + count;
+	while (b < end)
+	{
+		unsigned int g = __myFSBlockGroup(fs, b);
+		unsigned int gEnd = (g + 1) * fs->blocksPerGroup, n, freed;
+		if (b % fs->blocksPerGroup < fs->groupDataStart ||
+			__myFSGroupLoad(fs, g) < 0)
+			return -1;
+		n = (end < gEnd ? end : gEnd) - b;
+		freed = __myFSBitmapMark(&fs->blockMap, b, n, 0);
+		fs->groups[g].freeBlocks += freed;
+		fs->freeBlocks += freed;
+		if (__myFSWriteGroupBitmap(fs, &fs->blockMap, g, fs->blocksPerGroup,
+								   fs->blockBitmapOffset,
+								   b % fs->blocksPerGroup, n) < 0)
+			return -1;
+		b += n;
+	}
+	__myFSJournalFreed(fs, first, count);
+	return 0;
+}
+
+// Funcao interna que retorna 1 se o bloco b for compartilhado por mais de
+// um arquivo (ou se nao for possivel ler seu contador) ou 0, caso contrario
+int __myFSBlockShared(MyFSInfo *fs, unsigned int b)
+{
+	return fs->refCounts && b < fs->numBlocks &&
+		   (__myFSGroupLoad(fs, __myFSBlockGroup(fs, b)) < 0 ||
+			fs->refCounts[b] > 0);
+}
+
+// Funcao interna que soma delta (1 ou -1) aos contadores de referencias dos
+// blocos de first ate first+count-1 e os grava. Se algum contador passaria
+// de MYFS_REFCOUNT_MAX, nada e' alterado. Retorna 0 se bem sucedido ou -1,
+// caso contrario
+int __myFSAddRefs(MyFSInfo *fs, unsigned int first, unsigned int count,
+				  int delta)
+{
+	if (__myFSGroupsLoadBlocks(fs, first, count) < 0)
+		return -1;
+	for (unsigned int b = first; b < first + count; b++)
+		if (delta > 0 && fs->refCounts[b] + delta > MYFS_REFCOUNT_MAX)
+			return -1;
+	for (unsigned int b = first; b < first + count; b++)
+		fs->refCounts[b] += delta;
+	if (__myFSWriteRefCounts(fs, first, count) < 0)
+	{
+		for (unsigned int b = first; b < first + count; b++)
+			fs->refCounts[b] -= delta;
+		return -1;
+	}
+	return 0;
+}
+
+// Funcao interna que libera uma referencia a cada um dos blocos de first ate
+// first+count-1: blocos compartilhados apenas perdem uma referencia; os
+// demais ficam livres. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSFreeBlocks(MyFSInfo *fs, unsigned int first, unsigned int count)
+{
+	unsigned int b = first, end = first + count;
+	int ret = 0;
+	if (!fs->refCounts)
+		return __myFSReleaseBlocks(fs, first, count);
+	if (count == 0 || end > fs->numBlocks || end < first ||
+		__myFSGroupsLoadBlocks(fs, first, count) < 0)
+		return -1;
+	while (b < end)
+	{
+		unsigned int e = b + 1, shared = (fs->refCounts[b] > 0);
+		while (e < end && (fs->refCounts[e] > 0) == shared)
+			e++;
+		if ((shared ? __myFSAddRefs(fs, b, e - b, -1)
+					: __myFSReleaseBlocks(fs, b, e - b)) < 0)
+			ret = -1;
+		b = e;
+	}
+	return ret;
+}
+
+// Funcao interna que retorna o numero de setores do fragmento que guarda os
+// len bytes finais de um arquivo, ou 0 se eles devem ocupar um bloco
+// proprio: um fragmento tem no maximo metade dos setores de dados de um
+// bloco de fragmentos, de modo que cada um destes guarde ao menos dois
+unsigned int __myFSFragSectors(MyFSInfo *fs, unsigned int len)
+{
+	unsigned int n = (len + DISK_SECTORDATASIZE - 1) / DISK_SECTORDATASIZE;
+	if (fs->sectorsPerBlock > MYFS_FRAG_MAX_SPB || n == 0 ||
+		2 * n > fs->sectorsPerBlock - 1)
+		return 0;
+	return n;
+}
+
+// Funcao interna que retorna o numero de setores do fragmento final de um
+// arquivo com size bytes
+unsigned int __myFSTailSectors(MyFSInfo *fs, unsigned int size)
+{
+	return (size % fs->blockSize + DISK_SECTORDATASIZE - 1) / DISK_SECTORDATASIZE;
+}
+
+// Funcao interna que grava o cabecalho do bloco de fragmentos block, com o
+// mapa de setores em uso used. Retorna 0 se bem sucedido ou -1, caso
+// contrario
+int __myFSFragWriteHeader(MyFSInfo *fs, unsigned int block,
+						  unsigned long long used)
+{
+	unsigned char sector[DISK_SECTORDATASIZE];
+	memset(sector, 0, DISK_SECTORDATASIZE);
+	ul2char(MYFS_FRAG_MAGIC, &sector[0]);
+	ul2char((unsigned int)(used & 0xFFFFFFFFu), &sector[4]);
+	ul2char((unsigned int)(used >> 32), &sector[8]);
+	return __myFSMetaWrite(fs, (unsigned long)block * fs->sectorsPerBlock,
+						   sector);
+}
+
+// Funcao interna que retorna 1 se o bloco de fragmentos com setores em uso
+// used nao tiver mais setores livres
+int __myFSFragFull(MyFSInfo *fs, unsigned long long used)
+{
+	return used == (fs->sectorsPerBlock == 64 ? MYFS_WORD_FULL
+											  : (1ULL << fs->sectorsPerBlock) - 1);
+}
+
+// Funcao interna que retira a entrada a da lista de blocos de fragmentos com
+// espaco em memoria
+void __myFSFragDrop(MyFSInfo *fs, unsigned int a)
+{
+	fs->frags[a] = fs->frags[--fs->numFrags];
+}
+
+// Funcao interna que poe o bloco de fragmentos block, com setores em uso
+// used, na lista de blocos com espaco em memoria. Com a lista cheia, sai
+// dela o bloco com menos setores livres, que continua valido em disco e
+// volta 'a lista quando algum de seus fragmentos for liberado
+void __myFSFragAdd(MyFSInfo *fs, unsigned int block, unsigned long long used)
+{
+	unsigned int a = fs->numFrags;
+	if (__myFSFragFull(fs, used))
+		return;
+	if (a == MYFS_FRAG_OPEN)
+	{
+		a = 0;
+		for (unsigned int b = 1; b < MYFS_FRAG_OPEN; b++)
+			if (MYFS_POPCOUNT64(fs->frags[b].used) >
+				MYFS_POPCOUNT64(fs->frags[a].used))
+				a = b;
+	}
+	else
+		fs->numFrags++;
+	fs->frags[a].block = block;
+	fs->frags[a].used = used;
+}
+
+// Funcao interna que aloca n setores contiguos em um bloco de fragmentos do
+// grupo do bloco goal: em um bloco ja' com fragmentos, se algum em memoria
+// tiver espaco, ou em um bloco novo, alocado a partir de goal. Fins de
+// arquivos proximos no disco ficam assim juntos no mesmo bloco. Retorna o
+// endereco do primeiro setor ou 0 se nao houver espaco
+unsigned int __myFSFragAlloc(MyFSInfo *fs, unsigned int n, unsigned int goal)
+{
+	unsigned int spb = fs->sectorsPerBlock, g = __myFSBlockGroup(fs, goal), blk;
+	unsigned long long mask = (1ULL << n) - 1;
+	for (unsigned int a = 0; a < fs->numFrags; a++)
+	{
+		MyFSFrag *fr = &fs->frags[a];
+		if (__myFSBlockGroup(fs, fr->block) != g ||
+			__myFSJournalWasFreed(fs, fr->block, 1))
+			continue;
+		for (unsigned int s = 1; s + n <= spb; s++)
+			if (!(fr->used & (mask << s)))
+			{
+				unsigned long long used = fr->used | (mask << s);
+				blk = fr->block;
+				if (__myFSFragWriteHeader(fs, blk, used) < 0)
+					return 0;
+				fr->used = used;
+				if (__myFSFragFull(fs, used))
+					__myFSFragDrop(fs, a);
+				return blk * spb + s;
+			}
+	}
+	if (fs->freeBlocks <= fs->reservedBlocks ||
+		__myFSAllocBlocks(fs, goal, 1, 1, &blk) != 1)
+		return 0;
+	if (__myFSFragWriteHeader(fs, blk, 1ULL | (mask << 1)) < 0)
+	{
+		__myFSFreeBlocks(fs, blk, 1);
+		return 0;
+	}
+	__myFSFragAdd(fs, blk, 1ULL | (mask << 1));
+	return blk * spb + 1;
+}
+
+// Funcao interna que libera os n setores do fragmento que comeca no setor
+// sector. O bloco de fragmentos e' liberado quando fica sem fragmentos.
+// Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSFragFree(MyFSInfo *fs, unsigned int sector, unsigned int n)
+{
+	unsigned char buf[DISK_SECTORDATASIZE];
+	unsigned int spb = fs->sectorsPerBlock, blk = sector / spb, a, lo, hi;
+	unsigned long long used;
+	for (a = 0; a < fs->numFrags && fs->frags[a].block != blk; a++)
+		;
+	if (a < fs->numFrags)
+		used = fs->frags[a].used;
+	else
+	{
+		// Bloco fora da lista: o mapa vem do cabecalho
+		if (__myFSMetaRead(fs, (unsigned long)blk * spb, buf) < 0)
+			return -1;
+		char2ul(&buf[0], &lo);
+		if (lo != MYFS_FRAG_MAGIC)
+			return -1;
+		char2ul(&buf[4], &lo);
+		char2ul(&buf[8], &hi);
+		used = ((unsigned long long)hi << 32) | lo;
+	}
+	used &= ~(((1ULL << n) - 1) << (sector % spb));
+	if (used == 1)
+	{
+		if (a < fs->numFrags)
+			__myFSFragDrop(fs, a);
+		return __myFSFreeBlocks(fs, blk, 1);
+	}
+	if (__myFSFragWriteHeader(fs, blk, used) < 0)
+		return -1;
+	__myFSJournalFreed(fs, blk, 1);
+	if (a < fs->numFrags)
+		fs->frags[a].used = used;
+	else
+		__myFSFragAdd(fs, blk, used);
+	return 0;
+}
+
+// Funcao interna que acrescenta a dst (com *op bytes de max) o complemento
+// v de um tamanho de sequencia LZ, em bytes de 255 e um final menor.
+// Retorna 0 se bem sucedido ou -1 se nao couber
+int __myFSLZPutLength(unsigned char *dst, unsigned int *op, unsigned int max,
+					  unsigned int v)
+{
+	for (;; v -= 255)
+	{
+		if (*op == max)
+			return -1;
+		dst[(*op)++] = (unsigned char)(v < 255 ? v : 255);
+		if (v < 255)
+			return 0;
+	}
+}
+
+// Funcao interna que acrescenta a dst (com *op bytes de max) uma sequencia
+// LZ: lit bytes de src copiados e uma repeticao de len bytes a off bytes
+// para tras, ausente (len 0) na ultima sequencia. Retorna 0 se bem
+// sucedido ou -1 se nao couber
+int __myFSLZPutSeq(unsigned char *dst, unsigned int *op, unsigned int max,
+				   const unsigned char *src, unsigned int lit,
+				   unsigned int off, unsigned int len)
+{
+	unsigned int m = (len ? len - MYFS_LZ_MIN_MATCH : 0);
+	if (*op == max)
+		return -1;
+	dst[(*op)++] = (unsigned char)((lit < 15 ? lit : 15) << 4 | (m < 15 ? m : 15));
+	if ((lit >= 15 && __myFSLZPutLength(dst, op, max, lit - 15) < 0) ||
+		lit > max - *op)
+		return -1;
+	memcpy(&dst[*op], src, lit);
+	*op += lit;
+	if (!len)
+		return 0;
+	if (max - *op < 2)
+		return -1;
+	dst[(*op)++] = (unsigned char)(off & 0xFF);
+	dst[(*op)++] = (unsigned char)(off >> 8);
+	return (m >= 15 ? __myFSLZPutLength(dst, op, max, m - 15) : 0);
+}
+
+// Funcao interna que comprime os n bytes (no maximo 65535) de src para dst,
+// com espaco para max bytes, em sequencias de bytes copiados seguidos de
+// uma repeticao de bytes anteriores, localizada por uma tabela de hash das
+// posicoes ja' vistas. Retorna o tamanho comprimido ou 0 se nao couber
+unsigned int __myFSLZCompress(const unsigned char *src, unsigned int n,
+							  unsigned char *dst, unsigned int max)
+{
+	unsigned short table[1 << MYFS_LZ_HASH_BITS];
+	unsigned int ip = 0, anchor = 0, op = 0;
+	memset(table, 0, sizeof(table));
+	while (ip + MYFS_LZ_MIN_MATCH <= n)
+	{
+		unsigned int v, h, ref, len = MYFS_LZ_MIN_MATCH;
+		char2ul((unsigned char *)&src[ip], &v);
+		h = (v * 2654435761u) >> (32 - MYFS_LZ_HASH_BITS);
+		// Posicoes sao guardadas mais 1; 0 e' uma entrada vazia
+		ref = table[h];
+		table[h] = (unsigned short)(ip + 1);
+		if (!ref || memcmp(&src[ref - 1], &src[ip], MYFS_LZ_MIN_MATCH) != 0)
+		{
+			ip++;
+			continue;
+		}
+		ref--;
+		while (ip + len < n && src[ref + len] == src[ip + len])
+			len++;
+		if (__myFSLZPutSeq(dst, &op, max, &src[anchor], ip - anchor, ip - ref,
+						   len) < 0)
+			return 0;
+		ip += len;
+		anchor = ip;
+	}
+	if (__myFSLZPutSeq(dst, &op, max, &src[anchor], n - anchor, 0, 0) < 0)
+		return 0;
+	return op;
+}
+
+// Funcao interna que descomprime os n bytes de src, gerados por
+// __myFSLZCompress, para dst, com espaco para max bytes. Retorna o tamanho
+// descomprimido ou -1 se os dados forem invalidos
+int __myFSLZDecompress(const unsigned char *src, unsigned int n,
+					   unsigned char *dst, unsigned int max)
+{
+	unsigned int ip = 0, op = 0;
+	while (ip < n)
+	{
+		unsigned int token = src[ip++], lit = token >> 4;
+		unsigned int len = (token & 15) + MYFS_LZ_MIN_MATCH, off;
+		if (lit == 15)
+			do
+			{
+				if (ip == n)
+					return -1;
+				lit += src[ip];
+			} while (src[ip++] == 255);
+		if (lit > n - ip || lit > max - op)
+			return -1;
+		memcpy(&dst[op], &src[ip], lit);
+		ip += lit;
+		op += lit;
+		if (ip == n)
+			break;
+		if (n - ip < 2)
+			return -1;
+		off = src[ip] | (unsigned int)src[ip + 1] << 8;
+		ip += 2;
+		if ((token & 15) == 15)
+			do
+			{
+				if (ip == n)
+					return -1;
+				len += src[ip];
+			} while (src[ip++] == 255);
+		if (off == 0 || off > op || len > max - op)
+			return -1;
+		// A repeticao pode se sobrepor aos bytes que ela mesma produz
+		for (; len > 0; len--, op++)
+			dst[op] = dst[op - off];
+	}
+	return (int)op;
+}
+
+// Funcao interna que comprime os len bytes do bloco data para out, com
+// espaco para um bloco, precedidos dos tamanhos. Retorna o numero de setores
+// dos dados comprimidos ou 0 se eles nao ocuparem ao menos dois setores a
+// menos que um bloco
+unsigned int __myFSZip(MyFSInfo *fs, const unsigned char *data,
+					   unsigned int len, unsigned char *out)
+{
+	unsigned int max, n;
+	if (fs->sectorsPerBlock < 3)
+		return 0;
+	max = (fs->sectorsPerBlock - 2) * DISK_SECTORDATASIZE - MYFS_ZIP_HEADER;
+	n = __myFSLZCompress(data, len, &out[MYFS_ZIP_HEADER], max);
+	// Sem ganho, dados que caibam sao guardados como estao
+	if (n == 0 || n >= len)
+	{
+		if (len > max)
+			return 0;
+		memcpy(&out[MYFS_ZIP_HEADER], data, len);
+		n = len;
+	}
+	ul2char(n | len << 16, out);
+	n += MYFS_ZIP_HEADER;
+	memset(&out[n], 0, DISK_SECTORDATASIZE - 1 - (n - 1) % DISK_SECTORDATASIZE);
+	return (n + DISK_SECTORDATASIZE - 1) / DISK_SECTORDATASIZE;
+}
+
+// Funcao interna que descomprime para buf, com espaco para um bloco e ja'
+// zerado, os dados do bloco comprimido z, de n setores. Retorna 0 se bem
+// sucedido ou -1 se os dados forem invalidos
+int __myFSUnzip(MyFSInfo *fs, const unsigned char *z, unsigned int n,
+				unsigned char *buf)
+{
+	unsigned int h, zlen, len;
+	char2ul((unsigned char *)z, &h);
+	zlen = h & 0xFFFF;
+	len = h >> 16;
+	if (len > fs->blockSize || zlen > n * DISK_SECTORDATASIZE - MYFS_ZIP_HEADER)
+		return -1;
+	if (zlen == len)
+	{
+		memcpy(buf, &z[MYFS_ZIP_HEADER], len);
+		return 0;
+	}
+	return (__myFSLZDecompress(&z[MYFS_ZIP_HEADER], zlen, buf, len) == (int)len
+				? 0
+				: -1);
+}
+
+// Funcao interna que escolhe o grupo para o i-node de um novo diretorio,
+// espalhando diretorios pelo disco: entre os grupos com ao menos a media de
+// i-nodes livres, o de mais blocos livres (em empate, o de menos diretorios)
+unsigned int __myFSPickDirGroup(MyFSInfo *fs)
+{
+	unsigned int avgInodes = fs->freeInodes / fs->numGroups, best = 0;
+	int found = 0;
+	for (unsigned int g = 0; g < fs->numGroups; g++)
+	{
+		MyFSGroup *gr = &fs->groups[g];
+		if (gr->freeInodes == 0 || gr->freeInodes < avgInodes)
+			continue;
+		if (!found || gr->freeBlocks > fs->groups[best].freeBlocks ||
+			(gr->freeBlocks == fs->groups[best].freeBlocks &&
+			 gr->numDirs < fs->groups[best].numDirs))
+		{
+			best = g;
+			found = 1;
+		}
+	}
+	return best;
+}
+
+// Funcao interna que aloca um i-node, preferencialmente no grupo group,
+// passando aos grupos seguintes se estiver cheio. isDir indica se o i-node
+// sera' de um diretorio. Retorna o numero do i-node ou 0 se nao houver
+// i-node livre
+unsigned int __myFSAllocInode(MyFSInfo *fs, unsigned int group, int isDir)
+{
+	MyFSBitmap *bm = &fs->inodeMap;
+	unsigned int bit, g;
+	if (fs->freeInodes == 0 && !__myFSOrphanDrain(fs))
+		return 0;
+	if (group >= fs->numGroups)
+		group = 0;
+	if (__myFSGroupLoad(fs, group) < 0)
+		return 0;
+	bit = __myFSBitmapFindFree(bm, group * fs->inodesPerGroup);
+	if (bit >= bm->numBits)
+		bit = __myFSBitmapFindFree(bm, 0);
+	// Sem i-node livre nos grupos lidos, sao lidos os grupos ainda nao lidos
+	// que tenham algum
+	while (bit >= bm->numBits &&
+		   (g = __myFSGroupPending(fs, group, 0, 1)) < fs->numGroups)
+	{
+		if (__myFSGroupLoad(fs, g) < 0)
+			return 0;
+		bit = __myFSBitmapFindFree(bm, g * fs->inodesPerGroup);
+	}
+	if (bit >= bm->numBits)
+		return 0;
+	g = bit / fs->inodesPerGroup;
+	if (__myFSInitInodeTable(fs, g, bit % fs->inodesPerGroup) < 0)
+		return 0;
+	__myFSBitmapMark(bm, bit, 1, 1);
+	fs->groups[g].freeInodes--;
+	fs->freeInodes--;
+	if (isDir)
+		fs->groups[g].numDirs++;
+	if (__myFSWriteGroupBitmap(fs, bm, g, fs->inodesPerGroup,
+							   fs->inodeBitmapOffset,
+							   bit % fs->inodesPerGroup, 1) < 0)
+		return 0;
+	return bit + 1;
+}
+
+// Funcao interna que libera o i-node number. isDir indica se o i-node era
+// de um diretorio. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSFreeInode(MyFSInfo *fs, unsigned int number, int isDir)
+{
+	unsigned int g;
+	if (number < 1 || number > fs->numInodes)
+		return -1;
+	g = __myFSInodeGroup(fs, number);
+	if (__myFSGroupLoad(fs, g) < 0)
+		return -1;
+	if (__myFSBitmapMark(&fs->inodeMap, number - 1, 1, 0))
+	{
+		fs->groups[g].freeInodes++;
+		fs->freeInodes++;
+		if (isDir && fs->groups[g].numDirs)
+			fs->groups[g].numDirs--;
+	}
+	return __myFSWriteGroupBitmap(fs, &fs->inodeMap, g, fs->inodesPerGroup,
+								  fs->inodeBitmapOffset,
+								  (number - 1) % fs->inodesPerGroup, 1);
+}
+
+MyFSInfo *__myFSGetInfo(Disk *d);
+
+// Funcao interna usada por inodeAddBlock para obter i-nodes de extensao,
+// no mesmo grupo do i-node que esta' sendo estendido
+unsigned int __myFSAllocExtInode(Disk *d, unsigned int near)
+{
+	MyFSInfo *fs = __myFSGetInfo(d);
+	if (!fs)
+		return 0;
+	return __myFSAllocInode(fs, __myFSInodeGroup(fs, near), 0);
+}
+
+// Funcao interna usada por inodeClear para liberar i-nodes de extensao
+void __myFSReleaseExtInode(Disk *d, unsigned int number)
+{
+	MyFSInfo *fs = __myFSGetInfo(d);
+	if (fs)
+		__myFSFreeInode(fs, number, 0);
+}
+
+// Funcao interna usada pelo modulo de i-nodes para ler setores de i-nodes,
+// que podem ter alteracoes ainda no journal ou ja' ter sido lidos em lote
+int __myFSInodeReadSector(Disk *d, unsigned long addr, unsigned char *sector)
+{
+	MyFSInfo *fs = __myFSGetInfo(d);
+	if (!fs)
+		return diskReadSector(d, addr, sector);
+	if (fs->itBuf && addr >= fs->itFirst && addr < fs->itFirst + fs->itCount &&
+		!__myFSJournalFind(fs, addr))
+	{
+		memcpy(sector, &fs->itBuf[(addr - fs->itFirst) * DISK_SECTORDATASIZE],
+			   DISK_SECTORDATASIZE);
+		return 0;
+	}
+	return __myFSMetaRead(fs, addr, sector);
+}
+
+// Funcao interna usada pelo modulo de i-nodes para gravar setores de
+// i-nodes, pelo journal
+int __myFSInodeWriteSector(Disk *d, unsigned long addr, unsigned char *sector)
+{
+	MyFSInfo *fs = __myFSGetInfo(d);
+	if (!fs)
+		return diskWriteSector(d, addr, sector);
+	return __myFSMetaWrite(fs, addr, sector);
+}
+
+// Funcao interna que registra, no modulo de i-nodes, a geometria dos grupos
+// de fs, o alocador de i-nodes de extensao e o acesso aos setores de
+// i-nodes pelo journal e pelas leituras em lote
+int __myFSSetupInodes(MyFSInfo *fs)
+{
+	if (inodeSetGeometry(fs->d, fs->inodesPerGroup,
+						 __myFSGroupSector(fs, 1), inodeAreaBeginSector()) < 0)
+		return -1;
+	inodeSetAllocator(fs->d, __myFSAllocExtInode, __myFSReleaseExtInode);
+	inodeSetSectorIO(fs->d, __myFSInodeReadSector, __myFSInodeWriteSector);
+	return 0;
+}
+
+// Funcao interna que retorna o setor do i-node number
+unsigned long __myFSInodeSector(MyFSInfo *fs, unsigned int number)
+{
+	unsigned int g = __myFSInodeGroup(fs, number);
+	return __myFSGroupSector(fs, g) + inodeAreaBeginSector() +
+		   (number - 1 - g * fs->inodesPerGroup) / inodeNumInodesPerSector();
+}
+
+// Funcao interna que libera as informacoes em memoria de um disco
+void __myFSFreeInfo(MyFSInfo *fs)
+{
+	if (!fs)
+		return;
+	for (int h = 0; h < MYFS_NODE_HASH; h++)
+		while (fs->nodes[h])
+		{
+			MyFSNode *n = fs->nodes[h];
+			fs->nodes[h] = n->next;
+			free(n->dirHeader);
+			free(n->blocks);
+			free(n->wbBuf);
+			free(n);
+		}
+	__myFSBitmapFree(&fs->blockMap);
+	__myFSBitmapFree(&fs->inodeMap);
+	free(fs->refCounts);
+	free(fs->dedupFps);
+	free(fs->dedupHeads);
+	free(fs->dedupNext);
+	__myFSJournalFree(fs);
+	free(fs->jRevoked);
+	free(fs->groups);
+	free(fs->dentries);
+	free(fs);
+}
+
+// Funcao interna que descarta as informacoes em memoria de um disco, se
+// houver, como ao reformata-lo
+void __myFSForgetInfo(Disk *d)
+{
+	for (int a = 0; a < MYFS_MAX_DISKS; a++)
+		if (myFSInfos[a] && myFSInfos[a]->d == d)
+		{
+			__myFSFreeInfo(myFSInfos[a]);
+			myFSInfos[a] = NULL;
+		}
+	// Geometria, alocador e acesso aos setores vao junto com o pool
+	inodePoolDestroy(d);
+}
+
+// Funcao interna que aloca as estruturas em memoria de fs, cujo layout ja'
+// foi calculado. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSAllocInfo(MyFSInfo *fs)
+{
+	fs->groups = calloc(fs->numGroups, sizeof(MyFSGroup));
+	fs->dentries = calloc(MYFS_DCACHE_SIZE, sizeof(MyFSDentry));
+	if (fs->refCountSectors)
+		fs->refCounts = calloc(fs->numGroups, fs->blocksPerGroup);
+	if (fs->dedupSectors)
+		fs->dedupFps = calloc((size_t)fs->numGroups * fs->blocksPerGroup,
+							  sizeof(unsigned int));
+	if (!fs->groups || !fs->dentries ||
+		(fs->refCountSectors && !fs->refCounts) ||
+		(fs->dedupSectors && !fs->dedupFps) ||
+		__myFSBitmapInit(&fs->blockMap,
+						 fs->numGroups * fs->blocksPerGroup) < 0 ||
+		__myFSBitmapInit(&fs->inodeMap, fs->numInodes) < 0)
+		return -1;
+	for (int e = 0; e < MYFS_DCACHE_SIZE; e++)
+	{
+		fs->dentries[e].lruPrev = (e > 0 ? &fs->dentries[e - 1] : NULL);
+		fs->dentries[e].lruNext = (e < MYFS_DCACHE_SIZE - 1 ? &fs->dentries[e + 1]
+															: NULL);
+	}
+	fs->lruFirst = &fs->dentries[0];
+	fs->lruLast = &fs->dentries[MYFS_DCACHE_SIZE - 1];
+	return 0;
+}
+
+// Funcao interna que serializa em buf, com size bytes zerados, as entradas
+// mais recentes do cache de nomes que couberem, da mais antiga para a mais
+// recente, de modo que recoloca-las nessa ordem refaz a ordem de uso.
+// Retorna o numero de bytes usados
+unsigned int __myFSWarmPack(MyFSInfo *fs, unsigned char *buf, unsigned int size)
+{
+	MyFSDentry *e = fs->lruFirst, *last = NULL;
+	unsigned int used = 0, pos = 0;
+	// Entradas livres ficam no fim da ordem de uso
+	for (; e && e->parent; e = e->lruNext)
+	{
+		unsigned int len = 2 * sizeof(unsigned int) + 1 + strlen(e->name);
+		if (used + len > size)
+			break;
+		used += len;
+		last = e;
+	}
+	for (e = last; e; e = e->lruPrev)
+	{
+		unsigned int len = strlen(e->name);
+		ul2char(e->parent, &buf[pos]);
+		ul2char(e->inumber, &buf[pos + sizeof(unsigned int)]);
+		pos += 2 * sizeof(unsigned int);
+		buf[pos++] = (unsigned char)len;
+		memcpy(&buf[pos], e->name, len);
+		pos += len;
+	}
+	return pos;
+}
+
+void __myFSDcacheSet(MyFSInfo *fs, unsigned int parent, const char *name,
+					 unsigned int inumber);
+
+// Funcao interna que recoloca no cache de nomes as entradas serializadas
+// por __myFSWarmPack nos size bytes de buf. A serializacao termina em uma
+// entrada com pai 0 ou no fim de buf; entradas invalidas a encerram
+void __myFSWarmUnpack(MyFSInfo *fs, unsigned char *buf, unsigned int size)
+{
+	unsigned int pos = 0, parent, inumber, len;
+	char name[MAX_FILENAME_LENGTH + 1];
+	while (pos + 2 * sizeof(unsigned int) + 1 <= size)
+	{
+		char2ul(&buf[pos], &parent);
+		char2ul(&buf[pos + sizeof(unsigned int)], &inumber);
+		pos += 2 * sizeof(unsigned int);
+		len = buf[pos++];
+		if (parent == 0 || parent > fs->numInodes || inumber > fs->numInodes ||
+			len == 0 || pos + len > size)
+			break;
+		memcpy(name, &buf[pos], len);
+		name[len] = '\0';
+		pos += len;
+		__myFSDcacheSet(fs, parent, name, inumber);
+	}
+}
+
+// Funcao interna que grava no log vazio do journal o resumo do alocador,
+// com o aquecimento (ver MYFS_SUMMARY_MAGIC) e, no superbloco, seu tamanho.
+// Um resumo ja' gravado e' regravado, com o aquecimento da sessao corrente.
+// Sem journal ou com transacoes ainda no log, nada faz. Retorna 0 se bem
+// sucedido ou -1, caso contrario
+int __myFSSummaryWrite(MyFSInfo *fs)
+{
+	unsigned int per = DISK_SECTORDATASIZE / sizeof(unsigned int), n, h;
+	unsigned int groupSectors, warm = MYFS_WARM_SECTORS;
+	unsigned char *buf;
+	int ret;
+	if (!fs->jMaxTxn || fs->jCount || fs->jUsed)
+		return 0;
+	groupSectors = (fs->numGroups * MYFS_SUMMARY_GROUP + per - 1) / per;
+	if (1 + groupSectors > __myFSJournalLogSize(fs))
+		return 0;
+	// Em um log pequeno, o cache de nomes fica com o que sobrar
+	if (1 + groupSectors + warm > __myFSJournalLogSize(fs))
+		warm = __myFSJournalLogSize(fs) - 1 - groupSectors;
+	buf = calloc(1 + groupSectors + warm, DISK_SECTORDATASIZE);
+	if (!buf)
+		return -1;
+	warm = (__myFSWarmPack(fs, &buf[(1 + groupSectors) * DISK_SECTORDATASIZE],
+						   warm * DISK_SECTORDATASIZE) +
+			DISK_SECTORDATASIZE - 1) /
+		   DISK_SECTORDATASIZE;
+	n = 1 + groupSectors + warm;
+	// O superbloco passa a apontar o resumo em uma transacao propria, antes
+	// de o resumo ir para o log, ja' vazio, depois dela. Em uma queda entre
+	// os dois, a sequencia do que estiver no log nao confere e o resumo e'
+	// ignorado na montagem
+	if (__myFSSummarySetSize(fs, n) < 0 || __myFSJournalCheckpoint(fs) < 0)
+	{
+		free(buf);
+		return -1;
+	}
+	ul2char(MYFS_SUMMARY_MAGIC, &buf[0]);
+	ul2char(fs->jId, &buf[sizeof(unsigned int)]);
+	ul2char(fs->jSeq, &buf[2 * sizeof(unsigned int)]);
+	ul2char(fs->numGroups, &buf[4 * sizeof(unsigned int)]);
+	ul2char(fs->allocHint, &buf[5 * sizeof(unsigned int)]);
+	ul2char(fs->numFrags, &buf[6 * sizeof(unsigned int)]);
+	ul2char(warm, &buf[7 * sizeof(unsigned int)]);
+	for (unsigned int a = 0; a < fs->numFrags; a++)
+	{
+		unsigned char *f = &buf[(MYFS_SUMMARY_HEADER + 3 * a) *
+								sizeof(unsigned int)];
+		ul2char(fs->frags[a].block, &f[0]);
+		ul2char((unsigned int)(fs->frags[a].used & 0xFFFFFFFFu),
+				&f[sizeof(unsigned int)]);
+		ul2char((unsigned int)(fs->frags[a].used >> 32),
+				&f[2 * sizeof(unsigned int)]);
+	}
+	for (unsigned int g = 0; g < fs->numGroups; g++)
+	{
+		unsigned char *e = &buf[DISK_SECTORDATASIZE +
+								g * MYFS_SUMMARY_GROUP * sizeof(unsigned int)];
+		ul2char(fs->groups[g].freeBlocks, &e[0]);
+		ul2char(fs->groups[g].freeInodes, &e[sizeof(unsigned int)]);
+		ul2char(fs->groups[g].numDirs, &e[2 * sizeof(unsigned int)]);
+		ul2char(fs->groups[g].itableUnused, &e[3 * sizeof(unsigned int)]);
+		ul2char(fs->groups[g].hot, &e[4 * sizeof(unsigned int)]);
+	}
+	h = __myFSChecksum(2166136261u, &buf[4 * sizeof(unsigned int)],
+					   n * DISK_SECTORDATASIZE - 4 * sizeof(unsigned int));
+	ul2char(h, &buf[3 * sizeof(unsigned int)]);
+	ret = __myFSJournalLogIO(fs, fs->jTail, n, buf, 1);
+	free(buf);
+	return ret;
+}
+
+// Funcao interna que le o resumo do alocador indicado no superbloco e, se
+// for do journal corrente, integro e coerente com os contadores do
+// superbloco, o aplica: os grupos gravados ficam com os contadores do resumo
+// e os mapas por ler, marcados como cheios ate' la'; os demais, como
+// formatados. Os grupos quentes ficam para leitura antecipada e o cache de
+// nomes recebe as entradas gravadas. Nada e' aplicado se o resumo nao
+// servir. Retorna 0 se aplicado ou -1, caso contrario
+int __myFSSummaryRead(MyFSInfo *fs)
+{
+	unsigned int per = DISK_SECTORDATASIZE / sizeof(unsigned int);
+	unsigned int n = fs->summarySectors, v[MYFS_SUMMARY_HEADER];
+	unsigned int freeBlocks = 0, freeInodes = 0, groupSectors;
+	unsigned char *buf;
+	int ok;
+	groupSectors = (fs->numGroups * MYFS_SUMMARY_GROUP + per - 1) / per;
+	if (!fs->jMaxTxn || n > __myFSJournalLogSize(fs) || n < 1 + groupSectors ||
+		n > 1 + groupSectors + MYFS_WARM_SECTORS)
+		return -1;
+	buf = malloc(n * DISK_SECTORDATASIZE);
+	if (!buf || __myFSJournalLogIO(fs, fs->jTail, n, buf, 0) < 0)
+	{
+		free(buf);
+		return -1;
+	}
+	for (unsigned int a = 0; a < MYFS_SUMMARY_HEADER; a++)
+		char2ul(&buf[a * sizeof(unsigned int)], &v[a]);
+	ok = (v[0] == MYFS_SUMMARY_MAGIC && v[1] == fs->jId && v[2] == fs->jSeq &&
+		  v[3] == __myFSChecksum(2166136261u, &buf[4 * sizeof(unsigned int)],
+								 n * DISK_SECTORDATASIZE -
+									 4 * sizeof(unsigned int)) &&
+		  v[4] == fs->numGroups && v[6] <= MYFS_FRAG_OPEN &&
+		  v[7] == n - 1 - groupSectors);
+	for (unsigned int g = 0; ok && g < fs->numGroups; g++)
+	{
+		unsigned char *e = &buf[DISK_SECTORDATASIZE +
+								g * MYFS_SUMMARY_GROUP * sizeof(unsigned int)];
+		unsigned int c[MYFS_SUMMARY_GROUP];
+		for (unsigned int a = 0; a < MYFS_SUMMARY_GROUP; a++)
+			char2ul(&e[a * sizeof(unsigned int)], &c[a]);
+		ok = (c[0] <= fs->blocksPerGroup && c[1] <= fs->inodesPerGroup &&
+			  c[3] <= fs->itableSectors);
+		freeBlocks += c[0];
+		freeInodes += c[1];
+	}
+	if (!ok || freeBlocks != fs->sbFreeBlocks || freeInodes != fs->sbFreeInodes)
+	{
+		free(buf);
+		return -1;
+	}
+	fs->allocHint = (v[5] < fs->numBlocks ? v[5] : 0);
+	fs->numFrags = 0;
+	for (unsigned int a = 0; a < v[6]; a++)
+	{
+		unsigned char *f = &buf[(MYFS_SUMMARY_HEADER + 3 * a) *
+								sizeof(unsigned int)];
+		unsigned int block, lo, hi;
+		char2ul(&f[0], &block);
+		char2ul(&f[sizeof(unsigned int)], &lo);
+		char2ul(&f[2 * sizeof(unsigned int)], &hi);
+		if (block < fs->numBlocks)
+			__myFSFragAdd(fs, block, ((unsigned long long)hi << 32) | lo);
+	}
+	for (unsigned int g = 0; g < fs->numGroups; g++)
+	{
+		unsigned char *e = &buf[DISK_SECTORDATASIZE +
+								g * MYFS_SUMMARY_GROUP * sizeof(unsigned int)];
+		unsigned int hot;
+		if (g >= fs->initGroups)
+			__myFSGroupDefaults(fs, g);
+		else
+		{
+			char2ul(&e[0], &fs->groups[g].freeBlocks);
+			char2ul(&e[sizeof(unsigned int)], &fs->groups[g].freeInodes);
+			char2ul(&e[2 * sizeof(unsigned int)], &fs->groups[g].numDirs);
+			char2ul(&e[3 * sizeof(unsigned int)], &fs->groups[g].itableUnused);
+			__myFSBitmapMark(&fs->blockMap, g * fs->blocksPerGroup,
+							 fs->blocksPerGroup, 1);
+			__myFSBitmapMark(&fs->inodeMap, g * fs->inodesPerGroup,
+							 fs->inodesPerGroup, 1);
+			fs->groups[g].unread = 1;
+			fs->unreadGroups++;
+			char2ul(&e[4 * sizeof(unsigned int)], &hot);
+			if (hot)
+			{
+				fs->groups[g].warm = 1;
+				fs->warmGroups++;
+			}
+		}
+		fs->freeBlocks += fs->groups[g].freeBlocks;
+		fs->freeInodes += fs->groups[g].freeInodes;
+	}
+	__myFSWarmUnpack(fs, &buf[(1 + groupSectors) * DISK_SECTORDATASIZE],
+					 v[7] * DISK_SECTORDATASIZE);
+	free(buf);
+	return 0;
+}
+
+// Funcao interna que retorna as informacoes em memoria do MyFS de um disco,
+// carregando superbloco e grupos na primeira chamada. Retorna NULL se o
+// disco nao estiver formatado com MyFS ou em caso de falha
+MyFSInfo *__myFSGetInfo(Disk *d)
+{
+	unsigned char sector[DISK_SECTORDATASIZE];
+	MyFSInfo *fs;
+	int slot = -1, replayed;
+	if (!d)
+		return NULL;
+	for (int a = 0; a < MYFS_MAX_DISKS; a++)
+	{
+		if (myFSInfos[a] && myFSInfos[a]->d == d)
+			return myFSInfos[a];
+		if (!myFSInfos[a] && slot < 0)
+			slot = a;
+	}
+	if (slot < 0)
+		return NULL;
+	if (diskReadSector(d, MYFS_SUPERBLOCK_SECTOR, sector) < 0)
+		return NULL;
+	fs = calloc(1, sizeof(MyFSInfo));
+	if (!fs)
+		return NULL;
+	fs->d = d;
+	// Transacoes completas no journal sao refeitas antes de ler os grupos.
+	// Se houve alguma, o superbloco e' relido, pois os grupos inicializados
+	// podem ter mudado
+	if (__myFSUnpackSuperblock(fs, sector) < 0 || __myFSAllocInfo(fs) < 0 ||
+		(replayed = __myFSJournalRecover(fs)) < 0 ||
+		(replayed > 0 &&
+		 (diskReadSector(d, MYFS_SUPERBLOCK_SECTOR, sector) < 0 ||
+		  __myFSUnpackSuperblock(fs, sector) < 0)))
+	{
+		__myFSFreeInfo(fs);
+		return NULL;
+	}
+	// Sem transacoes refeitas, basta o resumo gravado ao desmontar, se
+	// houver. Senao, grupos ainda nao gravados estao como foram formatados e
+	// os blocos e i-nodes livres sao recontados a partir dos grupos
+	if (replayed > 0 || !fs->summarySectors || __myFSSummaryRead(fs) < 0)
+	{
+		fs->summarySectors = 0;
+		for (unsigned int g = 0; g < fs->numGroups; g++)
+		{
+			if (g >= fs->initGroups)
+				__myFSGroupDefaults(fs, g);
+			else if (__myFSReadGroup(fs, g) < 0)
+			{
+				__myFSFreeInfo(fs);
+				return NULL;
+			}
+			fs->freeBlocks += fs->groups[g].freeBlocks;
+			fs->freeInodes += fs->groups[g].freeInodes;
+		}
+	}
+	if (__myFSSetupInodes(fs) < 0)
+	{
+		__myFSFreeInfo(fs);
+		return NULL;
+	}
+	myFSInfos[slot] = fs;
+	// Discos formatados antes dos contadores de uso: os bytes em uso sao
+	// somados uma vez, percorrendo os i-nodes
+	if (!(fs->features & MYFS_FEAT_USAGE))
+	{
+		Inode inode;
+		fs->usedBytes = 0;
+		for (unsigned int number = 1; number <= fs->numInodes; number++)
+			if (__myFSBitmapTest(&fs->inodeMap, number - 1) &&
+				inodeLoadInto(&inode, number, d) == 0 &&
+				(inodeGetFileType(&inode) == FILETYPE_REGULAR ||
+				 inodeGetFileType(&inode) == FILETYPE_DIR))
+				fs->usedBytes += inodeGetFileSize(&inode);
+		fs->features |= MYFS_FEAT_USAGE;
+		__myFSWriteSuperblock(fs);
+		__myFSJournalCheckpoint(fs);
+	}
+	return fs;
+}
+
+// Funcao interna de hash (FNV-1a) para nomes de entradas de diretorio
+unsigned int __myFSDirHash(const char *name)
+{
+	unsigned int h = 2166136261u;
+	for (; *name; name++)
+	{
+		h ^= (unsigned char)*name;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// Funcao interna que move uma entrada do cache de nomes para o inicio
+// (posicao mais recente, se first) ou o fim (proxima a ser reutilizada) da
+// ordem de uso
+void __myFSDcacheMove(MyFSInfo *fs, MyFSDentry *e, int first)
+{
+	if (e->lruPrev)
+		e->lruPrev->lruNext = e->lruNext;
+	else
+		fs->lruFirst = e->lruNext;
+	if (e->lruNext)
+		e->lruNext->lruPrev = e->lruPrev;
+	else
+		fs->lruLast = e->lruPrev;
+	if (first)
+	{
+		e->lruPrev = NULL;
+		e->lruNext = fs->lruFirst;
+		if (fs->lruFirst)
+			fs->lruFirst->lruPrev = e;
+		fs->lruFirst = e;
+		if (!fs->lruLast)
+			fs->lruLast = e;
+	}
+	else
+	{
+		e->lruNext = NULL;
+		e->lruPrev = fs->lruLast;
+		if (fs->lruLast)
+			fs->lruLast->lruNext = e;
+		fs->lruLast = e;
+		if (!fs->lruFirst)
+			fs->lruFirst = e;
+	}
+}
+
+// Funcao interna que retira uma entrada do cache de nomes, tornando-a livre
+void __myFSDcacheDrop(MyFSInfo *fs, MyFSDentry *e)
+{
+	MyFSDentry **p;
+	if (!e->parent)
+		return;
+	for (p = &fs->dcache[e->hash % MYFS_DCACHE_HASH]; *p; p = &(*p)->next)
+		if (*p == e)
+		{
+			*p = e->next;
+			break;
+		}
+	e->parent = 0;
+	__myFSDcacheMove(fs, e, 0);
+}
+
+// Funcao interna que procura (parent, name) no cache de nomes. Retorna a
+// entrada ou NULL se nao estiver no cache
+MyFSDentry *__myFSDcacheFind(MyFSInfo *fs, unsigned int parent,
+							 const char *name, unsigned int hash)
+{
+	MyFSDentry *e;
+	for (e = fs->dcache[hash % MYFS_DCACHE_HASH]; e; e = e->next)
+		if (e->hash == hash && e->parent == parent && strcmp(e->name, name) == 0)
+			return e;
+	return NULL;
+}
+
+// Funcao interna que consulta o cache de nomes. Se (parent, name) estiver no
+// cache, escreve em *inumber o i-node da entrada (0 se o nome nao existe) e
+// retorna 0. Retorna -1 se a entrada nao estiver no cache
+int __myFSDcacheLookup(MyFSInfo *fs, unsigned int parent, const char *name,
+					   unsigned int *inumber)
+{
+	MyFSDentry *e = __myFSDcacheFind(fs, parent, name,
+									 __myFSDirHash(name) ^ (parent * 2654435761u));
+	if (!e)
+		return -1;
+	__myFSDcacheMove(fs, e, 1);
+	*inumber = e->inumber;
+	return 0;
+}
+
+// Funcao interna que registra no cache de nomes que (parent, name) leva ao
+// i-node inumber (0 se o nome nao existe), reutilizando a entrada usada ha'
+// mais tempo se o cache estiver cheio
+void __myFSDcacheSet(MyFSInfo *fs, unsigned int parent, const char *name,
+					 unsigned int inumber)
+{
+	unsigned int hash = __myFSDirHash(name) ^ (parent * 2654435761u);
+	MyFSDentry *e = __myFSDcacheFind(fs, parent, name, hash);
+	if (!e && strlen(name) <= MAX_FILENAME_LENGTH)
+	{
+		e = fs->lruLast;
+		__myFSDcacheDrop(fs, e);
+		e->parent = parent;
+		e->hash = hash;
+		strcpy(e->name, name);
+		e->next = fs->dcache[hash % MYFS_DCACHE_HASH];
+		fs->dcache[hash % MYFS_DCACHE_HASH] = e;
+	}
+	if (e)
+	{
+		e->inumber = inumber;
+		__myFSDcacheMove(fs, e, 1);
+	}
+}
+
+// Funcao interna que retira do cache de nomes todas as entradas do
+// diretorio parent, cujo i-node deixou de existir
+void __myFSDcachePurgeDir(MyFSInfo *fs, unsigned int parent)
+{
+	for (int e = 0; e < MYFS_DCACHE_SIZE; e++)
+		if (fs->dentries[e].parent == parent)
+			__myFSDcacheDrop(fs, &fs->dentries[e]);
+}
+
+// Funcao interna que le um bloco de metadados (diretorios) inteiro, a partir
+// do setor addr, para buf. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSReadBlock(MyFSInfo *fs, unsigned int addr, unsigned char *buf)
+{
+	for (unsigned int s = 0; s < fs->sectorsPerBlock; s++)
+		if (__myFSMetaRead(fs, addr + s, &buf[s * DISK_SECTORDATASIZE]) < 0)
+			return -1;
+	return 0;
+}
+
+// Funcao interna que grava, pelo journal, um bloco de metadados (diretorios)
+// inteiro, a partir do setor addr, com o conteudo de buf. Retorna 0 se bem
+// sucedido ou -1, caso contrario
+int __myFSWriteBlock(MyFSInfo *fs, unsigned int addr, unsigned char *buf)
+{
+	for (unsigned int s = 0; s < fs->sectorsPerBlock; s++)
+		if (__myFSMetaWrite(fs, addr + s, &buf[s * DISK_SECTORDATASIZE]) < 0)
+			return -1;
+	return 0;
+}
+
+// Funcao interna que retorna o numero de blocos ocupados por um i-node
+unsigned int __myFSNodeNumBlocks(MyFSNode *node)
+{
+	unsigned int bs = node->fs->blockSize;
+	return (inodeGetFileSize(&node->inode) + bs - 1) / bs;
+}
+
+// Funcao interna que muda o tamanho de um i-node para size, sem salva-lo,
+// mantendo o total de bytes em uso do disco
+void __myFSNodeSetSize(MyFSNode *node, unsigned int size)
+{
+	node->fs->usedBytes += size;
+	node->fs->usedBytes -= inodeGetFileSize(&node->inode);
+	inodeSetFileSize(&node->inode, size);
+}
+
+// Funcao interna que retorna 1 se o i-node for de um diretorio
+int __myFSNodeIsDir(MyFSNode *node)
+{
+	return inodeGetFileType(&node->inode) == FILETYPE_DIR;
+}
+
+// Funcao interna que le para um vetor em memoria, compartilhado por todos
+// que usam o i-node, os enderecos de todos os blocos da cadeia de i-nodes,
+// inclusive os reservados alem do fim do arquivo, com um endereco
+// MYFS_HOLE para cada bloco de um buraco. Um fragmento final fica com seu
+// endereco MYFS_TAIL. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSNodeMapBlocks(MyFSNode *node)
+{
+	unsigned int n = __myFSNodeNumBlocks(node) + 1, got, total = 0, holes = 0;
+	node->mapSize = (n > 16 ? n : 16);
+	node->blocks = malloc(node->mapSize * sizeof(unsigned int));
+	if (!node->blocks)
+		return -1;
+	got = inodeGetBlockAddrs(&node->inode, 0, node->mapSize, node->blocks);
+	// Vetor cheio: pode haver blocos reservados alem dos lidos
+	while (got == node->mapSize && node->blocks[got - 1] != 0)
+	{
+		unsigned int *b = realloc(node->blocks, 2 * node->mapSize *
+													sizeof(unsigned int));
+		if (!b)
+		{
+			free(node->blocks);
+			node->blocks = NULL;
+			return -1;
+		}
+		node->blocks = b;
+		got += inodeGetBlockAddrs(&node->inode, node->mapSize, node->mapSize,
+								  &b[node->mapSize]);
+		node->mapSize *= 2;
+	}
+	while (got > 0 && node->blocks[got - 1] == 0)
+		got--;
+	for (unsigned int a = 0; a < got; a++)
+	{
+		if (node->blocks[a] & MYFS_HOLE)
+			holes++;
+		total += (node->blocks[a] & MYFS_HOLE ? node->blocks[a] & ~MYFS_HOLE : 1);
+	}
+	// Buracos sao expandidos, um endereco por bloco
+	if (holes > 0)
+	{
+		unsigned int size = (total > 16 ? total : 16), k = 0;
+		unsigned int *b = malloc(size * sizeof(unsigned int));
+		if (!b)
+		{
+			free(node->blocks);
+			node->blocks = NULL;
+			return -1;
+		}
+		for (unsigned int a = 0; a < got; a++)
+		{
+			if (!(node->blocks[a] & MYFS_HOLE))
+				b[k++] = node->blocks[a];
+			else
+				for (unsigned int j = node->blocks[a] & ~MYFS_HOLE; j > 0; j--)
+					b[k++] = MYFS_HOLE;
+		}
+		free(node->blocks);
+		node->blocks = b;
+		node->mapSize = size;
+	}
+	node->numMapped = total;
+	return 0;
+}
+
+// Funcao interna que retorna o endereco do bloco logico lblock de um i-node
+// (MYFS_HOLE se for um buraco), ou 0 se o bloco nao existir ou nao puder ser
+// localizado, a partir do vetor de enderecos em memoria
+unsigned int __myFSNodeBlockAddr(MyFSNode *node, unsigned int lblock)
+{
+	if (!node->blocks && __myFSNodeMapBlocks(node) < 0)
+		return 0;
+	return (lblock < node->numMapped ? node->blocks[lblock] : 0);
+}
+
+// Funcao interna que retorna o numero de blocos alocados a um i-node, que
+// pode ser maior que o necessario para seu tamanho se houver blocos
+// reservados. Blocos de buracos tambem sao contados. Retorna 0 em caso de
+// falha
+unsigned int __myFSNodeAllocated(MyFSNode *node)
+{
+	if (!node->blocks && __myFSNodeMapBlocks(node) < 0)
+		return 0;
+	return node->numMapped;
+}
+
+// Funcao interna que acrescenta addr ao vetor de enderecos de um i-node, se
+// ja' lido, apos um novo bloco ser acrescentado ao fim do arquivo
+void __myFSNodeMapAppend(MyFSNode *node, unsigned int addr)
+{
+	if (!node->blocks)
+		return;
+	if (node->numMapped == node->mapSize)
+	{
+		unsigned int *b = realloc(node->blocks, 2 * node->mapSize *
+													sizeof(unsigned int));
+		if (!b)
+		{
+			// Sem memoria: o vetor sera' lido novamente quando necessario
+			free(node->blocks);
+			node->blocks = NULL;
+			return;
+		}
+		node->blocks = b;
+		node->mapSize *= 2;
+	}
+	node->blocks[node->numMapped++] = addr;
+}
+
+// Funcao interna que retorna a posicao seguinte ao fim do trecho de map (com
+// n enderecos) que comeca em b: um bloco alocado ou um buraco inteiro
+unsigned int __myFSMapRunEnd(const unsigned int *map, unsigned int b,
+							 unsigned int n)
+{
+	unsigned int e = b + 1;
+	if (map[b] == MYFS_HOLE)
+		while (e < n && map[e] == MYFS_HOLE)
+			e++;
+	return e;
+}
+
+// Funcao interna que converte os enderecos de map de from (inicio de um
+// trecho) ate' n nos enderecos gravados no i-node: um por bloco alocado e um
+// por buraco. Os enderecos sao escritos em slots, se nao for NULL. Retorna o
+// numero de enderecos
+unsigned int __myFSMapEncode(const unsigned int *map, unsigned int from,
+							 unsigned int n, unsigned int *slots)
+{
+	unsigned int count = 0;
+	for (unsigned int b = from, e; b < n; b = e, count++)
+	{
+		e = __myFSMapRunEnd(map, b, n);
+		if (slots)
+			slots[count] = (map[b] == MYFS_HOLE ? MYFS_HOLE | (e - b) : map[b]);
+	}
+	return count;
+}
+
+// Funcao interna que retorna o bloco logico em que comeca o trecho do vetor
+// de enderecos de um i-node que contem lblock
+unsigned int __myFSNodeRunStart(MyFSNode *node, unsigned int lblock)
+{
+	if (node->blocks[lblock] == MYFS_HOLE)
+		while (lblock > 0 && node->blocks[lblock - 1] == MYFS_HOLE)
+			lblock--;
+	return lblock;
+}
+
+// Funcao interna que retorna o bloco seguinte ao ultimo bloco alocado antes
+// do bloco logico lblock de um i-node ou, se nao houver, o inicio da area de
+// dados do grupo do i-node, onde comecar a busca por blocos novos
+unsigned int __myFSNodeGoal(MyFSNode *node, unsigned int lblock)
+{
+	MyFSInfo *fs = node->fs;
+	while (lblock > 0)
+	{
+		unsigned int addr = __myFSNodeBlockAddr(node, --lblock);
+		if (addr && addr != MYFS_HOLE && !(addr & MYFS_TAIL))
+			return addr / fs->sectorsPerBlock + 1;
+	}
+	return __myFSGroupDataGoal(fs, __myFSInodeGroup(fs, node->number));
+}
+
+// Funcao interna que retorna o endereco do primeiro bloco alocado de um
+// i-node, sem contar um fragmento final, ou 0 se nao houver
+unsigned int __myFSNodeFirstAddr(MyFSNode *node)
+{
+	unsigned int n = __myFSNodeAllocated(node);
+	for (unsigned int b = 0; b < n; b++)
+		if (node->blocks[b] != MYFS_HOLE && !(node->blocks[b] & MYFS_TAIL))
+			return node->blocks[b];
+	return 0;
+}
+
+// Funcao interna que acrescenta um buraco de count blocos ao fim dos blocos
+// de um i-node, estendendo o buraco final, se houver. O i-node principal
+// pode nao ser salvo. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSNodeAppendHole(MyFSNode *node, unsigned int count)
+{
+	unsigned int n = __myFSNodeAllocated(node), v;
+	int ret;
+	if (!node->blocks)
+		return -1;
+	if (n > 0 && node->blocks[n - 1] == MYFS_HOLE)
+	{
+		unsigned int start = __myFSNodeRunStart(node, n - 1);
+		v = MYFS_HOLE | (n - start + count);
+		ret = inodeSetBlockAddrs(&node->inode,
+								 __myFSMapEncode(node->blocks, 0, start, NULL), 1,
+								 &v);
+	}
+	else
+		ret = inodeAddBlock(&node->inode, MYFS_HOLE | count);
+	if (ret < 0)
+		return -1;
+	for (; count > 0; count--)
+		__myFSNodeMapAppend(node, MYFS_HOLE);
+	return 0;
+}
+
+// Funcao interna que substitui, nos enderecos de um i-node, os count blocos
+// de buraco a partir de lblock, todos de um mesmo buraco, pelos blocos
+// alocados contiguos a partir do endereco addr. O buraco e' dividido e os
+// enderecos seguintes do i-node sao regravados. Retorna 0 se bem sucedido ou
+// -1, caso contrario
+int __myFSNodeFillHole(MyFSNode *node, unsigned int lblock, unsigned int count,
+					   unsigned int addr)
+{
+	unsigned int n = node->numMapped, start = __myFSNodeRunStart(node, lblock);
+	unsigned int slot = __myFSMapEncode(node->blocks, 0, start, NULL);
+	unsigned int old = __myFSMapEncode(node->blocks, start, n, NULL), now;
+	unsigned int *slots;
+	int ret;
+	for (unsigned int k = 0; k < count; k++)
+		node->blocks[lblock + k] = addr + k * node->fs->sectorsPerBlock;
+	now = __myFSMapEncode(node->blocks, start, n, NULL);
+	slots = malloc(now * sizeof(unsigned int));
+	if (!slots)
+		ret = -1;
+	else
+	{
+		__myFSMapEncode(node->blocks, start, n, slots);
+		// Os enderecos acrescentados sao gravados antes, para que os
+		// existentes so' mudem se houver espaco para os que eles deslocam
+		ret = (now > old ? inodeAddBlocks(&node->inode, &slots[old], now - old)
+						 : 0);
+		if (ret == 0)
+			ret = inodeSetBlockAddrs(&node->inode, slot, old, slots);
+		free(slots);
+	}
+	if (ret < 0)
+	{
+		// O vetor sera' lido novamente quando necessario
+		free(node->blocks);
+		node->blocks = NULL;
+	}
+	return ret;
+}
+
+// Funcao interna que retorna 1 se os blocos de um arquivo sao gravados
+// comprimidos ou 0, caso contrario
+int __myFSNodeZipped(MyFSNode *node)
+{
+	return (inodeGetPermission(&node->inode) & MYFS_PERM_COMPRESS ? 1 : 0);
+}
+
+// Funcao interna que retorna o primeiro setor do fragmento de endereco addr
+// (com MYFS_TAIL) de um arquivo e escreve em *n seu numero de setores: o do
+// endereco, em arquivos comprimidos, ou o do fragmento final, nos demais
+unsigned int __myFSNodeFrag(MyFSNode *node, unsigned int addr, unsigned int *n)
+{
+	if (__myFSNodeZipped(node))
+	{
+		*n = ((addr & ~MYFS_TAIL) >> MYFS_ZIP_SHIFT) + 1;
+		return addr & ((1u << MYFS_ZIP_SHIFT) - 1);
+	}
+	*n = __myFSTailSectors(node->fs, inodeGetFileSize(&node->inode));
+	return addr & ~MYFS_TAIL;
+}
+
+// Funcao interna que retorna o endereco, com MYFS_TAIL, do fragmento de n
+// setores a partir do setor s de um arquivo
+unsigned int __myFSNodeFragAddr(MyFSNode *node, unsigned int s, unsigned int n)
+{
+	return MYFS_TAIL | (__myFSNodeZipped(node) ? (n - 1) << MYFS_ZIP_SHIFT : 0) | s;
+}
+
+// Funcao interna que le para buf, com espaco para um bloco, o conteudo do
+// bloco de um arquivo guardado no fragmento de endereco addr, descomprimido
+// se preciso e completado com zeros. Retorna 0 se bem sucedido ou -1, caso
+// contrario
+int __myFSNodeReadFrag(MyFSNode *node, unsigned int addr, unsigned char *buf)
+{
+	MyFSInfo *fs = node->fs;
+	unsigned int n, s = __myFSNodeFrag(node, addr, &n);
+	unsigned char *z;
+	int ret;
+	memset(buf, 0, fs->blockSize);
+	if (!__myFSNodeZipped(node))
+		return __myFSReadSectors(fs->d, s, n, buf);
+	if (!(z = malloc(n * DISK_SECTORDATASIZE)))
+		return -1;
+	ret = (__myFSReadSectors(fs->d, s, n, z) < 0 ? -1 : __myFSUnzip(fs, z, n, buf));
+	free(z);
+	return ret;
+}
+
+// Funcao interna que libera o bloco ou fragmento de endereco addr de um
+// arquivo. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSNodeFreeAddr(MyFSNode *node, unsigned int addr)
+{
+	unsigned int n, s;
+	if (!(addr & MYFS_TAIL))
+		return __myFSFreeBlocks(node->fs, addr / node->fs->sectorsPerBlock, 1);
+	s = __myFSNodeFrag(node, addr, &n);
+	return __myFSFragFree(node->fs, s, n);
+}
+
+// Funcao interna que libera os fragmentos entre os count primeiros enderecos
+// slots, no formato gravado no i-node, de um arquivo
+void __myFSNodeFreeFrags(MyFSNode *node, const unsigned int *slots,
+						 unsigned int count)
+{
+	for (unsigned int j = 0; j < count; j++)
+		if (!(slots[j] & MYFS_HOLE) && (slots[j] & MYFS_TAIL))
+			__myFSNodeFreeAddr(node, slots[j]);
+}
+
+// Funcao interna que libera, no mapa de bits, todos os blocos de um i-node,
+// sem altera-lo, e tambem seus fragmentos, se tails. Blocos contiguos
+// sao liberados de uma so' vez. Retorna 0 se bem sucedido ou -1, caso
+// contrario
+int __myFSNodeFreeBlocks(MyFSNode *node, int tails)
+{
+	MyFSInfo *fs = node->fs;
+	unsigned int n = __myFSNodeAllocated(node), runStart = 0, runLen = 0;
+	int ret = 0;
+	for (unsigned int b = 0; b <= n; b++)
+	{
+		unsigned int addr = (b < n ? __myFSNodeBlockAddr(node, b) : 0);
+		unsigned int blk;
+		if (addr & MYFS_TAIL)
+		{
+			if (tails && __myFSNodeFreeAddr(node, addr) < 0)
+				ret = -1;
+			addr = 0;
+		}
+		if (addr == MYFS_HOLE)
+			addr = 0;
+		blk = addr / fs->sectorsPerBlock;
+		if (addr && runLen && blk == runStart + runLen)
+		{
+			runLen++;
+			continue;
+		}
+		if (runLen && __myFSFreeBlocks(fs, runStart, runLen) < 0)
+			ret = -1;
+		runStart = blk;
+		runLen = (addr ? 1 : 0);
+	}
+	return ret;
+}
+
+// Funcao interna que libera os blocos, as extensoes e o proprio i-node de um
+// arquivo ou diretorio sem referencias. Retorna 0 se bem sucedido ou -1,
+// caso contrario
+int __myFSReleaseFile(MyFSNode *node)
+{
+	MyFSInfo *fs = node->fs;
+	int isDir = __myFSNodeIsDir(node);
+	int ret = __myFSNodeFreeBlocks(node, 1);
+	fs->usedBytes -= inodeGetFileSize(&node->inode);
+	if (isDir)
+		__myFSDcachePurgeDir(fs, node->number);
+	if (inodeClear(&node->inode) < 0 ||
+		__myFSFreeInode(fs, node->number, isDir) < 0)
+		ret = -1;
+	return ret;
+}
+
+// Funcao interna que poe na lista de orfaos um arquivo ou diretorio sem
+// referencias, cujo espaco sera' liberado depois. Retorna 0 se bem sucedido
+// ou -1, caso contrario
+int __myFSOrphanAdd(MyFSNode *node)
+{
+	MyFSInfo *fs = node->fs;
+	inodeSetPermission(&node->inode,
+					   inodeGetPermission(&node->inode) | MYFS_PERM_ORPHAN);
+	inodeSetOwner(&node->inode, fs->orphanHead);
+	if (inodeSave(&node->inode) < 0)
+		return -1;
+	fs->orphanHead = node->number;
+	return __myFSWriteSuperblock(fs);
+}
+
+// Funcao interna que da' um passo na liberacao do primeiro orfao da lista:
+// libera a primeira extensao de sua cadeia, com os blocos que ela aponta,
+// ou, se nao houver mais extensoes, o restante do arquivo, que sai da
+// lista. A extensao sai da cadeia antes de seus blocos serem liberados, de
+// modo que uma queda no meio do passo nunca libera um bloco duas vezes.
+// Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSOrphanStep(MyFSInfo *fs)
+{
+	MyFSNode node;
+	Inode ext;
+	unsigned int runStart = 0, runLen = 0;
+	int ret = 0;
+	// O orfao nao esta' em memoria nem pode voltar a estar: uma copia local
+	// basta para as funcoes que liberam seus enderecos
+	memset(&node, 0, sizeof(node));
+	node.fs = fs;
+	node.number = fs->orphanHead;
+	if (inodeLoadInto(&node.inode, node.number, fs->d) < 0)
+		return -1;
+	if (!(inodeGetPermission(&node.inode) & MYFS_PERM_ORPHAN))
+	{
+		// Lista corrompida: o que restar fica para a verificacao
+		fs->orphanHead = 0;
+		__myFSWriteSuperblock(fs);
+		return -1;
+	}
+	if (inodeGetNextNumber(&node.inode) == 0)
+	{
+		fs->orphanHead = inodeGetOwner(&node.inode);
+		ret = __myFSReleaseFile(&node);
+		free(node.blocks);
+		if (__myFSWriteSuperblock(fs) < 0)
+			ret = -1;
+		return ret;
+	}
+	if (inodeLoadInto(&ext, inodeGetNextNumber(&node.inode), fs->d) < 0)
+		return -1;
+	inodeSetNextNumber(&node.inode, inodeGetNextNumber(&ext));
+	if (inodeSave(&node.inode) < 0)
+		return -1;
+	// Blocos contiguos sao liberados de uma so' vez
+	for (unsigned int a = 0; a <= NUMITEMS_PERINODE; a++)
+	{
+		unsigned int addr = (a < NUMITEMS_PERINODE ? inodeGetItem(&ext, a) : 0);
+		unsigned int blk;
+		if (addr & MYFS_HOLE)
+			addr = 0;
+		else if (addr & MYFS_TAIL)
+		{
+			if (__myFSNodeFreeAddr(&node, addr) < 0)
+				ret = -1;
+			addr = 0;
+		}
+		blk = addr / fs->sectorsPerBlock;
+		if (addr && runLen && blk == runStart + runLen)
+		{
+			runLen++;
+			continue;
+		}
+		if (runLen && __myFSFreeBlocks(fs, runStart, runLen) < 0)
+			ret = -1;
+		runStart = blk;
+		runLen = (addr ? 1 : 0);
+	}
+	inodeSetNextNumber(&ext, 0);
+	if (inodeClear(&ext) < 0 ||
+		__myFSFreeInode(fs, inodeGetNumber(&ext), 0) < 0)
+		ret = -1;
+	return ret;
+}
+
+// Funcao interna que libera orfaos da lista, em ate' steps passos (0: ate'
+// esvazia-la). Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSOrphanReclaim(MyFSInfo *fs, unsigned int steps)
+{
+	for (unsigned int a = 0; fs->orphanHead && (steps == 0 || a < steps); a++)
+		if (__myFSOrphanStep(fs) < 0)
+			return -1;
+	return 0;
+}
+
+// Funcao interna que libera de vez todos os orfaos, quando falta espaco.
+// Retorna 1 se havia orfaos e todos foram liberados ou 0, caso contrario
+int __myFSOrphanDrain(MyFSInfo *fs)
+{
+	return fs->orphanHead && __myFSOrphanReclaim(fs, 0) == 0;
+}
+
+// Funcao interna que retorna o i-node em memoria de numero number,
+// lendo-o do disco se ainda nao estiver em uso. Cada chamada deve ser
+// pareada com __myFSNodePut. Retorna NULL se o i-node nao estiver alocado,
+// for um orfao ou em caso de falha
+MyFSNode *__myFSNodeGet(MyFSInfo *fs, unsigned int number)
+{
+	MyFSNode *node;
+	if (number < 1 || number > fs->numInodes ||
+		__myFSGroupLoad(fs, __myFSInodeGroup(fs, number)) < 0 ||
+		!__myFSBitmapTest(&fs->inodeMap, number - 1))
+		return NULL;
+	for (node = fs->nodes[number % MYFS_NODE_HASH]; node; node = node->next)
+		if (node->number == number)
+		{
+			node->refs++;
+			return node;
+		}
+	node = calloc(1, sizeof(MyFSNode));
+	if (!node)
+		return NULL;
+	// I-nodes de extensao tambem estao no mapa de bits, mas nao tem tipo
+	if (inodeLoadInto(&node->inode, number, fs->d) < 0 ||
+		(inodeGetFileType(&node->inode) != FILETYPE_REGULAR &&
+		 inodeGetFileType(&node->inode) != FILETYPE_DIR) ||
+		(inodeGetPermission(&node->inode) & MYFS_PERM_ORPHAN))
+	{
+		free(node);
+		return NULL;
+	}
+	node->fs = fs;
+	node->number = number;
+	node->refs = 1;
+	node->next = fs->nodes[number % MYFS_NODE_HASH];
+	fs->nodes[number % MYFS_NODE_HASH] = node;
+	return node;
+}
+
+// Funcao interna que cria, em disco e em memoria, o i-node number (ja'
+// alocado no mapa de bits), vazio e do tipo type. Retorna o i-node em
+// memoria, a ser liberado com __myFSNodePut, ou NULL em caso de falha
+MyFSNode *__myFSNodeCreate(MyFSInfo *fs, unsigned int number,
+						   unsigned int type)
+{
+	MyFSNode *node = calloc(1, sizeof(MyFSNode));
+	if (!node)
+		return NULL;
+	if (inodeCreateInto(&node->inode, number, fs->d) < 0)
+	{
+		free(node);
+		return NULL;
+	}
+	inodeSetFileType(&node->inode, type);
+	node->fs = fs;
+	node->number = number;
+	node->refs = 1;
+	node->next = fs->nodes[number % MYFS_NODE_HASH];
+	fs->nodes[number % MYFS_NODE_HASH] = node;
+	return node;
+}
+
+int __myFSNodeFlush(MyFSNode *node, int all);
+void __myFSNodeDropWb(MyFSNode *node);
+
+// Funcao interna que devolve uma referencia a um i-node em memoria. Quando
+// nao ha mais referencias, o i-node sai da memoria e, se nao houver mais
+// entradas de diretorio apontando para ele, vai para a lista de orfaos (ou,
+// se nao puder, tem seu espaco liberado de imediato)
+void __myFSNodePut(MyFSNode *node)
+{
+	MyFSNode **p;
+	if (!node || --node->refs > 0)
+		return;
+	if (inodeGetRefCount(&node->inode) > 0)
+		__myFSNodeFlush(node, 1);
+	__myFSNodeDropWb(node);
+	if (inodeGetRefCount(&node->inode) == 0 && __myFSOrphanAdd(node) < 0)
+		__myFSReleaseFile(node);
+	for (p = &node->fs->nodes[node->number % MYFS_NODE_HASH]; *p;
+		 p = &(*p)->next)
+		if (*p == node)
+		{
+			*p = node->next;
+			break;
+		}
+	free(node->dirHeader);
+	free(node->blocks);
+	free(node);
+}
+
+// Funcao interna que acrescenta um bloco ao fim de um arquivo ou diretorio,
+// contiguo ao ultimo bloco sempre que possivel ou, para o primeiro bloco, no
+// grupo do i-node. O tamanho do arquivo passa a ser newSize e o i-node e'
+// salvo. O endereco do bloco e' escrito em *addr. Retorna 0 se bem sucedido
+// ou -1, caso contrario
+int __myFSNodeAppendBlock(MyFSNode *node, unsigned int newSize,
+						  unsigned int *addr)
+{
+	MyFSInfo *fs = node->fs;
+	unsigned int blk, oldSize = inodeGetFileSize(&node->inode);
+	// Blocos reservados para dados pendentes de outros arquivos nao podem
+	// ser usados
+	if (fs->freeBlocks <= fs->reservedBlocks)
+		return -1;
+	if (__myFSAllocBlocks(fs, __myFSNodeGoal(node, __myFSNodeNumBlocks(node)), 1,
+						  1, &blk) != 1)
+		return -1;
+	*addr = blk * fs->sectorsPerBlock;
+	// inodeAddBlock sempre salva o i-node principal, ja' com o novo tamanho
+	__myFSNodeSetSize(node, newSize);
+	if (inodeAddBlock(&node->inode, *addr) < 0)
+	{
+		__myFSNodeSetSize(node, oldSize);
+		__myFSFreeBlocks(fs, blk, 1);
+		return -1;
+	}
+	__myFSNodeMapAppend(node, *addr);
+	return 0;
+}
+
+// Funcao interna que retorna o tamanho de um arquivo, incluindo os dados
+// ainda pendentes de gravacao
+unsigned int __myFSNodeSize(MyFSNode *node)
+{
+	unsigned int size = inodeGetFileSize(&node->inode);
+	if (node->wbBuf && node->wbFirst * node->fs->blockSize + node->wbLen > size)
+		size = node->wbFirst * node->fs->blockSize + node->wbLen;
+	return size;
+}
+
+// Funcao interna que descarta os dados pendentes de um arquivo e libera os
+// blocos reservados para eles
+void __myFSNodeDropWb(MyFSNode *node)
+{
+	node->fs->dirtyBytes -= node->wbLen;
+	node->fs->reservedBlocks -= node->wbReserved;
+	free(node->wbBuf);
+	node->wbBuf = NULL;
+	node->wbLen = node->wbCap = node->wbReserved = 0;
+}
+
+// Funcao interna que retorna 1 se o primeiro bloco dos dados pendentes de um
+// arquivo estiver em um fragmento ou for compartilhado, precisando de um
+// bloco novo quando os dados forem gravados, ou 0, caso contrario
+unsigned int __myFSNodeWbTail(MyFSNode *node)
+{
+	unsigned int addr;
+	if (node->wbLen == 0)
+		return 0;
+	addr = __myFSNodeBlockAddr(node, node->wbFirst);
+	return ((addr & MYFS_TAIL) ||
+					__myFSBlockShared(node->fs, addr / node->fs->sectorsPerBlock)
+				? 1
+				: 0);
+}
+
+// Funcao interna que recalcula os blocos livres reservados para os dados
+// pendentes de um arquivo: os que eles ocupam alem dos blocos ja' alocados
+void __myFSNodeReserve(MyFSNode *node)
+{
+	unsigned int bs = node->fs->blockSize;
+	unsigned int need = node->wbFirst + (node->wbLen + bs - 1) / bs;
+	unsigned int have = __myFSNodeAllocated(node);
+	node->fs->reservedBlocks -= node->wbReserved;
+	node->wbReserved = (need > have ? need - have : 0) + __myFSNodeWbTail(node);
+	node->fs->reservedBlocks += node->wbReserved;
+}
+
+// Funcao interna que passa a manter em memoria o fim de um arquivo, a partir
+// de seu ultimo bloco incompleto (cujo conteudo e' lido do disco) ou do fim
+// do ultimo bloco. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSNodeStartWb(MyFSNode *node)
+{
+	MyFSInfo *fs = node->fs;
+	unsigned int size = inodeGetFileSize(&node->inode), addr;
+	node->wbCap = fs->blockSize;
+	node->wbBuf = calloc(1, node->wbCap);
+	if (!node->wbBuf)
+		return -1;
+	node->wbFirst = size / fs->blockSize;
+	node->wbLen = size % fs->blockSize;
+	node->wbReserved = 0;
+	addr = (node->wbLen ? __myFSNodeBlockAddr(node, node->wbFirst) : MYFS_HOLE);
+	if (addr != MYFS_HOLE &&
+		((addr & MYFS_TAIL) ? __myFSNodeReadFrag(node, addr, node->wbBuf)
+							: __myFSReadSectors(fs->d, addr,
+												(node->wbLen + DISK_SECTORDATASIZE - 1) /
+													DISK_SECTORDATASIZE,
+												node->wbBuf)) < 0)
+	{
+		free(node->wbBuf);
+		node->wbBuf = NULL;
+		node->wbLen = 0;
+		return -1;
+	}
+	fs->dirtyBytes += node->wbLen;
+	return 0;
+}
+
+// Funcao interna que copia len bytes de buf para a posicao pos (relativa ao
+// inicio de wbBuf) dos dados pendentes de um arquivo. Os blocos novos sao
+// apenas reservados, limitados aos blocos livres do disco. Retorna o numero
+// de bytes copiados ou -1 em caso de falha
+int __myFSNodeBufferWrite(MyFSNode *node, unsigned int pos, const char *buf,
+						  unsigned int len)
+{
+	MyFSInfo *fs = node->fs;
+	unsigned int bs = fs->blockSize, end = pos + len, need;
+	unsigned int have = __myFSNodeAllocated(node) - node->wbFirst;
+	unsigned int avail = fs->freeBlocks - fs->reservedBlocks + node->wbReserved;
+	unsigned int tail = __myFSNodeWbTail(node);
+	if (end > node->wbLen)
+	{
+		need = (end + bs - 1) / bs;
+		need = (need > have ? need - have : 0) + tail;
+		if (need > avail && __myFSOrphanDrain(fs))
+			avail = fs->freeBlocks - fs->reservedBlocks + node->wbReserved;
+		if (need > avail)
+		{
+			// Disco cheio: apenas o que couber nos blocos livres
+			end = (have + avail - tail) * bs;
+			if (end <= pos)
+				return -1;
+			len = end - pos;
+			need = avail;
+		}
+		if (end > node->wbCap)
+		{
+			unsigned int cap = node->wbCap;
+			unsigned char *b;
+			while (cap < end)
+				cap *= 2;
+			b = realloc(node->wbBuf, cap);
+			if (!b)
+				return -1;
+			memset(&b[node->wbCap], 0, cap - node->wbCap);
+			node->wbBuf = b;
+			node->wbCap = cap;
+		}
+		fs->reservedBlocks += need - node->wbReserved;
+		node->wbReserved = need;
+		fs->dirtyBytes += end - node->wbLen;
+		node->wbLen = end;
+	}
+	memcpy(&node->wbBuf[pos], buf, len);
+	return (int)len;
+}
+
+// Funcao interna que descarta os enderecos de blocos guardados nos
+// descritores abertos para um i-node, depois que um bloco dele muda de lugar
+void __myFSNodeForgetAddrs(MyFSNode *node)
+{
+	for (int a = 0; a < myFSFdsUsed; a++)
+		if (myFSFds[a].node == node)
+			myFSFds[a].curAddr = 0;
+}
+
+// Funcao interna que descarta os nblk primeiros blocos dos dados pendentes
+// de um arquivo, ja' gravados, ou todos os dados pendentes, se all
+void __myFSNodeWbDone(MyFSNode *node, unsigned int nblk, int all)
+{
+	unsigned int bs = node->fs->blockSize;
+	if (all)
+		__myFSNodeDropWb(node);
+	else
+	{
+		memmove(node->wbBuf, &node->wbBuf[nblk * bs], node->wbLen - nblk * bs);
+		memset(&node->wbBuf[node->wbLen - nblk * bs], 0, nblk * bs);
+		node->wbFirst += nblk;
+		node->wbLen -= nblk * bs;
+		node->fs->dirtyBytes -= nblk * bs;
+		__myFSNodeReserve(node);
+	}
+}
+
+// Funcao interna que grava em disco os dados pendentes de um arquivo
+// comprimido ou com deduplicacao, como __myFSNodeFlush, mas um bloco de cada
+// vez: um bloco completo igual a um bloco ja' gravado passa a compartilha-lo
+// (deduplicacao); os demais sao comprimidos para um fragmento novo
+// (compressao) ou vao para seu proprio bloco, se ja' houver um nao
+// compartilhado, ou para um bloco novo. Os blocos e fragmentos substituidos
+// sao liberados depois que o i-node aponta para os novos. Retorna 0 se bem
+// sucedido ou -1, caso contrario
+int __myFSNodeFlushEach(MyFSNode *node, int all)
+{
+	MyFSInfo *fs = node->fs;
+	unsigned int bs = fs->blockSize, spb = fs->sectorsPerBlock;
+	unsigned int perm = inodeGetPermission(&node->inode);
+	unsigned int nblk, have, k, size, *addrs, *olds;
+	unsigned int goal = __myFSGroupDataGoal(fs, __myFSInodeGroup(fs, node->number));
+	unsigned int oldSize = inodeGetFileSize(&node->inode);
+	unsigned char *z;
+	int ret = 0;
+	nblk = (all ? (node->wbLen + bs - 1) / bs : node->wbLen / bs);
+	if (nblk == 0)
+	{
+		if (all)
+			__myFSNodeDropWb(node);
+		return 0;
+	}
+	addrs = malloc(2 * nblk * sizeof(unsigned int));
+	z = malloc(bs);
+	if (!addrs || !z)
+	{
+		free(addrs);
+		free(z);
+		return -1;
+	}
+	olds = &addrs[nblk];
+	have = __myFSNodeAllocated(node) - node->wbFirst;
+	if (have > nblk)
+		have = nblk;
+	fs->reservedBlocks -= node->wbReserved;
+	node->wbReserved = 0;
+	// Leituras antecipadas de outros descritores podem ter os blocos antigos
+	node->gen++;
+	for (k = 0; k < nblk && ret == 0; k++)
+	{
+		unsigned char *data = &node->wbBuf[k * bs];
+		unsigned int len = (all && k == nblk - 1 ? node->wbLen - k * bs : bs);
+		unsigned int n = 0, s = 0, fp = 0, dup = 0, blk;
+		olds[k] = (k < have ? __myFSNodeBlockAddr(node, node->wbFirst + k) : 0);
+		if ((perm & MYFS_PERM_DEDUP) && fs->dedupFps && len == bs)
+		{
+			fp = __myFSDedupHash(fs, data);
+			dup = __myFSDedupFind(fs, data, fp, z);
+		}
+		if (dup && dup * spb == olds[k])
+		{
+			// O bloco ja' tem este conteudo
+			addrs[k] = olds[k];
+			continue;
+		}
+		// Com o maximo de referencias, o bloco vai para uma copia propria
+		if (dup && __myFSAddRefs(fs, dup, 1, 1) == 0)
+		{
+			addrs[k] = dup * spb;
+			continue;
+		}
+		if ((perm & MYFS_PERM_COMPRESS) && (n = __myFSZip(fs, data, len, z)) > 0 &&
+			(s = __myFSFragAlloc(fs, n, goal)) != 0)
+		{
+			// Os proximos fragmentos sao procurados no mesmo grupo, que pode
+			// nao ser o do i-node se este estiver cheio
+			goal = s / spb;
+			addrs[k] = __myFSNodeFragAddr(node, s, n);
+			ret = __myFSWriteSectors(fs->d, s, n, z);
+		}
+		else if (olds[k] && !(olds[k] & MYFS_TAIL) &&
+				 !__myFSBlockShared(fs, olds[k] / spb))
+		{
+			addrs[k] = olds[k];
+			ret = __myFSWriteSectors(fs->d, olds[k], spb, data);
+		}
+		else if (__myFSAllocBlocks(fs, __myFSNodeGoal(node, node->wbFirst + k), 1,
+								   1, &blk) == 1)
+		{
+			addrs[k] = blk * spb;
+			ret = __myFSWriteSectors(fs->d, addrs[k], spb, data);
+		}
+		else
+			break;
+		// Um bloco gravado inteiro passa a poder ser compartilhado
+		if (ret == 0 && fs->dedupFps && !(addrs[k] & MYFS_TAIL))
+			ret = __myFSDedupSet(fs, addrs[k] / spb, fp);
+	}
+	free(z);
+	size = (all ? node->wbFirst * bs + node->wbLen : (node->wbFirst + nblk) * bs);
+	if (ret == 0 && k == nblk)
+	{
+		__myFSNodeSetSize(node, size);
+		if (have > 0)
+		{
+			ret = inodeSetBlockAddrs(&node->inode,
+									 __myFSMapEncode(node->blocks, 0,
+													 node->wbFirst, NULL),
+									 have, addrs);
+			memcpy(&node->blocks[node->wbFirst], addrs, have * sizeof(unsigned int));
+		}
+		if (ret == 0 && have < nblk)
+		{
+			ret = inodeAddBlocks(&node->inode, &addrs[have], nblk - have);
+			for (k = have; k < nblk; k++)
+				__myFSNodeMapAppend(node, addrs[k]);
+		}
+		else if (ret == 0)
+			ret = inodeSave(&node->inode);
+	}
+	else
+	{
+		// Os blocos e fragmentos novos sao liberados; os antigos continuam
+		for (unsigned int j = 0; j < k; j++)
+			if (addrs[j] != olds[j])
+				__myFSNodeFreeAddr(node, addrs[j]);
+		ret = -1;
+	}
+	if (ret == 0)
+	{
+		// O i-node ja' tem o tamanho novo: um fragmento final substituido
+		// tem os setores do tamanho anterior
+		for (k = 0; k < have; k++)
+			if (addrs[k] == olds[k])
+				continue;
+			else if ((olds[k] & MYFS_TAIL) && !__myFSNodeZipped(node))
+				__myFSFragFree(fs, olds[k] & ~MYFS_TAIL,
+							   __myFSTailSectors(fs, oldSize));
+			else
+				__myFSNodeFreeAddr(node, olds[k]);
+		__myFSNodeForgetAddrs(node);
+	}
+	free(addrs);
+	if (ret < 0)
+	{
+		__myFSNodeReserve(node);
+		return -1;
+	}
+	__myFSNodeWbDone(node, nblk, all);
+	return 0;
+}
+
+// Funcao interna que grava em disco os dados pendentes de um arquivo: todos,
+// se all, ou apenas os blocos completos. Os blocos novos sao alocados de uma
+// so' vez, contiguos ao fim do arquivo sempre que possivel, e cada trecho
+// fisicamente contiguo e' gravado em uma unica transferencia. Um ultimo
+// bloco incompleto pequeno vai para um fragmento. Retorna 0 se bem sucedido
+// ou -1, caso contrario
+int __myFSNodeFlush(MyFSNode *node, int all)
+{
+	MyFSInfo *fs = node->fs;
+	unsigned int bs = fs->blockSize, spb = fs->sectorsPerBlock;
+	unsigned int nblk, have, k, goal, *addrs, size, end, old = 0, frag = 0;
+	unsigned int oldSize = inodeGetFileSize(&node->inode);
+	int ret = 0;
+	if (!node->wbBuf)
+		return 0;
+	if (inodeGetPermission(&node->inode) & (MYFS_PERM_COMPRESS | MYFS_PERM_DEDUP))
+		return __myFSNodeFlushEach(node, all);
+	nblk = (all ? (node->wbLen + bs - 1) / bs : node->wbLen / bs);
+	if (nblk == 0)
+	{
+		if (all)
+			__myFSNodeDropWb(node);
+		return 0;
+	}
+	addrs = malloc(nblk * sizeof(unsigned int));
+	if (!addrs)
+		return -1;
+	// Blocos ja' alocados (o ultimo incompleto e os reservados) sao usados
+	// como estao
+	have = __myFSNodeAllocated(node) - node->wbFirst;
+	for (k = 0; k < have && k < nblk; k++)
+		addrs[k] = __myFSNodeBlockAddr(node, node->wbFirst + k);
+	// Um fragmento ja' gravado ou um bloco compartilhado so' pode ser o
+	// primeiro bloco pendente: ele e' substituido por um bloco ou fragmento
+	// novo e liberado depois
+	if (have > 0 &&
+		((addrs[0] & MYFS_TAIL) || __myFSBlockShared(fs, addrs[0] / spb)))
+		old = addrs[0];
+	goal = __myFSNodeGoal(node, node->wbFirst + have);
+	if (have > nblk)
+		have = nblk;
+	// A reserva dos blocos deste arquivo e' convertida em alocacao
+	fs->reservedBlocks -= node->wbReserved;
+	node->wbReserved = 0;
+	// O ultimo bloco, se incompleto e sem bloco reservado para ele, vai para
+	// um fragmento perto do i-node, junto aos fins dos arquivos vizinhos. Um
+	// bloco compartilhado so' vira fragmento se nao houver blocos reservados
+	// depois dele, pois so' o ultimo bloco do mapa pode ser um fragmento
+	if (all &&
+		(nblk > have ||
+		 (nblk == 1 && old &&
+		  ((old & MYFS_TAIL) || __myFSNodeAllocated(node) <= node->wbFirst + 1))) &&
+		(frag = __myFSFragSectors(fs, node->wbLen - (nblk - 1) * bs)) > 0)
+	{
+		unsigned int s = __myFSFragAlloc(
+			fs, frag, __myFSGroupDataGoal(fs, __myFSInodeGroup(fs, node->number)));
+		if (s)
+			addrs[nblk - 1] = MYFS_TAIL | s;
+		else
+			frag = 0;
+	}
+	end = (frag && nblk > have ? nblk - 1 : nblk);
+	if (old && !(frag && nblk == 1))
+	{
+		unsigned int first;
+		if (__myFSAllocBlocks(fs, __myFSNodeGoal(node, node->wbFirst), 1, 1,
+							  &first) != 1)
+			ret = -1;
+		else
+			addrs[0] = first * spb;
+	}
+	while (ret == 0 && k < end)
+	{
+		unsigned int first, got = __myFSAllocBlocks(fs, goal, end - k, 1, &first);
+		if (got == 0)
+			break;
+		for (unsigned int j = 0; j < got; j++)
+			addrs[k + j] = (first + j) * spb;
+		k += got;
+		goal = first + got;
+	}
+	if (ret < 0 || k < end)
+	{
+		for (unsigned int j = (have < nblk ? have : nblk); j < k; j++)
+			__myFSFreeBlocks(fs, addrs[j] / spb, 1);
+		if (old && addrs[0] != old && !(addrs[0] & MYFS_TAIL))
+			__myFSFreeBlocks(fs, addrs[0] / spb, 1);
+		if (frag)
+			__myFSFragFree(fs, addrs[nblk - 1] & ~MYFS_TAIL, frag);
+		free(addrs);
+		return -1;
+	}
+	// Leituras antecipadas de outros descritores podem ter os blocos antigos
+	node->gen++;
+	for (k = 0; k < nblk && ret == 0;)
+	{
+		unsigned int run = 1;
+		if (addrs[k] & MYFS_TAIL)
+		{
+			ret = __myFSWriteSectors(fs->d, addrs[k] & ~MYFS_TAIL, frag,
+									  &node->wbBuf[k * bs]);
+			k++;
+			continue;
+		}
+		while (k + run < nblk && addrs[k + run] == addrs[k] + run * spb)
+			run++;
+		ret = __myFSWriteSectors(fs->d, addrs[k], run * spb, &node->wbBuf[k * bs]);
+		k += run;
+	}
+	size = (all ? node->wbFirst * bs + node->wbLen : (node->wbFirst + nblk) * bs);
+	if (ret == 0)
+	{
+		__myFSNodeSetSize(node, size);
+		if (old)
+		{
+			ret = inodeSetBlockAddrs(&node->inode,
+									 __myFSMapEncode(node->blocks, 0,
+													 node->wbFirst, NULL),
+									 1, addrs);
+			node->blocks[node->wbFirst] = addrs[0];
+		}
+		if (ret == 0 && have < nblk)
+		{
+			ret = inodeAddBlocks(&node->inode, &addrs[have], nblk - have);
+			for (k = have; k < nblk; k++)
+				__myFSNodeMapAppend(node, addrs[k]);
+		}
+		else if (ret == 0)
+			ret = inodeSave(&node->inode);
+	}
+	free(addrs);
+	if (ret < 0)
+		return -1;
+	if (old & MYFS_TAIL)
+		__myFSFragFree(fs, old & ~MYFS_TAIL, __myFSTailSectors(fs, oldSize));
+	else if (old)
+	{
+		__myFSNodeForgetAddrs(node);
+		__myFSFreeBlocks(fs, old / spb, 1);
+	}
+	__myFSNodeWbDone(node, nblk, all);
+	return 0;
+}
+
+// Funcao interna que move o fragmento final de um arquivo sem dados
+// pendentes, se houver, para um bloco proprio, antes que o arquivo passe a
+// ter blocos depois dele. Em arquivos comprimidos, os fragmentos podem ficar
+// em qualquer bloco e nada e' feito. Retorna 0 se bem sucedido ou -1, caso
+// contrario
+int __myFSNodeUnpackTail(MyFSNode *node)
+{
+	MyFSInfo *fs = node->fs;
+	unsigned int spb = fs->sectorsPerBlock, t = __myFSNodeNumBlocks(node);
+	unsigned int size = inodeGetFileSize(&node->inode), tail, blk, v;
+	unsigned char *buf;
+	if (__myFSNodeZipped(node) || t == 0 || t > __myFSNodeAllocated(node) ||
+		!(node->blocks[t - 1] & MYFS_TAIL))
+		return 0;
+	tail = node->blocks[--t];
+	if (fs->freeBlocks <= fs->reservedBlocks || !(buf = calloc(1, fs->blockSize)))
+		return -1;
+	if (__myFSAllocBlocks(fs, __myFSNodeGoal(node, t), 1, 1, &blk) != 1)
+	{
+		free(buf);
+		return -1;
+	}
+	v = blk * spb;
+	if (__myFSReadSectors(fs->d, tail & ~MYFS_TAIL, __myFSTailSectors(fs, size),
+						  buf) < 0 ||
+		__myFSWriteSectors(fs->d, v, spb, buf) < 0 ||
+		inodeSetBlockAddrs(&node->inode, __myFSMapEncode(node->blocks, 0, t, NULL),
+						   1, &v) < 0)
+	{
+		free(buf);
+		__myFSFreeBlocks(fs, blk, 1);
+		return -1;
+	}
+	free(buf);
+	node->blocks[t] = v;
+	node->gen++;
+	return __myFSFragFree(fs, tail & ~MYFS_TAIL, __myFSTailSectors(fs, size));
+}
+
+// Funcao interna que soma delta (1 ou -1) aos contadores de referencias dos
+// blocos alocados entre os n primeiros blocos logicos de um i-node, um
+// trecho contiguo de cada vez. Em caso de falha, os contadores ja' alterados
+// sao restaurados. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSNodeAddRefs(MyFSNode *node, unsigned int n, int delta)
+{
+	unsigned int spb = node->fs->sectorsPerBlock;
+	for (unsigned int b = 0, e; b < n; b = e)
+	{
+		unsigned int addr = node->blocks[b];
+		e = b + 1;
+		if (addr == MYFS_HOLE || (addr & MYFS_TAIL))
+			continue;
+		while (e < n && node->blocks[e] == node->blocks[e - 1] + spb)
+			e++;
+		if (__myFSAddRefs(node->fs, addr / spb, e - b, delta) < 0)
+		{
+			__myFSNodeAddRefs(node, b, -delta);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// Funcao interna que substitui o bloco logico lblock de um arquivo, se for
+// compartilhado com outros arquivos ou, em um arquivo comprimido, estiver
+// comprimido em um fragmento, por uma copia propria e sem compressao, antes
+// de uma escrita nele. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSNodeUnshare(MyFSNode *node, unsigned int lblock)
+{
+	MyFSInfo *fs = node->fs;
+	unsigned int spb = fs->sectorsPerBlock, addr, blk, v;
+	unsigned char *buf;
+	addr = __myFSNodeBlockAddr(node, lblock);
+	if (!addr || addr == MYFS_HOLE ||
+		((addr & MYFS_TAIL) ? !__myFSNodeZipped(node)
+							: !__myFSBlockShared(fs, addr / spb)))
+		return (addr ? 0 : -1);
+	if (fs->freeBlocks <= fs->reservedBlocks || !(buf = malloc(fs->blockSize)))
+		return -1;
+	if (__myFSAllocBlocks(fs, __myFSNodeGoal(node, lblock), 1, 1, &blk) != 1)
+	{
+		free(buf);
+		return -1;
+	}
+	v = blk * spb;
+	if (((addr & MYFS_TAIL) ? __myFSNodeReadFrag(node, addr, buf)
+							: __myFSReadSectors(fs->d, addr, spb, buf)) < 0 ||
+		__myFSWriteSectors(fs->d, v, spb, buf) < 0 ||
+		inodeSetBlockAddrs(&node->inode,
+						   __myFSMapEncode(node->blocks, 0, lblock, NULL), 1,
+						   &v) < 0)
+	{
+		free(buf);
+		__myFSFreeBlocks(fs, blk, 1);
+		return -1;
+	}
+	free(buf);
+	node->blocks[lblock] = v;
+	node->gen++;
+	__myFSNodeForgetAddrs(node);
+	return __myFSNodeFreeAddr(node, addr);
+}
+
+// Funcao interna que estende um arquivo sem dados pendentes ate' o inicio do
+// bloco logico lblock, alem de seu ultimo bloco. Blocos reservados no caminho
+// sao zerados em disco e os demais formam um buraco, sem alocacao. Retorna 0
+// se bem sucedido ou -1, caso contrario
+int __myFSNodeExtend(MyFSNode *node, unsigned int lblock)
+{
+	MyFSInfo *fs = node->fs;
+	unsigned int bs = fs->blockSize, spb = fs->sectorsPerBlock, b, have;
+	unsigned int chunk = MYFS_FILL_BYTES / bs, size = inodeGetFileSize(&node->inode);
+	unsigned char *zero = NULL;
+	int ret = 0;
+	// Um fragmento so' pode ser o ultimo bloco do arquivo
+	if (__myFSNodeUnpackTail(node) < 0)
+		return -1;
+	b = __myFSNodeNumBlocks(node);
+	have = __myFSNodeAllocated(node);
+	if (!node->blocks)
+		return -1;
+	if (chunk == 0)
+		chunk = 1;
+	// O conteudo anterior de blocos reservados nao pode ficar visivel
+	if (b < have && b < lblock && !(zero = calloc(chunk, bs)))
+		return -1;
+	while (ret == 0 && b < have && b < lblock)
+	{
+		unsigned int addr = node->blocks[b], run = 1;
+		if (addr == MYFS_HOLE)
+		{
+			b++;
+			continue;
+		}
+		while (b + run < have && b + run < lblock && run < chunk &&
+			   node->blocks[b + run] == addr + run * spb)
+			run++;
+		ret = __myFSWriteSectors(fs->d, addr, run * spb, zero);
+		b += run;
+	}
+	free(zero);
+	if (ret < 0)
+		return -1;
+	__myFSNodeSetSize(node, lblock * bs);
+	if ((have < lblock && __myFSNodeAppendHole(node, lblock - have) < 0) ||
+		inodeSave(&node->inode) < 0)
+	{
+		__myFSNodeSetSize(node, size);
+		return -1;
+	}
+	return 0;
+}
+
+// Funcao interna que grava len bytes de buf na posicao pos de um arquivo,
+// dentro de um buraco, alocando os blocos do buraco cobertos pelos dados
+// (antes do bloco logico limit) contiguos ao bloco alocado anterior sempre
+// que possivel. Os blocos sao gravados inteiros, com zeros onde nao ha
+// dados, em uma unica transferencia. Retorna o numero de bytes gravados ou
+// -1 em caso de falha
+int __myFSNodeWriteHole(MyFSNode *node, unsigned int pos, const char *buf,
+						unsigned int len, unsigned int limit)
+{
+	MyFSInfo *fs = node->fs;
+	unsigned int bs = fs->blockSize, spb = fs->sectorsPerBlock;
+	unsigned int lblock = pos / bs, off = pos % bs, max = MYFS_FILL_BYTES / bs;
+	unsigned int count = (off + len + bs - 1) / bs, n, first, got;
+	unsigned char *data;
+	if (fs->freeBlocks <= fs->reservedBlocks)
+		return -1;
+	if (max == 0)
+		max = 1;
+	if (count > max)
+		count = max;
+	if (count > limit - lblock)
+		count = limit - lblock;
+	if (count > fs->freeBlocks - fs->reservedBlocks)
+		count = fs->freeBlocks - fs->reservedBlocks;
+	for (n = 1; n < count && node->blocks[lblock + n] == MYFS_HOLE; n++)
+		;
+	got = __myFSAllocBlocks(fs, __myFSNodeGoal(node, lblock), n, 1, &first);
+	if (got == 0)
+		return -1;
+	if (len > got * bs - off)
+		len = got * bs - off;
+	data = calloc(got, bs);
+	if (!data)
+	{
+		__myFSFreeBlocks(fs, first, got);
+		return -1;
+	}
+	memcpy(&data[off], buf, len);
+	if (__myFSWriteSectors(fs->d, (unsigned long)first * spb, got * spb, data) < 0 ||
+		__myFSNodeFillHole(node, lblock, got, first * spb) < 0)
+	{
+		free(data);
+		__myFSFreeBlocks(fs, first, got);
+		return -1;
+	}
+	free(data);
+	return (int)len;
+}
+
+// Funcao interna que le o bloco logico lblock de um i-node para buf.
+// Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSNodeReadBlock(MyFSNode *node, unsigned int lblock, unsigned char *buf)
+{
+	unsigned int addr = __myFSNodeBlockAddr(node, lblock);
+	if (!addr)
+		return -1;
+	return __myFSReadBlock(node->fs, addr, buf);
+}
+
+// Funcao interna que grava buf no bloco logico lblock de um i-node.
+// Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSNodeWriteBlock(MyFSNode *node, unsigned int lblock,
+						 unsigned char *buf)
+{
+	unsigned int addr = __myFSNodeBlockAddr(node, lblock);
+	if (!addr)
+		return -1;
+	return __myFSWriteBlock(node->fs, addr, buf);
+}
+
+// Funcao interna de comparacao de pares de unsigned ints pelo segundo
+// elemento, para ordena-los com qsort
+int __myFSPairCompare(const void *a, const void *b)
+{
+	unsigned int ba = ((const unsigned int *)a)[1];
+	unsigned int bb = ((const unsigned int *)b)[1];
+	return (ba > bb) - (ba < bb);
+}
+
+// Funcao interna que le um unsigned int na posicao pos de buf
+unsigned int __myFSGetUInt(unsigned char *buf, unsigned int pos)
+{
+	unsigned int v;
+	char2ul(&buf[pos], &v);
+	return v;
+}
+
+// Funcao interna que escreve v na posicao pos de buf
+void __myFSPutUInt(unsigned char *buf, unsigned int pos, unsigned int v)
+{
+	ul2char(v, &buf[pos]);
+}
+
+// Funcao interna que retorna quantas entradas da tabela cabem no cabecalho
+// de um diretorio (maior potencia de 2 que cabe no bloco)
+unsigned int __myFSDirInlineSlots(MyFSInfo *fs)
+{
+	unsigned int n = 1;
+	while (n * 2 <= (fs->blockSize - MYFS_DIR_HDR_SIZE - MYFS_DIR_HDR_TAIL) /
+						sizeof(unsigned int))
+		n *= 2;
+	return n;
+}
+
+// Funcao interna que retorna quantas entradas da tabela cabem em um bloco de
+// indice de diretorio
+unsigned int __myFSDirSlotsPerIndex(MyFSInfo *fs)
+{
+	return (fs->blockSize - MYFS_DIR_IDX_SIZE) / sizeof(unsigned int);
+}
+
+// Funcao interna que retorna a profundidade global maxima de um diretorio,
+// limitada pelo numero de blocos de indice enderecaveis pelo cabecalho
+unsigned int __myFSDirMaxDepth(MyFSInfo *fs)
+{
+	unsigned long maxSlots = (unsigned long)__myFSDirSlotsPerIndex(fs) *
+							 ((fs->blockSize - MYFS_DIR_HDR_SIZE - MYFS_DIR_HDR_TAIL) /
+							  sizeof(unsigned int));
+	unsigned int depth = 0;
+	while ((2UL << depth) <= maxSlots && depth < 24)
+		depth++;
+	return depth;
+}
+
+// Funcao interna que garante o cabecalho de um diretorio em memoria.
+// Retorna o cabecalho ou NULL em caso de falha
+unsigned char *__myFSDirHeader(MyFSNode *dir)
+{
+	if (dir->dirHeader)
+		return dir->dirHeader;
+	dir->dirHeader = malloc(dir->fs->blockSize);
+	if (!dir->dirHeader)
+		return NULL;
+	if (__myFSNodeReadBlock(dir, 0, dir->dirHeader) < 0 ||
+		__myFSGetUInt(dir->dirHeader, 0) != MYFS_DIR_HDR_MAGIC)
+	{
+		free(dir->dirHeader);
+		dir->dirHeader = NULL;
+	}
+	return dir->dirHeader;
+}
+
+// Funcao interna que retorna o bloco logico da folha apontada pela entrada
+// idx da tabela de um diretorio, ou 0 em caso de falha. O bloco de indice
+// lido, se houver, usa buf como area de trabalho
+unsigned int __myFSDirGetSlot(MyFSNode *dir, unsigned int idx,
+							  unsigned char *buf)
+{
+	unsigned char *hdr = __myFSDirHeader(dir);
+	unsigned int per = __myFSDirSlotsPerIndex(dir->fs);
+	unsigned int ib;
+	if (!hdr)
+		return 0;
+	if (__myFSGetUInt(hdr, 8) == 0)
+		return __myFSGetUInt(hdr, MYFS_DIR_HDR_SIZE + idx * sizeof(unsigned int));
+	ib = __myFSGetUInt(hdr, MYFS_DIR_HDR_SIZE + (idx / per) * sizeof(unsigned int));
+	if (__myFSNodeReadBlock(dir, ib, buf) < 0)
+		return 0;
+	return __myFSGetUInt(buf, MYFS_DIR_IDX_SIZE +
+								  (idx % per) * sizeof(unsigned int));
+}
+
+// Funcao interna que faz apontar para value as entradas first, first+stride,
+// first+2*stride, ... da tabela de um diretorio, gravando cada bloco de
+// indice (ou o cabecalho) alterado uma unica vez. Retorna 0 se bem sucedido
+// ou -1, caso contrario
+int __myFSDirSetSlots(MyFSNode *dir, unsigned int first, unsigned int stride,
+					  unsigned int value, unsigned char *buf)
+{
+	unsigned char *hdr = __myFSDirHeader(dir);
+	unsigned int per = __myFSDirSlotsPerIndex(dir->fs);
+	unsigned int numSlots, loaded = 0, ib = 0;
+	if (!hdr)
+		return -1;
+	numSlots = 1U << __myFSGetUInt(hdr, 4);
+	if (__myFSGetUInt(hdr, 8) == 0)
+	{
+		for (unsigned int s = first; s < numSlots; s += stride)
+			__myFSPutUInt(hdr, MYFS_DIR_HDR_SIZE + s * sizeof(unsigned int),
+						  value);
+		return __myFSNodeWriteBlock(dir, 0, hdr);
+	}
+	for (unsigned int s = first; s < numSlots; s += stride)
+	{
+		unsigned int b = __myFSGetUInt(hdr, MYFS_DIR_HDR_SIZE +
+												(s / per) * sizeof(unsigned int));
+		if (!loaded || b != ib)
+		{
+			if (loaded && __myFSNodeWriteBlock(dir, ib, buf) < 0)
+				return -1;
+			if (__myFSNodeReadBlock(dir, b, buf) < 0)
+				return -1;
+			ib = b;
+			loaded = 1;
+		}
+		__myFSPutUInt(buf, MYFS_DIR_IDX_SIZE + (s % per) * sizeof(unsigned int),
+					  value);
+	}
+	return (loaded ? __myFSNodeWriteBlock(dir, ib, buf) : 0);
+}
+
+// Funcao interna que acrescenta um bloco logico a um diretorio. O numero do
+// bloco logico e' escrito em *lblock. Retorna 0 se bem sucedido ou -1, caso
+// contrario
+int __myFSDirAppendBlock(MyFSNode *dir, unsigned int *lblock)
+{
+	unsigned int addr, n = __myFSNodeNumBlocks(dir);
+	if (__myFSNodeAppendBlock(dir, (n + 1) * dir->fs->blockSize, &addr) < 0)
+		return -1;
+	*lblock = n;
+	return 0;
+}
+
+// Funcao interna que retorna a posicao, no cabecalho de um diretorio, do
+// numero do primeiro bloco da lista de blocos livres (0: lista vazia)
+unsigned int __myFSDirFreePos(MyFSInfo *fs)
+{
+	return fs->blockSize - MYFS_DIR_HDR_TAIL;
+}
+
+// Funcao interna que obtem um bloco para uma nova folha ou bloco de
+// transbordo de um diretorio: o primeiro da lista de blocos livres, se
+// houver, ou um bloco novo no fim do diretorio. O numero do bloco logico e'
+// escrito em *lblock. buf e' usado como area de trabalho. Retorna 0 se bem
+// sucedido ou -1, caso contrario
+int __myFSDirNewBlock(MyFSNode *dir, unsigned int *lblock, unsigned char *buf)
+{
+	unsigned char *hdr = __myFSDirHeader(dir);
+	unsigned int lb;
+	if (!hdr)
+		return -1;
+	lb = __myFSGetUInt(hdr, __myFSDirFreePos(dir->fs));
+	if (!lb)
+		return __myFSDirAppendBlock(dir, lblock);
+	if (__myFSNodeReadBlock(dir, lb, buf) < 0 ||
+		__myFSGetUInt(buf, 0) != MYFS_DIR_FREE_MAGIC)
+		return -1;
+	__myFSPutUInt(hdr, __myFSDirFreePos(dir->fs), __myFSGetUInt(buf, 4));
+	if (__myFSNodeWriteBlock(dir, 0, hdr) < 0)
+		return -1;
+	*lblock = lb;
+	return 0;
+}
+
+// Funcao interna que libera o bloco lb de um diretorio, que nao e' mais
+// referenciado, colocando-o na lista de blocos livres do diretorio. O bloco
+// continua no i-node (o mapa de blocos nao admite lacunas) e e' reaproveitado
+// pela proxima divisao. buf e' usado como area de trabalho. Retorna 0 se bem
+// sucedido ou -1, caso contrario
+int __myFSDirFreeBlock(MyFSNode *dir, unsigned int lb, unsigned char *buf)
+{
+	MyFSInfo *fs = dir->fs;
+	unsigned char *hdr = __myFSDirHeader(dir);
+	if (!hdr || !__myFSNodeBlockAddr(dir, lb))
+		return -1;
+	memset(buf, 0, fs->blockSize);
+	__myFSPutUInt(buf, 0, MYFS_DIR_FREE_MAGIC);
+	__myFSPutUInt(buf, 4, __myFSGetUInt(hdr, __myFSDirFreePos(fs)));
+	if (__myFSNodeWriteBlock(dir, lb, buf) < 0)
+		return -1;
+	__myFSPutUInt(hdr, __myFSDirFreePos(fs), lb);
+	return __myFSNodeWriteBlock(dir, 0, hdr);
+}
+
+// Funcao interna que dobra a tabela de um diretorio, incrementando sua
+// profundidade global. Entradas passam do cabecalho para blocos de indice
+// quando nao couberem mais nele. Retorna 0 se bem sucedido ou -1, caso
+// contrario (inclusive na profundidade maxima)
+int __myFSDirDouble(MyFSNode *dir)
+{
+	MyFSInfo *fs = dir->fs;
+	unsigned char *hdr = __myFSDirHeader(dir), *buf;
+	unsigned int depth, numSlots, *slots, per = __myFSDirSlotsPerIndex(fs);
+	unsigned int numIdx, needIdx;
+	int ret = 0;
+	if (!hdr)
+		return -1;
+	depth = __myFSGetUInt(hdr, 4);
+	numIdx = __myFSGetUInt(hdr, 8);
+	if (depth + 1 > __myFSDirMaxDepth(fs))
+		return -1;
+	numSlots = 1U << depth;
+	slots = malloc(2 * numSlots * sizeof(unsigned int));
+	buf = malloc(fs->blockSize);
+	if (!slots || !buf)
+	{
+		free(slots);
+		free(buf);
+		return -1;
+	}
+	// Tabela inteira em memoria, com a segunda metade igual 'a primeira
+	for (unsigned int s = 0; s < numSlots && ret == 0; s++)
+	{
+		if (numIdx && s % per == 0)
+			ret = __myFSNodeReadBlock(
+				dir, __myFSGetUInt(hdr, MYFS_DIR_HDR_SIZE + s / per * sizeof(unsigned int)),
+				buf);
+		slots[s] = (numIdx ? __myFSGetUInt(buf, MYFS_DIR_IDX_SIZE +
+													s % per * sizeof(unsigned int))
+						   : __myFSGetUInt(hdr, MYFS_DIR_HDR_SIZE +
+													s * sizeof(unsigned int)));
+		slots[s + numSlots] = slots[s];
+	}
+	numSlots *= 2;
+	if (ret == 0 && numIdx == 0 && numSlots <= __myFSDirInlineSlots(fs))
+	{
+		for (unsigned int s = 0; s < numSlots; s++)
+			__myFSPutUInt(hdr, MYFS_DIR_HDR_SIZE + s * sizeof(unsigned int),
+						  slots[s]);
+	}
+	else if (ret == 0)
+	{
+		// Blocos de indice: os existentes sao reaproveitados e os que faltam
+		// sao acrescentados ao diretorio
+		needIdx = (numSlots + per - 1) / per;
+		if (numIdx == 0)
+			memset(&hdr[MYFS_DIR_HDR_SIZE], 0,
+				   fs->blockSize - MYFS_DIR_HDR_SIZE - MYFS_DIR_HDR_TAIL);
+		for (unsigned int k = numIdx; k < needIdx && ret == 0; k++)
+		{
+			unsigned int lb;
+			ret = __myFSDirAppendBlock(dir, &lb);
+			if (ret == 0)
+				__myFSPutUInt(hdr, MYFS_DIR_HDR_SIZE + k * sizeof(unsigned int),
+							  lb);
+		}
+		for (unsigned int k = 0; k < needIdx && ret == 0; k++)
+		{
+			memset(buf, 0, fs->blockSize);
+			__myFSPutUInt(buf, 0, MYFS_DIR_IDX_MAGIC);
+			for (unsigned int s = k * per; s < numSlots && s < (k + 1) * per; s++)
+				__myFSPutUInt(buf, MYFS_DIR_IDX_SIZE +
+									   (s % per) * sizeof(unsigned int),
+							  slots[s]);
+			ret = __myFSNodeWriteBlock(
+				dir, __myFSGetUInt(hdr, MYFS_DIR_HDR_SIZE + k * sizeof(unsigned int)),
+				buf);
+		}
+		if (ret == 0)
+			__myFSPutUInt(hdr, 8, needIdx);
+	}
+	if (ret == 0)
+	{
+		__myFSPutUInt(hdr, 4, depth + 1);
+		ret = __myFSNodeWriteBlock(dir, 0, hdr);
+	}
+	if (ret < 0)
+	{
+		// Cabecalho em memoria pode estar inconsistente: sera' relido
+		free(dir->dirHeader);
+		dir->dirHeader = NULL;
+	}
+	free(slots);
+	free(buf);
+	return ret;
+}
+
+// Funcao interna que inicializa buf como uma folha vazia de profundidade
+// local depth
+void __myFSDirInitLeaf(MyFSInfo *fs, unsigned char *buf, unsigned int depth)
+{
+	memset(buf, 0, fs->blockSize);
+	__myFSPutUInt(buf, 0, MYFS_DIR_LEAF_MAGIC);
+	__myFSPutUInt(buf, MYFS_DIR_LEAF_DEPTH, depth);
+	__myFSPutUInt(buf, MYFS_DIR_LEAF_USED, MYFS_DIR_LEAF_SIZE);
+}
+
+// Funcao interna que acrescenta a entrada (name, inumber) ao fim da folha
+// em buf. Retorna 0 se bem sucedido ou -1 se nao houver espaco
+int __myFSDirLeafAppend(MyFSInfo *fs, unsigned char *buf, const char *name,
+						unsigned int inumber)
+{
+	unsigned int len = strlen(name);
+	unsigned int used = __myFSGetUInt(buf, MYFS_DIR_LEAF_USED);
+	if (used + MYFS_DIR_ENTRY_SIZE + len > fs->blockSize)
+		return -1;
+	__myFSPutUInt(buf, used, inumber);
+	buf[used + sizeof(unsigned int)] = len;
+	memcpy(&buf[used + MYFS_DIR_ENTRY_SIZE], name, len);
+	__myFSPutUInt(buf, MYFS_DIR_LEAF_USED, used + MYFS_DIR_ENTRY_SIZE + len);
+	__myFSPutUInt(buf, MYFS_DIR_LEAF_COUNT,
+				  __myFSGetUInt(buf, MYFS_DIR_LEAF_COUNT) + 1);
+	return 0;
+}
+
+// Funcao interna que procura name na folha em buf. Retorna a posicao da
+// entrada na folha ou 0 se nao encontrada
+unsigned int __myFSDirLeafFind(unsigned char *buf, const char *name)
+{
+	unsigned int len = strlen(name);
+	unsigned int used = __myFSGetUInt(buf, MYFS_DIR_LEAF_USED);
+	for (unsigned int pos = MYFS_DIR_LEAF_SIZE; pos < used;
+		 pos += MYFS_DIR_ENTRY_SIZE + buf[pos + sizeof(unsigned int)])
+		if (buf[pos + sizeof(unsigned int)] == len &&
+			memcmp(&buf[pos + MYFS_DIR_ENTRY_SIZE], name, len) == 0)
+			return pos;
+	return 0;
+}
+
+// Funcao interna que cria o diretorio vazio de i-node number (ja' alocado),
+// com as entradas "." e ".." (esta apontando para parent). Retorna o i-node
+// em memoria, a ser liberado com __myFSNodePut, ou NULL em caso de falha
+MyFSNode *__myFSDirCreate(MyFSInfo *fs, unsigned int number,
+						  unsigned int parent)
+{
+	MyFSNode *dir = __myFSNodeCreate(fs, number, FILETYPE_DIR);
+	unsigned char *buf = malloc(fs->blockSize);
+	unsigned int hdrBlock, leafBlock;
+	int ret = -1;
+	if (!dir)
+		__myFSFreeInode(fs, number, 1);
+	else if (buf)
+	{
+		inodeSetRefCount(&dir->inode, 1);
+		if (__myFSDirAppendBlock(dir, &hdrBlock) == 0 &&
+			__myFSDirAppendBlock(dir, &leafBlock) == 0)
+		{
+			__myFSDirInitLeaf(fs, buf, 0);
+			__myFSDirLeafAppend(fs, buf, ".", number);
+			__myFSDirLeafAppend(fs, buf, "..", parent);
+			ret = __myFSNodeWriteBlock(dir, leafBlock, buf);
+			memset(buf, 0, fs->blockSize);
+			__myFSPutUInt(buf, 0, MYFS_DIR_HDR_MAGIC);
+			__myFSPutUInt(buf, MYFS_DIR_HDR_SIZE, leafBlock);
+			if (ret == 0)
+				ret = __myFSNodeWriteBlock(dir, hdrBlock, buf);
+		}
+	}
+	free(buf);
+	if (ret < 0 && dir)
+	{
+		inodeSetRefCount(&dir->inode, 0);
+		__myFSNodePut(dir);
+		dir = NULL;
+	}
+	return dir;
+}
+
+// Funcao interna que procura name em um diretorio, escrevendo o numero do
+// i-node da entrada em *inumber. Consulta primeiro o cache de nomes; se
+// preciso, le o bloco de indice (se houver) e a folha correspondentes ao
+// hash do nome e registra o resultado no cache. Retorna 0 se encontrada ou
+// -1, caso contrario
+int __myFSDirLookup(MyFSNode *dir, const char *name, unsigned int *inumber)
+{
+	unsigned char *hdr, *buf;
+	unsigned int lb, cached;
+	int ret = -1;
+	if (__myFSDcacheLookup(dir->fs, dir->number, name, &cached) == 0)
+	{
+		*inumber = cached;
+		return (cached ? 0 : -1);
+	}
+	hdr = __myFSDirHeader(dir);
+	if (!hdr || !(buf = malloc(dir->fs->blockSize)))
+		return -1;
+	lb = __myFSDirGetSlot(dir, __myFSDirHash(name) &
+								   ((1U << __myFSGetUInt(hdr, 4)) - 1),
+						  buf);
+	while (lb && __myFSNodeReadBlock(dir, lb, buf) == 0)
+	{
+		unsigned int pos = __myFSDirLeafFind(buf, name);
+		if (pos)
+		{
+			*inumber = __myFSGetUInt(buf, pos);
+			ret = 0;
+			break;
+		}
+		lb = __myFSGetUInt(buf, MYFS_DIR_LEAF_NEXT);
+	}
+	// Falhas de leitura nao sao registradas como nomes inexistentes
+	if (ret == 0 || lb == 0)
+		__myFSDcacheSet(dir->fs, dir->number, name, (ret == 0 ? *inumber : 0));
+	free(buf);
+	return ret;
+}
+
+// Funcao interna que divide a folha lb (cujo conteudo esta' em buf), de
+// profundidade local menor que a global, em duas folhas pelo proximo bit do
+// hash. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSDirSplit(MyFSNode *dir, unsigned int lb, unsigned char *buf)
+{
+	MyFSInfo *fs = dir->fs;
+	unsigned int depth = __myFSGetUInt(buf, MYFS_DIR_LEAF_DEPTH);
+	unsigned int used = __myFSGetUInt(buf, MYFS_DIR_LEAF_USED);
+	unsigned char *low = malloc(fs->blockSize), *high = malloc(fs->blockSize);
+	unsigned int nb, prefix = 0, first = 1;
+	char name[MAX_FILENAME_LENGTH + 1];
+	int ret = -1;
+	if (low && high && __myFSDirNewBlock(dir, &nb, high) == 0)
+	{
+		__myFSDirInitLeaf(fs, low, depth + 1);
+		__myFSDirInitLeaf(fs, high, depth + 1);
+		for (unsigned int pos = MYFS_DIR_LEAF_SIZE; pos < used;
+			 pos += MYFS_DIR_ENTRY_SIZE + buf[pos + sizeof(unsigned int)])
+		{
+			unsigned int len = buf[pos + sizeof(unsigned int)], h;
+			memcpy(name, &buf[pos + MYFS_DIR_ENTRY_SIZE], len);
+			name[len] = '\0';
+			h = __myFSDirHash(name);
+			if (first)
+			{
+				prefix = h & ((1U << depth) - 1);
+				first = 0;
+			}
+			__myFSDirLeafAppend(fs, (h >> depth) & 1 ? high : low, name,
+								__myFSGetUInt(buf, pos));
+		}
+		if (first)
+		{
+			// Folha vazia: nada a dividir
+			free(low);
+			free(high);
+			return -1;
+		}
+		// Nova folha gravada antes de a tabela apontar para ela
+		ret = __myFSNodeWriteBlock(dir, nb, high);
+		if (ret == 0)
+			ret = __myFSNodeWriteBlock(dir, lb, low);
+		if (ret == 0)
+			ret = __myFSDirSetSlots(dir, prefix | (1U << depth),
+									1U << (depth + 1), nb, buf);
+		if (ret == 0)
+			memcpy(buf, low, fs->blockSize);
+	}
+	free(low);
+	free(high);
+	return ret;
+}
+
+// Funcao interna que acrescenta a entrada (name, inumber) a um diretorio.
+// Normalmente le e grava apenas a folha do hash do nome (e seu bloco de
+// indice, se houver); folhas cheias sao divididas e, na profundidade
+// maxima, estendidas por blocos de transbordo. Retorna 0 se bem sucedido ou
+// -1, caso contrario (inclusive se o nome ja' existir)
+int __myFSDirAdd(MyFSNode *dir, const char *name, unsigned int inumber)
+{
+	MyFSInfo *fs = dir->fs;
+	unsigned char *hdr, *buf;
+	unsigned int h = __myFSDirHash(name), existing;
+	int ret = -1;
+	if (__myFSDirLookup(dir, name, &existing) == 0)
+		return -1;
+	if (!(hdr = __myFSDirHeader(dir)) || !(buf = malloc(fs->blockSize)))
+		return -1;
+	for (int tries = 0; tries <= 32; tries++)
+	{
+		unsigned int gd = __myFSGetUInt(hdr, 4);
+		unsigned int lb = __myFSDirGetSlot(dir, h & ((1U << gd) - 1), buf);
+		unsigned int cur = lb, depth;
+		if (!lb || __myFSNodeReadBlock(dir, lb, buf) < 0)
+			break;
+		depth = __myFSGetUInt(buf, MYFS_DIR_LEAF_DEPTH);
+		// Primeiro bloco da cadeia da folha com espaco para a entrada
+		while (__myFSDirLeafAppend(fs, buf, name, inumber) < 0)
+		{
+			unsigned int next = __myFSGetUInt(buf, MYFS_DIR_LEAF_NEXT);
+			if (!next)
+				break;
+			cur = next;
+			if (__myFSNodeReadBlock(dir, cur, buf) < 0)
+			{
+				cur = 0;
+				break;
+			}
+		}
+		if (!cur)
+			break;
+		if (__myFSDirLeafFind(buf, name))
+		{
+			ret = __myFSNodeWriteBlock(dir, cur, buf);
+			if (ret == 0)
+				__myFSDcacheSet(fs, dir->number, name, inumber);
+			break;
+		}
+		// Cadeia cheia: dividir a folha ou, na profundidade maxima, transbordar
+		if (cur == lb && depth < __myFSDirMaxDepth(fs) &&
+			(depth < gd || __myFSDirDouble(dir) == 0))
+		{
+			if (__myFSDirSplit(dir, lb, buf) < 0)
+				break;
+			continue;
+		}
+		{
+			unsigned int nb;
+			unsigned char *nbuf = malloc(fs->blockSize);
+			if (nbuf && __myFSDirNewBlock(dir, &nb, nbuf) == 0)
+			{
+				__myFSDirInitLeaf(fs, nbuf, depth);
+				__myFSDirLeafAppend(fs, nbuf, name, inumber);
+				ret = __myFSNodeWriteBlock(dir, nb, nbuf);
+				__myFSPutUInt(buf, MYFS_DIR_LEAF_NEXT, nb);
+				if (ret == 0)
+					ret = __myFSNodeWriteBlock(dir, cur, buf);
+				if (ret == 0)
+					__myFSDcacheSet(fs, dir->number, name, inumber);
+			}
+			free(nbuf);
+		}
+		break;
+	}
+	free(buf);
+	return ret;
+}
+
+// Funcao interna que junta a folha lb de um diretorio, cujo conteudo esta'
+// em buf e cujos nomes tem o hash h nos bits da profundidade local, 'a sua
+// irma (a que difere no ultimo desses bits), se nenhuma das duas tiver
+// blocos de transbordo e se juntas couberem em meia folha. A irma recebe as
+// entradas e fica com profundidade uma unidade menor, e o bloco de lb e'
+// liberado; a juncao se repete enquanto possivel. other e' usado como area
+// de trabalho. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSDirMerge(MyFSNode *dir, unsigned int lb, unsigned int h,
+				   unsigned char *buf, unsigned char *other)
+{
+	MyFSInfo *fs = dir->fs;
+	unsigned int room = (fs->blockSize - MYFS_DIR_LEAF_SIZE) / 2;
+	char name[MAX_FILENAME_LENGTH + 1];
+	for (;;)
+	{
+		unsigned int depth = __myFSGetUInt(buf, MYFS_DIR_LEAF_DEPTH);
+		unsigned int used = __myFSGetUInt(buf, MYFS_DIR_LEAF_USED);
+		unsigned int prefix, sib;
+		if (depth == 0 || __myFSGetUInt(buf, MYFS_DIR_LEAF_NEXT) != 0)
+			return 0;
+		prefix = h & ((1U << depth) - 1);
+		sib = __myFSDirGetSlot(dir, prefix ^ (1U << (depth - 1)), other);
+		if (!sib || sib == lb || __myFSNodeReadBlock(dir, sib, other) < 0)
+			return -1;
+		if (__myFSGetUInt(other, MYFS_DIR_LEAF_DEPTH) != depth ||
+			__myFSGetUInt(other, MYFS_DIR_LEAF_NEXT) != 0 ||
+			used + __myFSGetUInt(other, MYFS_DIR_LEAF_USED) -
+					2 * MYFS_DIR_LEAF_SIZE >
+				room)
+			return 0;
+		for (unsigned int pos = MYFS_DIR_LEAF_SIZE; pos < used;
+			 pos += MYFS_DIR_ENTRY_SIZE + buf[pos + sizeof(unsigned int)])
+		{
+			unsigned int len = buf[pos + sizeof(unsigned int)];
+			memcpy(name, &buf[pos + MYFS_DIR_ENTRY_SIZE], len);
+			name[len] = '\0';
+			__myFSDirLeafAppend(fs, other, name, __myFSGetUInt(buf, pos));
+		}
+		__myFSPutUInt(other, MYFS_DIR_LEAF_DEPTH, depth - 1);
+		// A irma e' gravada antes de a tabela deixar de apontar para lb
+		if (__myFSNodeWriteBlock(dir, sib, other) < 0 ||
+			__myFSDirSetSlots(dir, prefix, 1U << depth, sib, buf) < 0 ||
+			__myFSDirFreeBlock(dir, lb, buf) < 0)
+			return -1;
+		lb = sib;
+		memcpy(buf, other, fs->blockSize);
+	}
+}
+
+// Funcao interna que remove a entrada name de um diretorio, compactando a
+// folha onde estava. Um bloco de transbordo que fica vazio sai da cadeia e
+// e' liberado, e uma folha pouco ocupada e' juntada 'a sua irma, de modo que
+// o diretorio nao acumule blocos vazios. O numero do i-node da entrada e'
+// escrito em *inumber. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSDirRemove(MyFSNode *dir, const char *name, unsigned int *inumber)
+{
+	unsigned char *hdr = __myFSDirHeader(dir), *buf, *other;
+	unsigned int h = __myFSDirHash(name), head, lb, prev = 0;
+	int ret = -1;
+	if (!hdr || !(buf = malloc(dir->fs->blockSize)))
+		return -1;
+	if (!(other = malloc(dir->fs->blockSize)))
+	{
+		free(buf);
+		return -1;
+	}
+	head = lb = __myFSDirGetSlot(dir, h & ((1U << __myFSGetUInt(hdr, 4)) - 1),
+								 buf);
+	while (lb && __myFSNodeReadBlock(dir, lb, buf) == 0)
+	{
+		unsigned int pos = __myFSDirLeafFind(buf, name);
+		if (pos)
+		{
+			unsigned int used = __myFSGetUInt(buf, MYFS_DIR_LEAF_USED);
+			unsigned int size = MYFS_DIR_ENTRY_SIZE +
+								buf[pos + sizeof(unsigned int)];
+			unsigned int count = __myFSGetUInt(buf, MYFS_DIR_LEAF_COUNT) - 1;
+			*inumber = __myFSGetUInt(buf, pos);
+			memmove(&buf[pos], &buf[pos + size], used - pos - size);
+			memset(&buf[used - size], 0, size);
+			__myFSPutUInt(buf, MYFS_DIR_LEAF_USED, used - size);
+			__myFSPutUInt(buf, MYFS_DIR_LEAF_COUNT, count);
+			if (count == 0 && lb != head &&
+				__myFSNodeReadBlock(dir, prev, other) == 0)
+			{
+				__myFSPutUInt(other, MYFS_DIR_LEAF_NEXT,
+							  __myFSGetUInt(buf, MYFS_DIR_LEAF_NEXT));
+				ret = __myFSNodeWriteBlock(dir, prev, other);
+				// A entrada ja' saiu do diretorio; uma falha aqui apenas
+				// deixa o bloco sem uso
+				if (ret == 0)
+					__myFSDirFreeBlock(dir, lb, buf);
+			}
+			else
+			{
+				ret = __myFSNodeWriteBlock(dir, lb, buf);
+				if (ret == 0 && lb == head)
+					__myFSDirMerge(dir, lb, h, buf, other);
+			}
+			if (ret == 0)
+				__myFSDcacheSet(dir->fs, dir->number, name, 0);
+			break;
+		}
+		prev = lb;
+		lb = __myFSGetUInt(buf, MYFS_DIR_LEAF_NEXT);
+	}
+	free(buf);
+	free(other);
+	return ret;
+}
+
+// Funcao interna que le ate' max entradas de um diretorio para entries
+// (nome e numero do i-node) a partir do cursor (*lblock, *offset),
+// percorrendo as folhas na ordem dos blocos logicos, como uma lista simples
+// de entradas. Cada folha e' lida uma unica vez. Retorna o numero de
+// entradas lidas, 0 se fim do diretorio ou -1 em caso de falha
+int __myFSDirNextEntries(MyFSNode *dir, unsigned int *lblock,
+						 unsigned int *offset, FSDirEntry *entries,
+						 unsigned int max)
+{
+	unsigned char *buf = malloc(dir->fs->blockSize);
+	unsigned int n = __myFSNodeNumBlocks(dir), count = 0;
+	int ret = 0;
+	if (!buf)
+		return -1;
+	if (*lblock == 0)
+		*lblock = 1;
+	for (; *lblock < n && count < max; (*lblock)++, *offset = 0)
+	{
+		unsigned int used;
+		if (__myFSNodeReadBlock(dir, *lblock, buf) < 0)
+		{
+			ret = -1;
+			break;
+		}
+		if (__myFSGetUInt(buf, 0) != MYFS_DIR_LEAF_MAGIC)
+			continue;
+		used = __myFSGetUInt(buf, MYFS_DIR_LEAF_USED);
+		if (*offset < MYFS_DIR_LEAF_SIZE)
+			*offset = MYFS_DIR_LEAF_SIZE;
+		while (*offset < used && count < max)
+		{
+			unsigned int len = buf[*offset + sizeof(unsigned int)];
+			entries[count].inumber = __myFSGetUInt(buf, *offset);
+			memcpy(entries[count].name, &buf[*offset + MYFS_DIR_ENTRY_SIZE], len);
+			entries[count].name[len] = '\0';
+			*offset += MYFS_DIR_ENTRY_SIZE + len;
+			count++;
+		}
+		// Folha lida so' em parte: a proxima chamada continua nela
+		if (*offset < used)
+			break;
+	}
+	free(buf);
+	return (count > 0 ? (int)count : ret);
+}
+
+// Funcao interna que le a proxima entrada de um diretorio a partir do
+// cursor (*lblock, *offset). Retorna 1 se uma entrada foi lida, 0 se fim do
+// diretorio ou -1 em caso de falha
+int __myFSDirNext(MyFSNode *dir, unsigned int *lblock, unsigned int *offset,
+				  char *filename, unsigned int *inumber)
+{
+	FSDirEntry e;
+	int ret = __myFSDirNextEntries(dir, lblock, offset, &e, 1);
+	if (ret > 0)
+	{
+		strcpy(filename, e.name);
+		*inumber = e.inumber;
+	}
+	return ret;
+}
+
+// Funcao interna que copia para e os atributos do i-node i, com o tamanho
+// size
+void __myFSSetAttrs(FSDirEntry *e, Inode *i, unsigned int size)
+{
+	e->type = inodeGetFileType(i);
+	e->size = size;
+	e->owner = inodeGetOwner(i);
+	e->groupOwner = inodeGetGroupOwner(i);
+	e->permission = inodeGetPermission(i) &
+					~(MYFS_PERM_COMPRESS | MYFS_PERM_DEDUP | MYFS_PERM_ORPHAN);
+	e->refCount = inodeGetRefCount(i);
+}
+
+// Funcao interna que preenche os atributos das count entradas de entries a
+// partir de seus i-nodes. I-nodes em memoria sao usados como estao; os
+// demais sao lidos em ordem de setor, com uma unica leitura para cada
+// sequencia de setores proximos. Retorna 0 se bem sucedido ou -1, caso
+// contrario
+int __myFSDirFillAttrs(MyFSInfo *fs, FSDirEntry *entries, unsigned int count)
+{
+	unsigned int *pairs = malloc(2 * count * sizeof(unsigned int)), n = 0;
+	unsigned int maxSectors = MYFS_RA_MAX_BYTES / DISK_SECTORDATASIZE;
+	int ret = 0;
+	if (!pairs)
+		return -1;
+	// Pares (entrada, i-node) dos i-nodes que precisam ser lidos
+	for (unsigned int a = 0; a < count; a++)
+	{
+		MyFSNode *node;
+		unsigned int number = entries[a].inumber;
+		for (node = (number >= 1 && number <= fs->numInodes
+						 ? fs->nodes[number % MYFS_NODE_HASH]
+						 : NULL);
+			 node && node->number != number; node = node->next)
+			;
+		if (node)
+			__myFSSetAttrs(&entries[a], &node->inode, __myFSNodeSize(node));
+		else if (number >= 1 && number <= fs->numInodes)
+		{
+			pairs[2 * n] = a;
+			pairs[2 * n + 1] = number;
+			n++;
+		}
+		else
+			ret = -1;
+	}
+	// Na ordem dos i-nodes, os setores ficam em ordem crescente
+	qsort(pairs, n, 2 * sizeof(unsigned int), __myFSPairCompare);
+	for (unsigned int a = 0, b; a < n && ret == 0; a = b)
+	{
+		unsigned long first = __myFSInodeSector(fs, pairs[2 * a + 1]);
+		unsigned long last = first;
+		for (b = a + 1; b < n; b++)
+		{
+			unsigned long s = __myFSInodeSector(fs, pairs[2 * b + 1]);
+			if (s > last + MYFS_READDIR_GAP || s - first >= maxSectors)
+				break;
+			last = s;
+		}
+		fs->itCount = last - first + 1;
+		fs->itFirst = first;
+		fs->itBuf = malloc(fs->itCount * DISK_SECTORDATASIZE);
+		if (fs->itBuf &&
+			__myFSReadSectors(fs->d, first, fs->itCount, fs->itBuf) < 0)
+		{
+			free(fs->itBuf);
+			fs->itBuf = NULL;
+		}
+		// Sem o lote, os i-nodes sao lidos um a um
+		for (unsigned int k = a; k < b; k++)
+		{
+			Inode i;
+			if (inodeLoadInto(&i, pairs[2 * k + 1], fs->d) < 0)
+				ret = -1;
+			else
+				__myFSSetAttrs(&entries[pairs[2 * k]], &i, inodeGetFileSize(&i));
+		}
+		free(fs->itBuf);
+		fs->itBuf = NULL;
+		fs->itCount = 0;
+	}
+	free(pairs);
+	return ret;
+}
+
+// Funcao interna que retorna 1 se o diretorio so' tiver "." e "..", 0 se
+// tiver outras entradas ou -1 em caso de falha
+int __myFSDirIsEmpty(MyFSNode *dir)
+{
+	char name[MAX_FILENAME_LENGTH + 1];
+	unsigned int lb = 0, off = 0, inumber;
+	int ret;
+	while ((ret = __myFSDirNext(dir, &lb, &off, name, &inumber)) > 0)
+		if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0)
+			return 0;
+	return (ret < 0 ? -1 : 1);
+}
+
+// Funcao interna que verifica se name e' um nome valido de entrada de
+// diretorio. Retorna 1 se valido ou 0, caso contrario
+int __myFSValidName(const char *name)
+{
+	size_t len = (name ? strlen(name) : 0);
+	return len > 0 && len <= MAX_FILENAME_LENGTH && !strchr(name, '/');
+}
+
+// Funcao interna que resolve o caminho absoluto path, a partir da raiz, um
+// componente por vez, consultando o cache de nomes antes do disco. Se o caminho existir, retorna 0 e escreve em *inumber
+// o i-node correspondente. Se apenas o ultimo componente nao existir,
+// retorna 1, escreve em *parent o i-node do diretorio pai e copia o ultimo
+// componente para last. Retorna -1 em caso de caminho invalido ou falha
+int __myFSResolvePath(MyFSInfo *fs, const char *path, unsigned int *parent,
+					  char *last, unsigned int *inumber)
+{
+	unsigned int cur = MYFS_ROOT_INODE;
+	char name[MAX_FILENAME_LENGTH + 1];
+	if (!path || path[0] != '/')
+		return -1;
+	*parent = MYFS_ROOT_INODE;
+	last[0] = '\0';
+	while (*path)
+	{
+		const char *end;
+		size_t len;
+		unsigned int next;
+		MyFSNode *dir;
+		int found;
+		while (*path == '/')
+			path++;
+		if (!*path)
+			break;
+		end = strchr(path, '/');
+		len = (end ? (size_t)(end - path) : strlen(path));
+		if (len > MAX_FILENAME_LENGTH)
+			return -1;
+		memcpy(name, path, len);
+		name[len] = '\0';
+		path += len;
+		// So' diretorios tem entradas no cache de nomes: um acerto dispensa
+		// carregar o i-node de cur
+		if (__myFSDcacheLookup(fs, cur, name, &next) == 0)
+			found = (next ? 0 : -1);
+		else
+		{
+			dir = __myFSNodeGet(fs, cur);
+			if (!dir || !__myFSNodeIsDir(dir))
+			{
+				__myFSNodePut(dir);
+				return -1;
+			}
+			found = __myFSDirLookup(dir, name, &next);
+			__myFSNodePut(dir);
+		}
+		if (found < 0)
+		{
+			while (*path == '/')
+				path++;
+			if (*path)
+				return -1;
+			*parent = cur;
+			strcpy(last, name);
+			return 1;
+		}
+		*parent = cur;
+		strcpy(last, name);
+		cur = next;
+	}
+	*inumber = cur;
+	return 0;
+}
+
+// Funcao interna que abre, criando se necessario, o arquivo (type igual a
+// FILETYPE_REGULAR) ou diretorio (FILETYPE_DIR) de caminho path. Retorna o
+// i-node em memoria, a ser liberado com __myFSNodePut, ou NULL em caso de
+// falha ou se o caminho existir com outro tipo
+MyFSNode *__myFSOpenPath(Disk *d, const char *path, unsigned int type)
+{
+	MyFSInfo *fs = __myFSGetInfo(d);
+	char last[MAX_FILENAME_LENGTH + 1];
+	unsigned int parent, inumber;
+	MyFSNode *node, *dir;
+	int r;
+	if (!fs)
+		return NULL;
+	// Grupos quentes na ultima desmontagem sao lidos aos poucos
+	if (fs->warmGroups > 0)
+		__myFSWarmStep(fs, MYFS_WARM_BATCH);
+	r = __myFSResolvePath(fs, path, &parent, last, &inumber);
+	if (r < 0)
+		return NULL;
+	if (r == 0)
+	{
+		node = __myFSNodeGet(fs, inumber);
+		if (node && inodeGetFileType(&node->inode) != type)
+		{
+			__myFSNodePut(node);
+			node = NULL;
+		}
+		return node;
+	}
+	dir = __myFSNodeGet(fs, parent);
+	if (!dir)
+		return NULL;
+	// Diretorios sao espalhados pelos grupos; arquivos ficam no grupo do pai
+	if (type == FILETYPE_DIR)
+		inumber = __myFSAllocInode(fs, __myFSPickDirGroup(fs), 1);
+	else
+		inumber = __myFSAllocInode(fs, __myFSInodeGroup(fs, parent), 0);
+	if (!inumber)
+	{
+		__myFSNodePut(dir);
+		return NULL;
+	}
+	if (type == FILETYPE_DIR)
+		node = __myFSDirCreate(fs, inumber, parent);
+	else
+	{
+		node = __myFSNodeCreate(fs, inumber, type);
+		if (node)
+		{
+			inodeSetRefCount(&node->inode, 1);
+			if (inodeSave(&node->inode) < 0)
+			{
+				inodeSetRefCount(&node->inode, 0);
+				__myFSNodePut(node);
+				node = NULL;
+			}
+		}
+		else
+			__myFSFreeInode(fs, inumber, 0);
+	}
+	if (node && __myFSDirAdd(dir, last, inumber) < 0)
+	{
+		inodeSetRefCount(&node->inode, 0);
+		__myFSNodePut(node);
+		node = NULL;
+	}
+	__myFSNodePut(dir);
+	__myFSJournalOpEnd(fs);
+	return node;
+}
+
+// Funcao interna que ocupa um descritor livre com node, que passa a ficar
+// preso em memoria ate' o fechamento. Usa o ultimo descritor liberado ou,
+// se nao houver, o primeiro nunca usado. Retorna o descritor (a partir de
+// 1) ou -1 se nao houver descritor livre
+int __myFSFdAlloc(MyFSNode *node)
+{
+	MyFSFd *f = myFSFreeFds;
+	if (f)
+		myFSFreeFds = f->nextFree;
+	else if (myFSFdsUsed < MAX_FDS)
+		f = &myFSFds[myFSFdsUsed++];
+	else
+		return -1;
+	f->node = node;
+	f->cursor = 0;
+	f->dirOffset = 0;
+	f->curBlock = 0;
+	f->curAddr = 0;
+	f->raBuf = NULL;
+	f->raCount = 0;
+	f->raWindow = 0;
+	f->raNext = 0;
+	f->nextFree = NULL;
+	node->fs->numOpen++;
+	return (int)(f - myFSFds) + 1;
+}
+
+// Funcao interna que retorna o descritor fd se estiver aberto para um
+// i-node do tipo type, ou NULL caso contrario
+MyFSFd *__myFSFdGet(int fd, unsigned int type)
+{
+	if (fd < 1 || fd > MAX_FDS || !myFSFds[fd - 1].node ||
+		inodeGetFileType(&myFSFds[fd - 1].node->inode) != type)
+		return NULL;
+	return &myFSFds[fd - 1];
+}
+
+// Funcao interna que fecha o descritor fd, do tipo type. Retorna 0 se bem
+// sucedido ou -1, caso contrario
+int __myFSFdClose(int fd, unsigned int type)
+{
+	MyFSFd *f = __myFSFdGet(fd, type);
+	MyFSInfo *fs;
+	int ret = 0;
+	if (!f)
+		return -1;
+	fs = f->node->fs;
+	fs->numOpen--;
+	// Dados pendentes sao gravados no fechamento
+	if (type == FILETYPE_REGULAR && __myFSNodeFlush(f->node, 1) < 0)
+		ret = -1;
+	__myFSNodePut(f->node);
+	f->node = NULL;
+	free(f->raBuf);
+	f->raBuf = NULL;
+	f->nextFree = myFSFreeFds;
+	myFSFreeFds = f;
+	__myFSJournalOpEnd(fs);
+	return ret;
+}
+
+// Funcao interna que retorna o endereco do bloco logico lblock do arquivo
+// aberto em f, ou 0 se o bloco nao existir. O endereco fica guardado no
+// descritor para os proximos acessos ao mesmo bloco, exceto o de um buraco,
+// que pode ser preenchido por outro descritor
+unsigned int __myFSFdBlockAddr(MyFSFd *f, unsigned int lblock)
+{
+	if (!f->curAddr || (f->curAddr & (MYFS_HOLE | MYFS_TAIL)) ||
+		f->curBlock != lblock)
+	{
+		f->curBlock = lblock;
+		f->curAddr = __myFSNodeBlockAddr(f->node, lblock);
+	}
+	return f->curAddr;
+}
+
+// Funcao interna que retorna o tamanho maximo da janela de leitura
+// antecipada, em blocos
+unsigned int __myFSRaMaxBlocks(MyFSInfo *fs)
+{
+	unsigned int n = MYFS_RA_MAX_BYTES / fs->blockSize;
+	return (n > 0 ? n : 1);
+}
+
+// Funcao interna que ajusta a janela de leitura antecipada de f antes de
+// uma leitura: ela dobra a cada leitura que continua de onde a anterior
+// parou e e' zerada por um acesso fora de sequencia
+void __myFSFdUpdateWindow(MyFSFd *f)
+{
+	unsigned int max = __myFSRaMaxBlocks(f->node->fs);
+	if (f->cursor != f->raNext)
+		f->raWindow = 0;
+	else if (f->raWindow == 0)
+		f->raWindow = (MYFS_RA_INITIAL < max ? MYFS_RA_INITIAL : max);
+	else if (f->raWindow < max)
+		f->raWindow = (2 * f->raWindow < max ? 2 * f->raWindow : max);
+}
+
+// Funcao interna que garante o bloco logico lblock no buffer de leitura
+// antecipada de f. Se nao estiver la' e a leitura for sequencial, le para o
+// buffer a janela de blocos a partir de lblock, com uma unica transferencia
+// para cada trecho fisicamente contiguo. Um bloco comprimido e' sempre lido
+// inteiro para o buffer, mesmo em acesso aleatorio, mas sem os seguintes.
+// Retorna 0 se o bloco estiver no buffer ou -1, caso contrario
+int __myFSFdReadAhead(MyFSFd *f, unsigned int lblock)
+{
+	MyFSNode *node = f->node;
+	MyFSInfo *fs = node->fs;
+	unsigned int bs = fs->blockSize, n, count, window = f->raWindow;
+	if (f->raGen == node->gen && lblock >= f->raFirst &&
+		lblock < f->raFirst + f->raCount)
+		return 0;
+	if (window == 0 && __myFSNodeZipped(node) &&
+		(__myFSFdBlockAddr(f, lblock) & (MYFS_HOLE | MYFS_TAIL)) == MYFS_TAIL)
+		window = 1;
+	if (window == 0)
+		return -1;
+	if (!f->raBuf && !(f->raBuf = malloc(__myFSRaMaxBlocks(fs) * bs)))
+		return -1;
+	n = __myFSNodeNumBlocks(node);
+	count = (lblock < n ? n - lblock : 0);
+	if (count > window)
+		count = window;
+	f->raFirst = lblock;
+	f->raCount = 0;
+	f->raGen = node->gen;
+	while (f->raCount < count)
+	{
+		unsigned int addr = __myFSNodeBlockAddr(node, lblock + f->raCount);
+		unsigned int run = 1;
+		if (!addr)
+			break;
+		if (addr == MYFS_HOLE)
+		{
+			// Blocos de buracos sao zeros, sem leitura
+			memset(&f->raBuf[f->raCount * bs], 0, bs);
+			f->raCount++;
+			continue;
+		}
+		if (addr & MYFS_TAIL)
+		{
+			// Fragmento: apenas os setores do fragmento
+			if (__myFSNodeReadFrag(node, addr, &f->raBuf[f->raCount * bs]) < 0)
+				break;
+			f->raCount++;
+			continue;
+		}
+		while (f->raCount + run < count &&
+			   __myFSNodeBlockAddr(node, lblock + f->raCount + run) ==
+				   addr + run * fs->sectorsPerBlock)
+			run++;
+		if (__myFSReadSectors(fs->d, addr, run * fs->sectorsPerBlock,
+							  &f->raBuf[f->raCount * bs]) < 0)
+			break;
+		f->raCount += run;
+	}
+	return (f->raCount > 0 ? 0 : -1);
+}
+
+// Funcao interna que retorna o numero de trechos contiguos dos blocos de um
+// i-node e soma a *cyls os cilindros percorridos entre um trecho e o
+// seguinte em uma leitura completa
+unsigned int __myFSNodeExtents(MyFSNode *node, unsigned long *cyls)
+{
+	MyFSInfo *fs = node->fs;
+	unsigned int n = __myFSNodeAllocated(node), ext = 0, prev = 0;
+	// Buracos nao sao lidos e nao separam trechos. O fragmento final nao
+	// e' movido pela desfragmentacao e tambem nao e' contado
+	for (unsigned int b = 0; b < n; b++)
+	{
+		unsigned int addr = __myFSNodeBlockAddr(node, b);
+		unsigned long from, to;
+		if (addr == MYFS_HOLE || (addr & MYFS_TAIL))
+			continue;
+		if (prev && addr == prev + fs->sectorsPerBlock)
+		{
+			prev = addr;
+			continue;
+		}
+		ext++;
+		if (prev && diskAddrToCylinder(fs->d, prev + fs->sectorsPerBlock - 1,
+										&from) == 0 &&
+			diskAddrToCylinder(fs->d, addr, &to) == 0)
+			*cyls += (from > to ? from - to : to - from);
+		prev = addr;
+	}
+	return ext;
+}
+
+// Funcao interna que retorna o numero de trechos de blocos livres do disco
+unsigned int __myFSFreeRuns(MyFSInfo *fs)
+{
+	unsigned int runs = 0, b = 0;
+	while ((b = __myFSBitmapFindFree(&fs->blockMap, b)) < fs->numBlocks)
+	{
+		b += __myFSBitmapRunLength(&fs->blockMap, b, fs->numBlocks - b);
+		runs++;
+	}
+	return runs;
+}
+
+// Funcao interna que copia os blocos alocados entre os n primeiros de um
+// i-node para os blocos contiguos a partir de run, usando buf, com espaco
+// para chunk blocos. Cada trecho contiguo de origem e' lido e cada grupo de
+// chunk blocos e' gravado com uma unica transferencia. Buracos e o
+// fragmento final sao pulados.
+// Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSDefragCopy(MyFSNode *node, unsigned int n, unsigned int run,
+					 unsigned char *buf, unsigned int chunk)
+{
+	MyFSInfo *fs = node->fs;
+	unsigned int spb = fs->sectorsPerBlock, dst = 0;
+	for (unsigned int k = 0; k < n;)
+	{
+		unsigned int c = 0;
+		while (k < n && c < chunk)
+		{
+			unsigned int addr = __myFSNodeBlockAddr(node, k), len = 1;
+			if (addr == MYFS_HOLE || (addr & MYFS_TAIL))
+			{
+				k++;
+				continue;
+			}
+			while (k + len < n && c + len < chunk &&
+				   __myFSNodeBlockAddr(node, k + len) == addr + len * spb)
+				len++;
+			if (__myFSReadSectors(fs->d, addr, len * spb,
+								  &buf[c * fs->blockSize]) < 0)
+				return -1;
+			c += len;
+			k += len;
+		}
+		if (c > 0 && __myFSWriteSectors(fs->d, (unsigned long)(run + dst) * spb,
+										 c * spb, buf) < 0)
+			return -1;
+		dst += c;
+	}
+	return 0;
+}
+
+// Funcao interna que move os blocos de um arquivo, que nao esteja aberto,
+// para blocos contiguos o mais perto possivel do inicio do grupo de seu
+// i-node. Arquivos ja' contiguos so' sao movidos para mais perto do inicio
+// do grupo, o que agrupa o espaco livre no fim dos grupos. Os dados sao
+// copiados antes e a troca de enderecos no i-node e a liberacao dos blocos
+// antigos formam uma unica transacao do journal. Retorna 1 se o arquivo foi
+// movido, 0 se nao foi ou -1 em caso de falha
+int __myFSDefragNode(MyFSNode *node, unsigned char *buf, unsigned int chunk)
+{
+	MyFSInfo *fs = node->fs;
+	unsigned int n = __myFSNodeAllocated(node), spb = fs->sectorsPerBlock;
+	unsigned int goal, first, run, m = 0, ns, *addrs, *slots;
+	unsigned long cyls = 0;
+	// Apenas os blocos alocados sao movidos; os buracos e o fragmento final
+	// continuam no lugar. Arquivos com blocos compartilhados nao sao movidos,
+	// o que os duplicaria
+	for (unsigned int k = 0; k < n; k++)
+		if (__myFSNodeBlockAddr(node, k) != MYFS_HOLE &&
+			!(node->blocks[k] & MYFS_TAIL))
+		{
+			if (__myFSBlockShared(fs, node->blocks[k] / spb))
+				return 0;
+			m++;
+		}
+	if (m == 0 || m > fs->freeBlocks - fs->reservedBlocks)
+		return 0;
+	goal = __myFSGroupDataGoal(fs, __myFSInodeGroup(fs, node->number));
+	first = __myFSNodeFirstAddr(node) / spb;
+	if (__myFSNodeExtents(node, &cyls) == 1)
+	{
+		if (goal >= first ||
+			(run = __myFSFindRun(fs, goal, first, m)) >= first)
+			return 0;
+	}
+	else if ((run = __myFSFindRun(fs, goal, fs->numBlocks, m)) >=
+				 fs->numBlocks &&
+			 (run = __myFSFindRun(fs, 0, goal, m)) >= goal)
+		return 0;
+	addrs = malloc(n * sizeof(unsigned int));
+	slots = malloc(n * sizeof(unsigned int));
+	if (!addrs || !slots)
+	{
+		free(addrs);
+		free(slots);
+		return -1;
+	}
+	for (unsigned int k = 0, j = 0; k < n; k++)
+		addrs[k] = (node->blocks[k] == MYFS_HOLE || (node->blocks[k] & MYFS_TAIL)
+						? node->blocks[k]
+						: (run + j++) * spb);
+	ns = __myFSMapEncode(addrs, 0, n, slots);
+	// Transacao vazia, para que a mudanca seja registrada de uma so' vez
+	if (__myFSJournalCommit(fs) < 0 || __myFSMarkBlocks(fs, run, m) < 0)
+	{
+		free(addrs);
+		free(slots);
+		return -1;
+	}
+	if (__myFSDefragCopy(node, n, run, buf, chunk) < 0 ||
+		inodeSetBlockAddrs(&node->inode, 0, ns, slots) < 0)
+	{
+		// Os enderecos antigos continuam validos
+		__myFSMapEncode(node->blocks, 0, n, slots);
+		inodeSetBlockAddrs(&node->inode, 0, ns, slots);
+		__myFSFreeBlocks(fs, run, m);
+		free(addrs);
+		free(slots);
+		return -1;
+	}
+	free(slots);
+	__myFSNodeFreeBlocks(node, 0);
+	free(node->blocks);
+	node->blocks = addrs;
+	node->numMapped = node->mapSize = n;
+	node->gen++;
+	return (__myFSJournalCommit(fs) < 0 ? -1 : 1);
+}
+
+// Funcao interna que acrescenta v ao fim da lista l. Retorna 0 se bem
+// sucedido ou -1, caso contrario
+int __myFSListAdd(MyFSList *l, unsigned int v)
+{
+	if (l->count == l->cap)
+	{
+		unsigned int cap = (l->cap ? 2 * l->cap : 64);
+		unsigned int *items = realloc(l->items, cap * sizeof(unsigned int));
+		if (!items)
+			return -1;
+		l->items = items;
+		l->cap = cap;
+	}
+	l->items[l->count++] = v;
+	return 0;
+}
+
+// Funcao interna que acrescenta a tripla (a, b, c) ao fim da lista l.
+// Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSListAdd3(MyFSList *l, unsigned int a, unsigned int b,
+				   unsigned int c)
+{
+	if (__myFSListAdd(l, a) < 0 || __myFSListAdd(l, b) < 0 ||
+		__myFSListAdd(l, c) < 0)
+		return -1;
+	return 0;
+}
+
+// Funcao interna que decodifica em *i o i-node number a partir da copia em
+// memoria das tabelas de i-nodes, como inodeLoadInto faria a partir do disco
+void __myFSCheckInode(MyFSCheck *ck, unsigned int number, Inode *i)
+{
+	inodeLoadFrom(i, ck->fs->d,
+				  &ck->img[(unsigned long)(number - 1) * INODE_SIZE *
+						   sizeof(unsigned int)]);
+}
+
+// Funcao interna que retorna 1 se o bloco b puder pertencer a um arquivo,
+// isto e', se estiver no disco e fora dos metadados dos grupos e do journal
+int __myFSCheckBlock(MyFSInfo *fs, unsigned int b)
+{
+	unsigned int jFirst = fs->journalStart / fs->sectorsPerBlock;
+	if (b >= fs->numBlocks || b % fs->blocksPerGroup < fs->groupDataStart)
+		return 0;
+	return !(fs->journalSectors && b >= jFirst &&
+			 b < jFirst + fs->journalSectors / fs->sectorsPerBlock);
+}
+
+// Funcao interna executada por cada thread da verificacao para ler as
+// tabelas de i-nodes. Cada thread pega a proxima tabela ainda nao lida e a
+// le com o disco reservado, de modo que as tabelas sao lidas em ordem de
+// disco; a decodificacao dos tipos dos i-nodes e' feita com o disco livre
+// para as demais. Setores ainda nao zerados das tabelas nao sao lidos
+void *__myFSCheckReadTables(void *arg)
+{
+	MyFSCheckPart *p = arg;
+	MyFSCheck *ck = p->ck;
+	MyFSInfo *fs = ck->fs;
+	unsigned int perSector = inodeNumInodesPerSector();
+	for (;;)
+	{
+		unsigned int g, n = 0;
+		int ret = 0;
+		pthread_mutex_lock(&ck->io);
+		g = ck->nextGroup++;
+		if (g < fs->initGroups)
+		{
+			n = fs->itableSectors - fs->groups[g].itableUnused;
+			if (n > 0)
+				ret = __myFSReadSectors(fs->d, __myFSGroupSector(fs, g) +
+												   inodeAreaBeginSector(),
+										n, &ck->img[(unsigned long)g *
+														fs->itableSectors *
+														DISK_SECTORDATASIZE]);
+		}
+		pthread_mutex_unlock(&ck->io);
+		if (g >= fs->initGroups)
+			break;
+		if (ret < 0)
+		{
+			p->failed = 1;
+			break;
+		}
+		for (unsigned int a = 0; a < n * perSector; a++)
+		{
+			unsigned int number = g * fs->inodesPerGroup + a + 1;
+			Inode i;
+			__myFSCheckInode(ck, number, &i);
+			if (inodeGetNumber(&i) != number)
+				continue;
+			if (inodeGetFileType(&i) == FILETYPE_REGULAR)
+				ck->kind[number] = MYFS_CHECK_FILE;
+			else if (inodeGetFileType(&i) == FILETYPE_DIR)
+				ck->kind[number] = MYFS_CHECK_DIR;
+		}
+	}
+	return NULL;
+}
+
+// Funcao interna que percorre, na copia em memoria, a cadeia de i-nodes do
+// arquivo ou diretorio number e confere seus enderecos: cada bloco conta
+// uma referencia em p->uses, o fragmento final vai para p->tails e cada
+// extensao e' reservada em ck->kind. Enderecos invalidos viram buracos de um
+// bloco, a cadeia e' cortada em uma extensao invalida (ou ja' percorrida) e
+// no i-node do primeiro item vazio, e o tamanho e' reduzido ao dos blocos;
+// as correcoes vao para p->fixes. Os enderecos, ja' corrigidos, ficam em
+// p->walk. Retorna 0 se bem sucedido ou -1 se nao houver memoria
+int __myFSCheckFile(MyFSCheckPart *p, unsigned int number)
+{
+	MyFSCheck *ck = p->ck;
+	MyFSInfo *fs = ck->fs;
+	MyFSList *w = &p->walk;
+	unsigned int spb = fs->sectorsPerBlock, bs = fs->blockSize;
+	unsigned int holder = number, items = NUMBLOCKS_PERINODE;
+	unsigned int size, need, end, total, logical = 0, cut = 0, zipped;
+	Inode i;
+	__myFSCheckInode(ck, number, &i);
+	size = inodeGetFileSize(&i);
+	zipped = inodeGetPermission(&i) & MYFS_PERM_COMPRESS;
+	need = size / bs + (size % bs != 0);
+	w->count = 0;
+	for (;;)
+	{
+		unsigned int next = inodeGetNextNumber(&i);
+		int valid;
+		for (unsigned int a = 0; a < items; a++)
+			if (__myFSListAdd3(w, holder, a, inodeGetItem(&i, a)) < 0)
+				return -1;
+		if (!next)
+			break;
+		valid = (next <= fs->numInodes);
+		if (valid)
+		{
+			__myFSCheckInode(ck, next, &i);
+			valid = (inodeGetNumber(&i) == next &&
+					 __sync_bool_compare_and_swap(&ck->kind[next], 0,
+												  MYFS_CHECK_EXT));
+		}
+		if (!valid)
+		{
+			p->info.badChains++;
+			if (__myFSListAdd3(&p->fixes, holder, MYFS_CHECK_NEXT, 0) < 0)
+				return -1;
+			break;
+		}
+		holder = next;
+		items = NUMITEMS_PERINODE;
+	}
+	total = w->count / 3;
+	for (end = 0; end < total && w->items[3 * end + 2]; end++)
+		;
+	for (unsigned int k = 0; k < end; k++)
+	{
+		unsigned int *t = &w->items[3 * k], v = t[2], ok;
+		if (v & MYFS_HOLE)
+			ok = ((v & ~MYFS_HOLE) != 0);
+		else if (v & MYFS_TAIL)
+		{
+			unsigned int s = v & ~MYFS_TAIL, n = __myFSTailSectors(fs, size);
+			// Em arquivos comprimidos, qualquer bloco pode ser um fragmento,
+			// com o numero de setores no endereco
+			if (zipped)
+			{
+				n = (s >> MYFS_ZIP_SHIFT) + 1;
+				s &= (1u << MYFS_ZIP_SHIFT) - 1;
+			}
+			ok = ((zipped || (k == end - 1 && logical + 1 == need)) && n > 0 &&
+				  spb <= MYFS_FRAG_MAX_SPB && s % spb > 0 &&
+				  s % spb + n <= spb && __myFSCheckBlock(fs, s / spb));
+			if (ok && (__myFSListAdd(&p->tails, n) < 0 ||
+					   __myFSListAdd(&p->tails, s) < 0))
+				return -1;
+		}
+		else
+		{
+			ok = (v % spb == 0 && __myFSCheckBlock(fs, v / spb));
+			if (ok && p->uses[v / spb] < 0xFFFF)
+				p->uses[v / spb]++;
+		}
+		if (!ok)
+		{
+			p->info.badBlocks++;
+			t[2] = v = MYFS_HOLE | 1;
+			if (__myFSListAdd3(&p->fixes, t[0], t[1], v) < 0)
+				return -1;
+		}
+		logical += (v & MYFS_HOLE ? v & ~MYFS_HOLE : 1);
+	}
+	// Depois do primeiro item vazio, os itens do mesmo i-node devem estar
+	// vazios e a cadeia deve terminar
+	for (unsigned int k = end + 1; k < total; k++)
+	{
+		unsigned int *t = &w->items[3 * k];
+		if (t[0] != w->items[3 * end])
+		{
+			if (!(cut & 2) && __myFSListAdd3(&p->fixes, w->items[3 * end],
+											 MYFS_CHECK_NEXT, 0) < 0)
+				return -1;
+			ck->kind[t[0]] = 0;
+			cut |= 2;
+		}
+		else if (t[2])
+		{
+			if (__myFSListAdd3(&p->fixes, t[0], t[1], 0) < 0)
+				return -1;
+			cut |= 1;
+		}
+	}
+	if (cut)
+		p->info.badChains++;
+	if (logical < need)
+	{
+		p->info.badSizes++;
+		size = logical * bs;
+		if (__myFSListAdd3(&p->fixes, number, MYFS_CHECK_SIZE, size) < 0)
+			return -1;
+	}
+	w->count = 3 * end;
+	p->usedBytes += size;
+	p->info.inodes++;
+	return 0;
+}
+
+// Funcao interna que le os blocos do diretorio number, cujos enderecos
+// estao em p->walk, e confere as entradas das folhas: cada entrada valida
+// conta um nome para seu i-node em p->links e o diretorio vai para p->dirs
+// se tiver entradas para i-nodes que nao sao de arquivos nem diretorios.
+// Trechos contiguos do diretorio sao lidos em uma unica transferencia.
+// Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSCheckDir(MyFSCheckPart *p, unsigned int number)
+{
+	MyFSCheck *ck = p->ck;
+	MyFSInfo *fs = ck->fs;
+	unsigned int bs = fs->blockSize, spb = fs->sectorsPerBlock;
+	unsigned int total = p->walk.count / 3, *items = p->walk.items, n = 0;
+	unsigned char *buf;
+	int ret = 0, bad = 0;
+	// O bloco 0 e' o cabecalho; buracos e fragmentos nao tem entradas
+	for (unsigned int k = 1; k < total; k++)
+		if (!(items[3 * k + 2] & (MYFS_HOLE | MYFS_TAIL)))
+			n++;
+	if (n == 0)
+		return 0;
+	buf = malloc((unsigned long)n * bs);
+	if (!buf)
+		return -1;
+	pthread_mutex_lock(&ck->io);
+	for (unsigned int k = 1, j = 0; k < total && ret == 0;)
+	{
+		unsigned int v = items[3 * k + 2], len = 1;
+		if (v & (MYFS_HOLE | MYFS_TAIL))
+		{
+			k++;
+			continue;
+		}
+		while (k + len < total && items[3 * (k + len) + 2] == v + len * spb)
+			len++;
+		ret = __myFSReadSectors(fs->d, v, len * spb, &buf[(unsigned long)j * bs]);
+		j += len;
+		k += len;
+	}
+	pthread_mutex_unlock(&ck->io);
+	for (unsigned int b = 0; b < n && ret == 0; b++)
+	{
+		unsigned char *leaf = &buf[(unsigned long)b * bs];
+		unsigned int used, pos, len;
+		if (__myFSGetUInt(leaf, 0) != MYFS_DIR_LEAF_MAGIC)
+			continue;
+		used = __myFSGetUInt(leaf, MYFS_DIR_LEAF_USED);
+		if (used < MYFS_DIR_LEAF_SIZE || used > bs)
+		{
+			p->info.badEntries++;
+			continue;
+		}
+		for (pos = MYFS_DIR_LEAF_SIZE; pos + MYFS_DIR_ENTRY_SIZE <= used;
+			 pos += MYFS_DIR_ENTRY_SIZE + len)
+		{
+			unsigned int inumber = __myFSGetUInt(leaf, pos);
+			char *name = (char *)&leaf[pos + MYFS_DIR_ENTRY_SIZE];
+			len = leaf[pos + sizeof(unsigned int)];
+			if (pos + MYFS_DIR_ENTRY_SIZE + len > used)
+			{
+				p->info.badEntries++;
+				break;
+			}
+			if (len == 1 && name[0] == '.')
+			{
+				if (inumber != number)
+					p->info.badEntries++;
+			}
+			else if (len == 2 && name[0] == '.' && name[1] == '.')
+			{
+				if (inumber < 1 || inumber > fs->numInodes ||
+					ck->kind[inumber] != MYFS_CHECK_DIR)
+					p->info.badEntries++;
+			}
+			else if (inumber >= 1 && inumber <= fs->numInodes &&
+					 ck->kind[inumber] >= MYFS_CHECK_FILE)
+				p->links[inumber]++;
+			else
+			{
+				p->info.badEntries++;
+				bad = 1;
+			}
+		}
+	}
+	free(buf);
+	if (ret == 0 && bad && __myFSListAdd(&p->dirs, number) < 0)
+		ret = -1;
+	return ret;
+}
+
+// Funcao interna executada por cada thread da verificacao para conferir os
+// arquivos e diretorios cujos i-nodes estao nos grupos de sua parte
+void *__myFSCheckRange(void *arg)
+{
+	MyFSCheckPart *p = arg;
+	MyFSCheck *ck = p->ck;
+	unsigned int ipg = ck->fs->inodesPerGroup;
+	for (unsigned int n = p->firstGroup * ipg + 1;
+		 n <= p->endGroup * ipg && !p->failed; n++)
+		if (ck->kind[n] >= MYFS_CHECK_FILE &&
+			(__myFSCheckFile(p, n) < 0 ||
+			 (ck->kind[n] == MYFS_CHECK_DIR && __myFSCheckDir(p, n) < 0)))
+			p->failed = 1;
+	return NULL;
+}
+
+// Funcao interna que executa fn para cada parte da verificacao, cada uma em
+// sua thread, e espera todas terminarem. Uma parte cuja thread nao pode ser
+// criada e' executada pela thread corrente
+void __myFSCheckRun(MyFSCheck *ck, void *(*fn)(void *))
+{
+	pthread_t threads[MYFS_CHECK_THREADS];
+	int started[MYFS_CHECK_THREADS];
+	for (unsigned int a = 0; a < ck->numParts; a++)
+		started[a] = (pthread_create(&threads[a], NULL, fn,
+									 &ck->parts[a]) == 0);
+	for (unsigned int a = 0; a < ck->numParts; a++)
+	{
+		if (started[a])
+			pthread_join(threads[a], NULL);
+		else
+			fn(&ck->parts[a]);
+	}
+}
+
+// Funcao interna que libera a memoria de uma verificacao
+void __myFSCheckFree(MyFSCheck *ck)
+{
+	for (unsigned int a = 0; a < ck->numParts; a++)
+	{
+		MyFSCheckPart *p = &ck->parts[a];
+		free(p->uses);
+		free(p->links);
+		free(p->fixes.items);
+		free(p->tails.items);
+		free(p->dirs.items);
+		free(p->walk.items);
+	}
+	pthread_mutex_destroy(&ck->io);
+	free(ck->img);
+	free(ck->kind);
+	free(ck);
+}
+
+// Funcao interna que prepara a verificacao de fs, dividida em uma parte por
+// faixa de grupos, ate' MYFS_CHECK_THREADS. Retorna a verificacao ou NULL
+// se nao houver memoria suficiente
+MyFSCheck *__myFSCheckAlloc(MyFSInfo *fs)
+{
+	MyFSCheck *ck = calloc(1, sizeof(MyFSCheck));
+	if (!ck)
+		return NULL;
+	ck->fs = fs;
+	ck->numParts = (fs->numGroups < MYFS_CHECK_THREADS ? fs->numGroups
+													   : MYFS_CHECK_THREADS);
+	pthread_mutex_init(&ck->io, NULL);
+	ck->img = calloc(fs->numGroups,
+					 (unsigned long)fs->itableSectors * DISK_SECTORDATASIZE);
+	ck->kind = calloc(fs->numInodes + 1, 1);
+	if (!ck->img || !ck->kind)
+	{
+		__myFSCheckFree(ck);
+		return NULL;
+	}
+	for (unsigned int a = 0; a < ck->numParts; a++)
+	{
+		MyFSCheckPart *p = &ck->parts[a];
+		p->ck = ck;
+		p->firstGroup = a * fs->numGroups / ck->numParts;
+		p->endGroup = (a + 1) * fs->numGroups / ck->numParts;
+		p->uses = calloc(fs->numBlocks, sizeof(unsigned short));
+		p->links = calloc(fs->numInodes + 1, sizeof(unsigned int));
+		if (!p->uses || !p->links)
+		{
+			__myFSCheckFree(ck);
+			return NULL;
+		}
+	}
+	return ck;
+}
+
+// Funcao interna que aplica aos i-nodes as correcoes encontradas pelas
+// partes da verificacao. Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSCheckFixInodes(MyFSCheck *ck)
+{
+	Inode i;
+	for (unsigned int a = 0; a < ck->numParts; a++)
+	{
+		MyFSList *l = &ck->parts[a].fixes;
+		for (unsigned int t = 0; t < l->count; t += 3)
+		{
+			unsigned int item = l->items[t + 1], v = l->items[t + 2];
+			if (inodeLoadInto(&i, l->items[t], ck->fs->d) < 0)
+				return -1;
+			if (item == MYFS_CHECK_NEXT)
+				inodeSetNextNumber(&i, v);
+			else if (item == MYFS_CHECK_SIZE)
+				inodeSetFileSize(&i, v);
+			else
+				inodeSetItem(&i, item, v);
+			if (inodeSave(&i) < 0)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+// Funcao interna que compara o mapa de i-nodes com os i-nodes encontrados
+// (arquivos, diretorios e extensoes de suas cadeias) e os diretorios de
+// cada grupo com os encontrados e, se repair, corrige os dois. O numero de
+// i-nodes livres esperado e' escrito em *freeInodes. Retorna 0 se bem
+// sucedido ou -1, caso contrario
+int __myFSCheckInodeMap(MyFSCheck *ck, FSCheckInfo *info, int repair,
+						unsigned int *freeInodes)
+{
+	MyFSInfo *fs = ck->fs;
+	MyFSBitmap want;
+	int ret = 0;
+	if (__myFSBitmapInit(&want, fs->numInodes) < 0)
+		return -1;
+	*freeInodes = fs->numInodes;
+	for (unsigned int n = 1; n <= fs->numInodes; n++)
+	{
+		unsigned int g = __myFSInodeGroup(fs, n);
+		int have = __myFSBitmapTest(&fs->inodeMap, n - 1);
+		if (ck->kind[n])
+			__myFSBitmapMark(&want, n - 1, 1, 1);
+		if (__myFSBitmapTest(&want, n - 1))
+			(*freeInodes)--;
+		if (have == __myFSBitmapTest(&want, n - 1))
+			continue;
+		info->inodeMapErrors++;
+		if (!repair)
+			continue;
+		if (!have)
+		{
+			__myFSBitmapMark(&fs->inodeMap, n - 1, 1, 1);
+			fs->groups[g].freeInodes--;
+			fs->freeInodes--;
+			if (__myFSWriteGroupBitmap(fs, &fs->inodeMap, g, fs->inodesPerGroup,
+									   fs->inodeBitmapOffset,
+									   (n - 1) % fs->inodesPerGroup, 1) < 0)
+				ret = -1;
+			else
+				info->fixed++;
+		}
+		else if (__myFSFreeInode(fs, n, 0) < 0)
+			ret = -1;
+		else
+			info->fixed++;
+	}
+	__myFSBitmapFree(&want);
+	for (unsigned int g = 0; g < fs->numGroups; g++)
+	{
+		unsigned int dirs = 0;
+		for (unsigned int n = g * fs->inodesPerGroup + 1;
+			 n <= (g + 1) * fs->inodesPerGroup; n++)
+			dirs += (ck->kind[n] == MYFS_CHECK_DIR);
+		if (dirs == fs->groups[g].numDirs)
+			continue;
+		info->counterErrors++;
+		if (!repair)
+			continue;
+		fs->groups[g].numDirs = dirs;
+		if (__myFSWriteGroupDesc(fs, g) < 0)
+			ret = -1;
+		else
+			info->fixed++;
+	}
+	return ret;
+}
+
+// Funcao interna que soma as referencias das partes da verificacao a cada
+// bloco e confere os cabecalhos dos blocos de fragmentos, o mapa de blocos
+// e os contadores de referencias, corrigindo-os se repair. O numero de
+// blocos livres esperado e' escrito em *freeBlocks. Retorna 0 se bem
+// sucedido ou -1, caso contrario
+int __myFSCheckBlockMap(MyFSCheck *ck, FSCheckInfo *info, int repair,
+						unsigned int *freeBlocks)
+{
+	MyFSInfo *fs = ck->fs;
+	unsigned int spb = fs->sectorsPerBlock, *tails, nt = 0;
+	unsigned short *uses = ck->parts[0].uses;
+	unsigned char sector[DISK_SECTORDATASIZE];
+	MyFSBitmap want;
+	int ret = 0;
+	for (unsigned int a = 1; a < ck->numParts; a++)
+	{
+		for (unsigned int b = 0; b < fs->numBlocks; b++)
+			uses[b] = (uses[b] + ck->parts[a].uses[b] > 0xFFFF
+						   ? 0xFFFF
+						   : uses[b] + ck->parts[a].uses[b]);
+		nt += ck->parts[a].tails.count / 2;
+	}
+	nt += ck->parts[0].tails.count / 2;
+	tails = malloc((nt ? nt : 1) * 2 * sizeof(unsigned int));
+	if (!tails || __myFSBitmapInit(&want, fs->numGroups * fs->blocksPerGroup) < 0)
+	{
+		free(tails);
+		return -1;
+	}
+	nt = 0;
+	for (unsigned int a = 0; a < ck->numParts; a++)
+	{
+		// Partes sem fragmentos nao chegaram a alocar a lista
+		if (ck->parts[a].tails.count == 0)
+			continue;
+		memcpy(&tails[2 * nt], ck->parts[a].tails.items,
+			   ck->parts[a].tails.count * sizeof(unsigned int));
+		nt += ck->parts[a].tails.count / 2;
+	}
+	// Blocos de metadados, alem do fim do disco, do journal e de arquivos
+	for (unsigned int g = 0; g < fs->numGroups; g++)
+	{
+		unsigned int first = g * fs->blocksPerGroup;
+		__myFSBitmapMark(&want, first, fs->groupDataStart, 1);
+		if (first + fs->blocksPerGroup > fs->numBlocks)
+			__myFSBitmapMark(&want, fs->numBlocks,
+							 first + fs->blocksPerGroup - fs->numBlocks, 1);
+	}
+	if (fs->journalSectors)
+		__myFSBitmapMark(&want, fs->journalStart / spb,
+						 fs->journalSectors / spb, 1);
+	for (unsigned int b = 0; b < fs->numBlocks; b++)
+		if (uses[b])
+			__myFSBitmapMark(&want, b, 1, 1);
+	// Fragmentos em ordem de setor: os de um mesmo bloco ficam juntos e nao
+	// podem se sobrepor. O cabecalho deve ter exatamente os setores em uso
+	qsort(tails, nt, 2 * sizeof(unsigned int), __myFSPairCompare);
+	for (unsigned int t = 0; t < nt;)
+	{
+		unsigned int blk = tails[2 * t + 1] / spb, lo, hi, magic;
+		unsigned long long mask = 1;
+		for (; t < nt && tails[2 * t + 1] / spb == blk; t++)
+		{
+			unsigned long long m = ((1ULL << tails[2 * t]) - 1)
+								   << (tails[2 * t + 1] % spb);
+			if (mask & m)
+				info->fragErrors++;
+			mask |= m;
+		}
+		__myFSBitmapMark(&want, blk, 1, 1);
+		if (uses[blk])
+			info->dupBlocks++;
+		if (__myFSMetaRead(fs, (unsigned long)blk * spb, sector) < 0)
+		{
+			ret = -1;
+			continue;
+		}
+		char2ul(&sector[0], &magic);
+		char2ul(&sector[4], &lo);
+		char2ul(&sector[8], &hi);
+		if (magic == MYFS_FRAG_MAGIC &&
+			(((unsigned long long)hi << 32) | lo) == mask)
+			continue;
+		info->fragErrors++;
+		if (!repair)
+			continue;
+		if (__myFSFragWriteHeader(fs, blk, mask) < 0)
+			ret = -1;
+		else
+			info->fixed++;
+	}
+	free(tails);
+	// Diferencas no mapa, em sequencias dentro de um mesmo grupo
+	*freeBlocks = 0;
+	for (unsigned int b = 0; b < fs->numBlocks;)
+	{
+		unsigned int gEnd = (__myFSBlockGroup(fs, b) + 1) * fs->blocksPerGroup;
+		unsigned int len = 1;
+		int need = __myFSBitmapTest(&want, b);
+		int have = __myFSBitmapTest(&fs->blockMap, b);
+		*freeBlocks += !need;
+		if (need == have)
+		{
+			b++;
+			continue;
+		}
+		if (gEnd > fs->numBlocks)
+			gEnd = fs->numBlocks;
+		while (b + len < gEnd && __myFSBitmapTest(&want, b + len) == need &&
+			   __myFSBitmapTest(&fs->blockMap, b + len) == have)
+			len++;
+		*freeBlocks += (need ? 0 : len - 1);
+		info->blockMapErrors += len;
+		if (repair)
+		{
+			if ((need ? __myFSMarkBlocks(fs, b, len)
+					  : __myFSReleaseBlocks(fs, b, len)) < 0)
+				ret = -1;
+			else
+				info->fixed += len;
+		}
+		b += len;
+	}
+	__myFSBitmapFree(&want);
+	// Cada referencia alem da primeira conta no contador do bloco. Sem
+	// contadores, um bloco so' pode ter uma referencia
+	for (unsigned int b = 0; b < fs->numBlocks; b++)
+	{
+		unsigned int u = uses[b], rc;
+		if (!fs->refCounts)
+		{
+			info->dupBlocks += (u > 1);
+			continue;
+		}
+		if (u > MYFS_REFCOUNT_MAX + 1)
+		{
+			info->dupBlocks++;
+			u = MYFS_REFCOUNT_MAX + 1;
+		}
+		rc = (u ? u - 1 : 0);
+		if (fs->refCounts[b] == rc)
+			continue;
+		info->refCountErrors++;
+		if (!repair)
+			continue;
+		fs->refCounts[b] = rc;
+		if (__myFSWriteRefCounts(fs, b, 1) < 0)
+			ret = -1;
+		else
+			info->fixed++;
+	}
+	return ret;
+}
+
+// Funcao interna que remove do diretorio number as entradas para i-nodes
+// que nao sao de arquivos nem diretorios. Retorna 0 se bem sucedido ou -1,
+// caso contrario
+int __myFSCheckFixDir(MyFSCheck *ck, unsigned int number, FSCheckInfo *info)
+{
+	MyFSNode *dir = __myFSNodeGet(ck->fs, number);
+	FSDirEntry e[16], *bad = NULL;
+	unsigned int lb = 0, off = 0, nbad = 0, x;
+	int n, ret = 0;
+	if (!dir)
+		return -1;
+	// As entradas sao removidas so' depois de lidas todas, pois a remocao
+	// muda as posicoes das seguintes
+	while (ret == 0 && (n = __myFSDirNextEntries(dir, &lb, &off, e, 16)) > 0)
+		for (int k = 0; k < n; k++)
+		{
+			unsigned int inumber = e[k].inumber;
+			FSDirEntry *b;
+			if (strcmp(e[k].name, ".") == 0 || strcmp(e[k].name, "..") == 0 ||
+				(inumber >= 1 && inumber <= ck->fs->numInodes &&
+				 ck->kind[inumber] >= MYFS_CHECK_FILE))
+				continue;
+			b = realloc(bad, (nbad + 1) * sizeof(FSDirEntry));
+			if (!b)
+			{
+				ret = -1;
+				break;
+			}
+			bad = b;
+			bad[nbad++] = e[k];
+		}
+	for (unsigned int k = 0; k < nbad; k++)
+	{
+		if (__myFSDirRemove(dir, bad[k].name, &x) < 0)
+			ret = -1;
+		else
+			info->fixed++;
+	}
+	free(bad);
+	__myFSNodePut(dir);
+	return ret;
+}
+
+// Funcao interna que confere o contador de nomes de cada i-node com as
+// entradas de diretorio que apontam para ele e, se repair, remove antes as
+// entradas invalidas e corrige os contadores. Arquivos e diretorios sem
+// nome vao para /lost+found, a menos que seu contador ja' seja 0 (foram
+// removidos enquanto abertos), caso em que seu espaco e' liberado.
+// Retorna 0 se bem sucedido ou -1, caso contrario
+int __myFSCheckLinks(MyFSCheck *ck, FSCheckInfo *info, int repair)
+{
+	MyFSInfo *fs = ck->fs;
+	unsigned int *links = ck->parts[0].links;
+	MyFSNode *lost = NULL;
+	int ret = 0;
+	for (unsigned int a = 1; a < ck->numParts; a++)
+		for (unsigned int n = 1; n <= fs->numInodes; n++)
+			links[n] += ck->parts[a].links[n];
+	for (unsigned int a = 0; a < ck->numParts && repair; a++)
+		for (unsigned int k = 0; k < ck->parts[a].dirs.count; k++)
+			if (__myFSCheckFixDir(ck, ck->parts[a].dirs.items[k], info) < 0)
+				ret = -1;
+	for (unsigned int n = 1; n <= fs->numInodes; n++)
+	{
+		unsigned int want = links[n] + (n == MYFS_ROOT_INODE), refs;
+		MyFSNode *node;
+		Inode i;
+		if (ck->kind[n] < MYFS_CHECK_FILE)
+			continue;
+		__myFSCheckInode(ck, n, &i);
+		refs = inodeGetRefCount(&i);
+		if (want > 0 && refs == want)
+			continue;
+		if (want == 0)
+			info->orphans++;
+		else
+			info->linkErrors++;
+		if (!repair)
+			continue;
+		// Orfaos deixados fora da lista perdem a marca, para voltarem a ela
+		// ao serem devolvidos
+		if ((inodeGetPermission(&i) & MYFS_PERM_ORPHAN) &&
+			inodeLoadInto(&i, n, fs->d) == 0)
+		{
+			inodeSetPermission(&i, inodeGetPermission(&i) & ~MYFS_PERM_ORPHAN);
+			inodeSave(&i);
+		}
+		node = __myFSNodeGet(fs, n);
+		if (!node)
+		{
+			ret = -1;
+			continue;
+		}
+		if (want == 0 && refs > 0)
+		{
+			char name[16];
+			sprintf(name, "#%u", n);
+			if (!lost)
+				lost = __myFSOpenPath(fs->d, "/lost+found", FILETYPE_DIR);
+			if (!lost || __myFSDirAdd(lost, name, n) < 0)
+			{
+				ret = -1;
+				__myFSNodePut(node);
+				continue;
+			}
+			want = 1;
+		}
+		// Com o contador em 0, o i-node vai para a lista de orfaos ao ser
+		// devolvido, e a lista e' esvaziada ao fim da verificacao
+		inodeSetRefCount(&node->inode, want);
+		if (want && inodeSave(&node->inode) < 0)
+			ret = -1;
+		else
+			info->fixed++;
+		__myFSNodePut(node);
+	}
+	__myFSNodePut(lost);
+	return ret;
+}
+
+// Funcao interna que compara dois unsigned ints, para qsort
+int __myFSUIntCompare(const void *a, const void *b)
+{
+	unsigned int va = *(const unsigned int *)a, vb = *(const unsigned int *)b;
+	return (va > vb) - (va < vb);
+}
+
+// Funcao interna que percorre, sem altera-la, a subarvore a partir do i-node
+// top, acrescentando a links top e o i-node de cada entrada dos diretorios
+// (exceto "." e ".."), uma vez por entrada, em ordem de numero. As entradas
+// sao lidas em lotes, com os i-nodes de cada lote lidos em ordem de setor, e
+// cada diretorio e' percorrido uma unica vez. Retorna 0 se bem sucedido ou
+// -1 em caso de falha ou se algum diretorio da subarvore estiver em uso ou
+// tiver nomes fora dela
+int __myFSTreeCollect(MyFSInfo *fs, unsigned int top, MyFSList *links)
+{
+	unsigned char *seen = calloc(fs->numInodes + 1, 1);
+	FSDirEntry *entries = malloc(MYFS_TREE_BATCH * sizeof(FSDirEntry));
+	MyFSList dirs = {0};
+	int ret = 0;
+	if (!seen || !entries || __myFSListAdd(links, top) < 0 ||
+		__myFSListAdd(&dirs, top) < 0)
+		ret = -1;
+	else
+		seen[top] = 1;
+	while (ret == 0 && dirs.count > 0)
+	{
+		MyFSNode *dir = __myFSNodeGet(fs, dirs.items[--dirs.count]);
+		unsigned int lb = 0, off = 0;
+		int n = 0;
+		if (!dir)
+		{
+			ret = -1;
+			break;
+		}
+		while (__myFSNodeIsDir(dir) &&
+			   (n = __myFSDirNextEntries(dir, &lb, &off, entries,
+										 MYFS_TREE_BATCH)) > 0)
+		{
+			if (__myFSDirFillAttrs(fs, entries, n) < 0)
+				n = -1;
+			for (int k = 0; k < n; k++)
+			{
+				unsigned int e = entries[k].inumber;
+				if (strcmp(entries[k].name, ".") == 0 ||
+					strcmp(entries[k].name, "..") == 0)
+					continue;
+				if (__myFSListAdd(links, e) < 0)
+					n = -1;
+				else if (entries[k].type == FILETYPE_DIR && !seen[e])
+				{
+					seen[e] = 1;
+					if (__myFSListAdd(&dirs, e) < 0)
+						n = -1;
+				}
+			}
+			if (n < 0)
+				break;
+		}
+		if (n < 0)
+			ret = -1;
+		__myFSNodePut(dir);
+	}
+	if (ret == 0)
+		qsort(links->items, links->count, sizeof(unsigned int),
+			  __myFSUIntCompare);
+	// Diretorios so' saem inteiros: sem outros nomes e sem uso
+	for (unsigned int a = 0, b; ret == 0 && a < links->count; a = b)
+	{
+		MyFSNode *node = __myFSNodeGet(fs, links->items[a]);
+		for (b = a + 1; b < links->count && links->items[b] == links->items[a];
+			 b++)
+			;
+		if (!node || node->number == MYFS_ROOT_INODE ||
+			(__myFSNodeIsDir(node) &&
+			 (node->refs > 1 || inodeGetRefCount(&node->inode) != b - a)))
+			ret = -1;
+		__myFSNodePut(node);
+	}
+	free(dirs.items);
+	free(entries);
+	free(seen);
+	return ret;
+}
 
 // Funcao para verificacao se o sistema de arquivos está ocioso, ou seja,
 // se nao ha quisquer descritores de arquivos em uso atualmente. Retorna
 // um positivo se ocioso ou, caso contrario, 0.
 int myFSIsIdle(Disk *d)
 {
+	for (int a = 0; a < MYFS_MAX_DISKS; a++)
+		if (myFSInfos[a] && myFSInfos[a]->d == d)
+			return myFSInfos[a]->numOpen == 0;
+	return 1;
+}
 
+// Funcao para desmontar o sistema de arquivos de um disco ocioso: os orfaos
+// pendentes sao liberados, os metadados pendentes no journal gravados nos
+// lugares e, com o journal vazio, o resumo do alocador fica para a proxima
+// montagem. As informacoes em memoria sao descartadas e o disco (ou outro
+// conectado no mesmo endereco) e' relido na montagem seguinte. Retorna 0 se
+// bem sucedido ou -1, caso contrario
+int myFSUnmount(Disk *d)
+{
+	MyFSInfo *fs = NULL;
+	for (int a = 0; a < MYFS_MAX_DISKS; a++)
+		if (myFSInfos[a] && myFSInfos[a]->d == d)
+			fs = myFSInfos[a];
+	if (!fs)
+		return 0;
+	if (fs->numOpen > 0)
+		return -1;
+	__myFSOrphanReclaim(fs, 0);
+	if (__myFSJournalCheckpoint(fs) < 0)
+		return -1;
+	__myFSSummaryWrite(fs);
+	__myFSForgetInfo(d);
 	return 0;
 }
 
@@ -35,7 +6455,139 @@ int myFSIsIdle(Disk *d)
 // retorna -1.
 int myFSFormat(Disk *d, unsigned int blockSize)
 {
-	return -1;
+	unsigned char zero[DISK_SECTORDATASIZE];
+	unsigned long groupSectors;
+	unsigned int totalBlocks, jBlocks;
+	unsigned int freeBlocks;
+	MyFSInfo *fs;
+	MyFSNode *root;
+	int slot = -1;
+
+	if (!d || blockSize < DISK_SECTORDATASIZE ||
+		blockSize % DISK_SECTORDATASIZE || diskGetNumCylinders(d) == 0)
+		return -1;
+	// Cada cilindro tem uma unica trilha
+	groupSectors = MYFS_GROUP_CYLINDERS *
+				   (diskGetNumSectors(d) / diskGetNumCylinders(d));
+	__myFSForgetInfo(d);
+	for (int a = 0; a < MYFS_MAX_DISKS && slot < 0; a++)
+		if (!myFSInfos[a])
+			slot = a;
+	if (slot < 0)
+		return -1;
+
+	fs = calloc(1, sizeof(MyFSInfo));
+	if (!fs)
+		return -1;
+	fs->d = d;
+	fs->blockSize = blockSize;
+	fs->features = MYFS_FEAT_REFCOUNT | MYFS_FEAT_USAGE | MYFS_FEAT_DEDUP;
+	totalBlocks = diskGetNumSectors(d) / (blockSize / DISK_SECTORDATASIZE);
+
+	// Grupos de MYFS_GROUP_CYLINDERS cilindros, com um numero de blocos
+	// multiplo de 64 (ao menos 64). Um grupo final parcial so' e' mantido
+	// se couberem seus metadados e algum bloco de dados
+	fs->blocksPerGroup = groupSectors / (blockSize / DISK_SECTORDATASIZE);
+	fs->blocksPerGroup -= fs->blocksPerGroup % MYFS_BITS_PER_WORD;
+	if (fs->blocksPerGroup < MYFS_BITS_PER_WORD)
+		fs->blocksPerGroup = MYFS_BITS_PER_WORD;
+	fs->inodesPerGroup = (fs->blocksPerGroup / MYFS_INODE_RATIO +
+						  MYFS_BITS_PER_WORD - 1) /
+						 MYFS_BITS_PER_WORD * MYFS_BITS_PER_WORD;
+	if (fs->inodesPerGroup == 0)
+		fs->inodesPerGroup = MYFS_BITS_PER_WORD;
+	fs->numGroups = 1;
+	fs->numBlocks = fs->blocksPerGroup;
+	if (__myFSComputeLayout(fs) < 0)
+	{
+		free(fs);
+		return -1;
+	}
+	fs->numGroups = totalBlocks / fs->blocksPerGroup;
+	if (totalBlocks % fs->blocksPerGroup > fs->groupDataStart)
+		fs->numGroups++;
+	fs->numBlocks = totalBlocks;
+	if (fs->numBlocks > fs->numGroups * fs->blocksPerGroup)
+		fs->numBlocks = fs->numGroups * fs->blocksPerGroup;
+	if (__myFSComputeLayout(fs) < 0 || __myFSAllocInfo(fs) < 0)
+	{
+		__myFSFreeInfo(fs);
+		return -1;
+	}
+
+	// Blocos de metadados de cada grupo e blocos alem do fim do disco ficam
+	// ocupados. Nenhum grupo esta' gravado ainda
+	for (unsigned int g = 0; g < fs->numGroups; g++)
+	{
+		__myFSGroupDefaults(fs, g);
+		fs->freeBlocks += fs->groups[g].freeBlocks;
+	}
+	fs->freeInodes = fs->numInodes;
+	fs->initGroups = 0;
+	fs->uninitGroups = fs->numGroups;
+
+	// Journal no inicio da area de dados do grupo 0, com ate' um quarto dela
+	jBlocks = MYFS_JOURNAL_SECTORS / fs->sectorsPerBlock;
+	if (jBlocks > fs->groups[0].freeBlocks / 4)
+		jBlocks = fs->groups[0].freeBlocks / 4;
+	if (jBlocks * fs->sectorsPerBlock < MYFS_JOURNAL_MIN)
+		jBlocks = 0;
+	if (jBlocks > 0)
+	{
+		__myFSBitmapMark(&fs->blockMap, fs->groupDataStart, jBlocks, 1);
+		fs->groups[0].freeBlocks -= jBlocks;
+		fs->freeBlocks -= jBlocks;
+		fs->journalStart = fs->groupDataStart * fs->sectorsPerBlock;
+		fs->journalSectors = jBlocks * fs->sectorsPerBlock;
+	}
+	fs->allocHint = __myFSGroupDataGoal(fs, 0) + jBlocks;
+
+	// So' o grupo 0 e' gravado agora, com o superbloco. Os demais grupos e
+	// as tabelas de i-nodes sao gravados no primeiro uso
+	if (__myFSInitGroups(fs, 0) < 0)
+	{
+		__myFSFreeInfo(fs);
+		return -1;
+	}
+	myFSInfos[slot] = fs;
+
+	// Journal vazio. O primeiro setor do log e' zerado e o identificador
+	// distingue este journal de restos de formatacoes anteriores
+	if (fs->journalSectors)
+	{
+		fs->jId = (unsigned int)time(NULL) ^ (unsigned int)clock();
+		fs->jTail = 0;
+		fs->jSeq = 1;
+		memset(zero, 0, DISK_SECTORDATASIZE);
+		if (diskWriteSector(d, fs->journalStart + 1, zero) < 0 ||
+			__myFSJournalWriteSb(fs) < 0)
+		{
+			__myFSForgetInfo(d);
+			return -1;
+		}
+		__myFSJournalSetLimits(fs);
+	}
+
+	// Diretorio raiz, vazio, no primeiro i-node do grupo 0. Seu ".." aponta
+	// para ele mesmo
+	root = NULL;
+	if (__myFSSetupInodes(fs) == 0 &&
+		__myFSAllocInode(fs, 0, 1) == MYFS_ROOT_INODE)
+		root = __myFSDirCreate(fs, MYFS_ROOT_INODE, MYFS_ROOT_INODE);
+	if (!root)
+	{
+		__myFSForgetInfo(d);
+		return -1;
+	}
+	__myFSNodePut(root);
+	// Como ao desmontar, as informacoes em memoria nao ficam para depois
+	freeBlocks = fs->freeBlocks;
+	if (myFSUnmount(d) < 0)
+	{
+		__myFSForgetInfo(d);
+		return -1;
+	}
+	return freeBlocks;
 }
 
 // Funcao para abertura de um arquivo, a partir do caminho especificado
@@ -44,7 +6596,14 @@ int myFSFormat(Disk *d, unsigned int blockSize)
 // em caso de sucesso. Retorna -1, caso contrario.
 int myFSOpen(Disk *d, const char *path)
 {
-	return -1;
+	MyFSNode *node = __myFSOpenPath(d, path, FILETYPE_REGULAR);
+	int fd;
+	if (!node)
+		return -1;
+	fd = __myFSFdAlloc(node);
+	if (fd < 0)
+		__myFSNodePut(node);
+	return fd;
 }
 
 // Funcao para a leitura de um arquivo, a partir de um descritor de
@@ -53,7 +6612,59 @@ int myFSOpen(Disk *d, const char *path)
 // lidos em caso de sucesso ou -1, caso contrario.
 int myFSRead(int fd, char *buf, unsigned int nbytes)
 {
-	return -1;
+	MyFSFd *f = __myFSFdGet(fd, FILETYPE_REGULAR);
+	unsigned char sector[DISK_SECTORDATASIZE];
+	unsigned int size, bs, done = 0;
+	if (!f || !buf)
+		return -1;
+	size = __myFSNodeSize(f->node);
+	bs = f->node->fs->blockSize;
+	if (f->cursor >= size)
+		return 0;
+	if (nbytes > size - f->cursor)
+		nbytes = size - f->cursor;
+	__myFSFdUpdateWindow(f);
+	while (done < nbytes)
+	{
+		unsigned int lblock = f->cursor / bs, off = f->cursor % bs, len;
+		MyFSNode *node = f->node;
+		if (node->wbBuf && lblock >= node->wbFirst)
+		{
+			// Dados ainda pendentes de gravacao
+			len = nbytes - done;
+			memcpy(&buf[done], &node->wbBuf[f->cursor - node->wbFirst * bs], len);
+		}
+		else if (__myFSFdReadAhead(f, lblock) == 0)
+		{
+			len = bs - off;
+			if (len > nbytes - done)
+				len = nbytes - done;
+			memcpy(&buf[done], &f->raBuf[(lblock - f->raFirst) * bs + off], len);
+		}
+		else
+		{
+			// Acesso aleatorio: apenas os setores com bytes pedidos sao lidos
+			unsigned int addr = __myFSFdBlockAddr(f, lblock);
+			len = (addr == MYFS_HOLE ? bs - off
+									 : DISK_SECTORDATASIZE - off % DISK_SECTORDATASIZE);
+			if (len > nbytes - done)
+				len = nbytes - done;
+			// Buracos sao zeros, sem acesso ao disco
+			if (addr == MYFS_HOLE)
+				memset(&buf[done], 0, len);
+			else if (!addr || ((addr & MYFS_TAIL) && __myFSNodeZipped(node)) ||
+					 diskReadSector(f->node->fs->d,
+									(addr & ~MYFS_TAIL) + off / DISK_SECTORDATASIZE,
+									sector) < 0)
+				break;
+			else
+				memcpy(&buf[done], &sector[off % DISK_SECTORDATASIZE], len);
+		}
+		done += len;
+		f->cursor += len;
+	}
+	f->raNext = f->cursor;
+	return (done > 0 || nbytes == 0 ? (int)done : -1);
 }
 
 // Funcao para a escrita de um arquivo, a partir de um descritor de
@@ -62,14 +6673,582 @@ int myFSRead(int fd, char *buf, unsigned int nbytes)
 // efetivamente escritos em caso de sucesso ou -1, caso contrario
 int myFSWrite(int fd, const char *buf, unsigned int nbytes)
 {
-	return -1;
+	MyFSFd *f = __myFSFdGet(fd, FILETYPE_REGULAR);
+	unsigned char sector[DISK_SECTORDATASIZE];
+	unsigned int valid, bs, done = 0;
+	MyFSNode *node;
+	MyFSInfo *fs;
+	if (!f || !buf)
+		return -1;
+	node = f->node;
+	fs = node->fs;
+	bs = fs->blockSize;
+	// Blocos lidos antecipadamente por qualquer descritor ficam invalidos
+	node->gen++;
+	// Escrita alem do ultimo bloco: os blocos inteiros no caminho formam um
+	// buraco, sem alocacao
+	if (nbytes > 0 && f->cursor / bs > (__myFSNodeSize(node) + bs - 1) / bs &&
+		(__myFSNodeFlush(node, 1) < 0 || __myFSNodeExtend(node, f->cursor / bs) < 0))
+	{
+		__myFSJournalOpEnd(fs);
+		return -1;
+	}
+	valid = inodeGetFileSize(&node->inode);
+	while (done < nbytes)
+	{
+		unsigned int lblock = f->cursor / bs, off = f->cursor % bs, addr;
+		unsigned int soff = off % DISK_SECTORDATASIZE;
+		unsigned int len = DISK_SECTORDATASIZE - soff;
+		// A partir do ultimo bloco incompleto, os dados ficam em memoria e
+		// os blocos so' sao alocados quando gravados
+		if (!node->wbBuf && lblock >= valid / bs &&
+			__myFSNodeStartWb(node) < 0)
+			break;
+		if (node->wbBuf && lblock >= node->wbFirst)
+		{
+			int n = __myFSNodeBufferWrite(node, f->cursor - node->wbFirst * bs,
+										  &buf[done], nbytes - done);
+			if (n < 0)
+				break;
+			done += n;
+			f->cursor += n;
+			break;
+		}
+		addr = __myFSFdBlockAddr(f, lblock);
+		if (!addr)
+			break;
+		if (addr == MYFS_HOLE)
+		{
+			int n = __myFSNodeWriteHole(node, f->cursor, &buf[done], nbytes - done,
+										valid / bs);
+			if (n < 0)
+				break;
+			done += n;
+			f->cursor += n;
+			continue;
+		}
+		// Bloco compartilhado ou comprimido: a escrita vai para uma copia
+		// propria
+		if (((addr & MYFS_TAIL) ||
+			 __myFSBlockShared(fs, addr / fs->sectorsPerBlock)) &&
+			(__myFSNodeUnshare(node, lblock) < 0 ||
+			 !(addr = __myFSFdBlockAddr(f, lblock))))
+			break;
+		if (len > nbytes - done)
+			len = nbytes - done;
+		addr += off / DISK_SECTORDATASIZE;
+		// Setores parcialmente escritos com dados anteriores sao lidos antes
+		if (len < DISK_SECTORDATASIZE &&
+			(soff > 0 || f->cursor + len < valid) &&
+			diskReadSector(fs->d, addr, sector) < 0)
+			break;
+		memcpy(&sector[soff], &buf[done], len);
+		if (diskWriteSector(fs->d, addr, sector) < 0)
+			break;
+		done += len;
+		f->cursor += len;
+	}
+	// Muitos dados pendentes: os blocos completos sao gravados
+	if (node->wbBuf && (node->wbLen >= MYFS_WB_MAX_BYTES ||
+						fs->dirtyBytes >= MYFS_WB_TOTAL_BYTES))
+		__myFSNodeFlush(node, 0);
+	__myFSJournalOpEnd(fs);
+	return (done > 0 || nbytes == 0 ? (int)done : -1);
+}
+
+// Funcao para reservar espaco para um arquivo, identificado por um descritor
+// de arquivo existente, de modo que ele possa crescer ate' nbytes sem que
+// novos blocos precisem ser alocados. Os blocos sao alocados contiguos ao
+// fim do arquivo sempre que possivel, mas nada e' gravado neles e o tamanho
+// do arquivo nao muda: o conteudo de um bloco reservado so' e' visivel
+// depois de escrito. Buracos do arquivo continuam sem blocos. Retorna 0 caso
+// bem sucedido, ou -1 caso contrario
+int myFSAllocate(int fd, unsigned int nbytes)
+{
+	MyFSFd *f = __myFSFdGet(fd, FILETYPE_REGULAR);
+	unsigned int have, want, k, goal, *addrs, spb;
+	MyFSNode *node;
+	MyFSInfo *fs;
+	int ret;
+	if (!f)
+		return -1;
+	node = f->node;
+	fs = node->fs;
+	spb = fs->sectorsPerBlock;
+	have = __myFSNodeAllocated(node);
+	want = (nbytes + fs->blockSize - 1) / fs->blockSize;
+	if (want <= have)
+		return 0;
+	// Blocos reservados nao podem vir depois de um fragmento
+	if (__myFSNodeUnpackTail(node) < 0)
+		return -1;
+	want -= have;
+	// Blocos ja' reservados para dados pendentes deste arquivo contam
+	if (want > fs->freeBlocks - fs->reservedBlocks + node->wbReserved)
+		return -1;
+	addrs = malloc(want * sizeof(unsigned int));
+	if (!addrs)
+		return -1;
+	goal = __myFSNodeGoal(node, have);
+	fs->reservedBlocks -= node->wbReserved;
+	node->wbReserved = 0;
+	for (k = 0; k < want;)
+	{
+		unsigned int first, got = __myFSAllocBlocks(fs, goal, want - k, 1, &first);
+		if (got == 0)
+			break;
+		for (unsigned int j = 0; j < got; j++)
+			addrs[k + j] = (first + j) * spb;
+		k += got;
+		goal = first + got;
+	}
+	ret = (k == want ? inodeAddBlocks(&node->inode, addrs, want) : -1);
+	if (ret == 0)
+		for (k = 0; k < want; k++)
+			__myFSNodeMapAppend(node, addrs[k]);
+	else
+	{
+		// Os blocos que chegaram a ser acrescentados ao i-node ficam nele
+		unsigned int added = 0;
+		free(node->blocks);
+		node->blocks = NULL;
+		if (k == want && __myFSNodeAllocated(node) > have)
+			added = __myFSNodeAllocated(node) - have;
+		for (unsigned int j = added; j < k; j++)
+			__myFSFreeBlocks(fs, addrs[j] / spb, 1);
+	}
+	free(addrs);
+	__myFSNodeReserve(node);
+	__myFSJournalOpEnd(fs);
+	return ret;
+}
+
+// Funcao para ligar (on diferente de 0) ou desligar a compressao dos blocos
+// de um arquivo, identificado por um descritor de arquivo existente. Com a
+// compressao ligada, cada bloco gravado e' comprimido e vai para um
+// fragmento, se ocupar menos setores, e e' lido sem que os demais blocos
+// sejam lidos; um bloco reescrito no meio do arquivo volta a ser gravado sem
+// compressao. Ao desligar, os blocos comprimidos voltam a ocupar blocos
+// proprios. A compressao exige blocos de no maximo MYFS_FRAG_MAX_SPB setores
+// e discos com menos de 2^MYFS_ZIP_SHIFT setores. Retorna 0 caso bem
+// sucedido, ou -1 caso contrario
+int myFSSetCompression(int fd, int on)
+{
+	MyFSFd *f = __myFSFdGet(fd, FILETYPE_REGULAR);
+	unsigned int perm, n;
+	MyFSNode *node;
+	MyFSInfo *fs;
+	int ret;
+	if (!f)
+		return -1;
+	node = f->node;
+	fs = node->fs;
+	on = (on ? 1 : 0);
+	if (on == __myFSNodeZipped(node))
+		return 0;
+	if (on && (fs->sectorsPerBlock > MYFS_FRAG_MAX_SPB ||
+			   diskGetNumSectors(fs->d) > (1ul << MYFS_ZIP_SHIFT)))
+		return -1;
+	// Os dados pendentes sao gravados no formato atual e os fragmentos sao
+	// convertidos antes da mudanca: ao ligar, o fragmento final vai para um
+	// bloco proprio; ao desligar, os blocos comprimidos sao descomprimidos
+	ret = __myFSNodeFlush(node, 1);
+	if (ret == 0 && on)
+		ret = __myFSNodeUnpackTail(node);
+	n = (ret == 0 && !on ? __myFSNodeAllocated(node) : 0);
+	for (unsigned int b = 0; b < n && ret == 0; b++)
+		if ((__myFSNodeBlockAddr(node, b) & (MYFS_HOLE | MYFS_TAIL)) == MYFS_TAIL)
+			ret = __myFSNodeUnshare(node, b);
+	if (ret == 0)
+	{
+		perm = inodeGetPermission(&node->inode);
+		inodeSetPermission(&node->inode, (on ? perm | MYFS_PERM_COMPRESS
+											 : perm & ~MYFS_PERM_COMPRESS));
+		ret = inodeSave(&node->inode);
+	}
+	node->gen++;
+	__myFSNodeForgetAddrs(node);
+	__myFSJournalOpEnd(fs);
+	return (ret < 0 ? -1 : 0);
+}
+
+// Funcao para ligar (on diferente de 0) ou desligar a deduplicacao dos
+// blocos de um arquivo, identificado por um descritor de arquivo existente.
+// Com a deduplicacao ligada, cada bloco completo gravado dai' em diante que
+// tenha o mesmo conteudo de um bloco ja' gravado por um arquivo com
+// deduplicacao passa a compartilha-lo, sem ocupar espaco nem ser gravado.
+// Os blocos ja' gravados nao mudam, exceto o fragmento final, que vai para
+// um bloco proprio. Retorna 0 caso bem sucedido, ou -1 caso contrario
+// (inclusive em discos formatados sem impressoes dos blocos)
+int myFSSetDedup(int fd, int on)
+{
+	MyFSFd *f = __myFSFdGet(fd, FILETYPE_REGULAR);
+	unsigned int perm;
+	MyFSInfo *fs;
+	int ret;
+	if (!f)
+		return -1;
+	fs = f->node->fs;
+	perm = inodeGetPermission(&f->node->inode);
+	if ((on != 0) == ((perm & MYFS_PERM_DEDUP) != 0))
+		return 0;
+	if (on && !fs->dedupFps)
+		return -1;
+	// Como na compressao, os dados pendentes sao gravados no formato atual
+	// e, ao ligar, o fragmento final vai para um bloco proprio: arquivos com
+	// deduplicacao gravam um bloco de cada vez, sem fragmentos
+	ret = __myFSNodeFlush(f->node, 1);
+	if (ret == 0 && on)
+		ret = __myFSNodeUnpackTail(f->node);
+	if (ret == 0)
+	{
+		inodeSetPermission(&f->node->inode, (on ? perm | MYFS_PERM_DEDUP
+												: perm & ~MYFS_PERM_DEDUP));
+		ret = inodeSave(&f->node->inode);
+	}
+	f->node->gen++;
+	__myFSNodeForgetAddrs(f->node);
+	__myFSJournalOpEnd(fs);
+	return (ret < 0 ? -1 : 0);
+}
+
+// Funcao interna que cria o arquivo regular de numero inumber, ja' alocado,
+// como clone dos n primeiros blocos de node, com os mesmos tamanho e
+// atributos: os blocos sao compartilhados e os fragmentos (o final ou, em
+// arquivos comprimidos, os de quaisquer blocos) sao copiados para
+// fragmentos novos. Retorna o i-node em memoria, a ser liberado com
+// __myFSNodePut, ou NULL em caso de falha
+MyFSNode *__myFSNodeClone(MyFSNode *node, unsigned int inumber, unsigned int n)
+{
+	MyFSInfo *fs = node->fs;
+	unsigned int size = inodeGetFileSize(&node->inode), ns, j;
+	unsigned int goal = __myFSGroupDataGoal(fs, __myFSInodeGroup(fs, inumber));
+	unsigned int *slots = malloc((n > 0 ? n : 1) * sizeof(unsigned int));
+	unsigned char *buf = malloc(fs->blockSize);
+	MyFSNode *clone;
+	int ret = 0;
+	if (!slots || !buf)
+	{
+		free(slots);
+		free(buf);
+		return NULL;
+	}
+	ns = __myFSMapEncode(node->blocks, 0, n, slots);
+	for (j = 0; j < ns && ret == 0; j++)
+		if (!(slots[j] & MYFS_HOLE) && (slots[j] & MYFS_TAIL))
+		{
+			unsigned int tn, s = __myFSNodeFrag(node, slots[j], &tn);
+			unsigned int t = __myFSFragAlloc(fs, tn, goal);
+			if (!t || __myFSReadSectors(fs->d, s, tn, buf) < 0 ||
+				__myFSWriteSectors(fs->d, t, tn, buf) < 0)
+			{
+				if (t)
+					__myFSFragFree(fs, t, tn);
+				ret = -1;
+				break;
+			}
+			slots[j] = __myFSNodeFragAddr(node, t, tn);
+		}
+	free(buf);
+	clone = (ret == 0 ? __myFSNodeCreate(fs, inumber, FILETYPE_REGULAR) : NULL);
+	if (!clone)
+	{
+		// Os fragmentos ja' copiados sao liberados
+		__myFSNodeFreeFrags(node, slots, j);
+		free(slots);
+		__myFSFreeInode(fs, inumber, 0);
+		return NULL;
+	}
+	__myFSNodeSetSize(clone, size);
+	inodeSetOwner(&clone->inode, inodeGetOwner(&node->inode));
+	inodeSetGroupOwner(&clone->inode, inodeGetGroupOwner(&node->inode));
+	inodeSetPermission(&clone->inode, inodeGetPermission(&node->inode));
+	inodeSetRefCount(&clone->inode, 1);
+	ret = (ns > 0 ? inodeAddBlocks(&clone->inode, slots, ns)
+				  : inodeSave(&clone->inode));
+	// As referencias sao contadas depois que o clone aponta para os blocos;
+	// ate' la', o clone e' liberado sem liberar os blocos: sua cadeia e'
+	// limpa antes, para que a liberacao do orfao nao os encontre
+	if (ret < 0 || __myFSNodeAddRefs(node, n, 1) < 0)
+	{
+		__myFSNodeFreeFrags(node, slots, ns);
+		free(slots);
+		__myFSNodeSetSize(clone, 0);
+		inodeClear(&clone->inode);
+		free(clone->blocks);
+		clone->blocks = calloc(1, sizeof(unsigned int));
+		clone->numMapped = 0;
+		clone->mapSize = 1;
+		inodeSetRefCount(&clone->inode, 0);
+		__myFSNodePut(clone);
+		return NULL;
+	}
+	free(slots);
+	return clone;
+}
+
+// Funcao para clonar o arquivo de caminho src em um novo arquivo de caminho
+// dst, que nao pode existir, no disco montado d. O clone compartilha os
+// blocos de dados de src, sem copia-los, e cada arquivo so' passa a ter uma
+// copia propria de um bloco quando escreve nele, de modo que o custo nao
+// depende do tamanho do arquivo. Retorna 0 caso bem sucedido, ou -1 caso
+// contrario (inclusive em discos sem contadores de referencias ou se algum
+// bloco ja' tiver o maximo de referencias)
+int myFSClone(Disk *d, const char *src, const char *dst)
+{
+	MyFSInfo *fs = __myFSGetInfo(d);
+	char last[MAX_FILENAME_LENGTH + 1];
+	unsigned int parent, number, inumber, n = 0;
+	MyFSNode *node = NULL, *dir = NULL, *clone = NULL;
+	int ret = -1;
+	if (!fs || !fs->refCounts ||
+		__myFSResolvePath(fs, src, &parent, last, &number) != 0 ||
+		__myFSResolvePath(fs, dst, &parent, last, &inumber) != 1)
+		return -1;
+	node = __myFSNodeGet(fs, number);
+	dir = __myFSNodeGet(fs, parent);
+	// Dados pendentes de src sao gravados antes, para serem compartilhados
+	if (node && dir && !__myFSNodeIsDir(node) && __myFSNodeIsDir(dir) &&
+		__myFSNodeFlush(node, 1) == 0 &&
+		(node->blocks || __myFSNodeMapBlocks(node) == 0))
+	{
+		// Um bloco com o maximo de referencias (mesmo que so' pelas
+		// repeticoes em src) faz a contagem, e o clone, falharem
+		n = __myFSNodeNumBlocks(node);
+		ret = 0;
+	}
+	if (ret == 0 &&
+		(!(inumber = __myFSAllocInode(fs, __myFSInodeGroup(fs, parent), 0)) ||
+		 !(clone = __myFSNodeClone(node, inumber, n))))
+		ret = -1;
+	if (clone && __myFSDirAdd(dir, last, inumber) < 0)
+	{
+		inodeSetRefCount(&clone->inode, 0);
+		ret = -1;
+	}
+	__myFSNodePut(clone);
+	__myFSNodePut(dir);
+	__myFSNodePut(node);
+	__myFSJournalOpEnd(fs);
+	return ret;
+}
+
+// Funcao para posicionar o cursor de um arquivo, a partir de um descritor
+// de arquivo existente, em offset bytes do inicio. O cursor pode ficar alem
+// do fim do arquivo: uma escrita ali deixa um buraco, lido como zeros e sem
+// blocos alocados. Retorna 0 caso bem sucedido, ou -1 caso contrario
+int myFSSeek(int fd, unsigned int offset)
+{
+	MyFSFd *f = __myFSFdGet(fd, FILETYPE_REGULAR);
+	if (!f)
+		return -1;
+	f->cursor = offset;
+	return 0;
+}
+
+// Funcao para desfragmentar o sistema de arquivos de um disco montado,
+// tornando contiguos os blocos dos arquivos que nao estejam abertos e
+// agrupando o espaco livre. Os arquivos sao processados em ordem de posicao
+// no disco. O resultado e' escrito em info. Retorna 0 caso bem sucedido, ou
+// -1 caso contrario
+int myFSDefrag(Disk *d, FSDefragInfo *info)
+{
+	MyFSInfo *fs = __myFSGetInfo(d);
+	unsigned int *files, count = 0, chunk;
+	unsigned char *buf;
+	int ret = 0;
+	// Os trechos livres sao contados no disco inteiro
+	if (!fs || !info || __myFSGroupsLoadAll(fs) < 0)
+		return -1;
+	memset(info, 0, sizeof(FSDefragInfo));
+	chunk = MYFS_DEFRAG_BYTES / fs->blockSize;
+	if (chunk == 0)
+		chunk = 1;
+	files = malloc(2 * fs->numInodes * sizeof(unsigned int));
+	buf = malloc(chunk * fs->blockSize);
+	if (!files || !buf)
+	{
+		free(files);
+		free(buf);
+		return -1;
+	}
+	info->freeRunsBefore = __myFSFreeRuns(fs);
+	// Arquivos regulares (pares i-node, primeiro bloco), ordenados pelo
+	// primeiro bloco
+	for (unsigned int number = 1; number <= fs->numInodes; number++)
+	{
+		MyFSNode *node;
+		if (!__myFSBitmapTest(&fs->inodeMap, number - 1) ||
+			!(node = __myFSNodeGet(fs, number)))
+			continue;
+		if (!__myFSNodeIsDir(node))
+		{
+			files[2 * count] = number;
+			files[2 * count + 1] = __myFSNodeFirstAddr(node);
+			count++;
+			info->files++;
+			info->extentsBefore += __myFSNodeExtents(node, &info->cylsBefore);
+			// Arquivos abertos tem outras referencias e ficam onde estao
+			if (node->refs > 1)
+				info->filesBusy++;
+		}
+		__myFSNodePut(node);
+	}
+	// A primeira passada torna os arquivos contiguos, mas pode ter de
+	// coloca-los alem do espaco ocupado; as seguintes aproximam os arquivos
+	// do inicio dos grupos, ocupando o espaco liberado pela anterior
+	for (int pass = 0, moved = 1; pass < MYFS_DEFRAG_PASSES && moved && ret == 0;
+		 pass++)
+	{
+		qsort(files, count, 2 * sizeof(unsigned int), __myFSPairCompare);
+		moved = 0;
+		for (unsigned int a = 0; a < count && ret == 0; a++)
+		{
+			MyFSNode *node = __myFSNodeGet(fs, files[2 * a]);
+			int r = 0;
+			if (!node)
+				continue;
+			if (node->refs == 1 && (r = __myFSDefragNode(node, buf, chunk)) > 0)
+			{
+				if (pass == 0)
+					info->filesMoved++;
+				files[2 * a + 1] = __myFSNodeFirstAddr(node);
+				moved = 1;
+			}
+			else if (r < 0)
+				ret = -1;
+			__myFSNodePut(node);
+		}
+	}
+	for (unsigned int a = 0; a < count; a++)
+	{
+		MyFSNode *node = __myFSNodeGet(fs, files[2 * a]);
+		if (!node)
+			continue;
+		info->extentsAfter += __myFSNodeExtents(node, &info->cylsAfter);
+		__myFSNodePut(node);
+	}
+	info->freeRunsAfter = __myFSFreeRuns(fs);
+	free(files);
+	free(buf);
+	return ret;
+}
+
+// Funcao para obter as estatisticas de uso do sistema de arquivos de um
+// disco montado, escritas em info. Os contadores sao mantidos pelos
+// alocadores e nada e' lido do disco. Retorna 0 caso bem sucedido, ou -1
+// caso contrario
+int myFSStatfs(Disk *d, FSStatInfo *info)
+{
+	MyFSInfo *fs = __myFSGetInfo(d);
+	if (!fs || !info)
+		return -1;
+	info->blockSize = fs->blockSize;
+	info->totalBlocks = fs->numBlocks;
+	info->freeBlocks = fs->freeBlocks;
+	info->availBlocks = fs->freeBlocks - fs->reservedBlocks;
+	info->totalInodes = fs->numInodes;
+	info->freeInodes = fs->freeInodes;
+	info->usedBytes = fs->usedBytes;
+	return 0;
+}
+
+// Funcao para verificar a consistencia do sistema de arquivos de um disco
+// sem arquivos abertos, comparando os mapas e contadores gravados com o que
+// as cadeias de i-nodes e os diretorios realmente usam. As inconsistencias
+// sao contadas em info e, se repair, corrigidas pelo journal. Retorna 0 se
+// a verificacao foi feita, ou -1 caso contrario
+int myFSCheck(Disk *d, FSCheckInfo *info, int repair)
+{
+	MyFSInfo *fs;
+	MyFSCheck *ck;
+	unsigned int freeBlocks, freeInodes, sbFreeBlocks, sbFreeInodes;
+	unsigned long long usedBytes = 0, sbUsedBytes;
+	int ret = 0;
+	if (!d || !info || !myFSIsIdle(d))
+		return -1;
+	// Os metadados sao relidos do disco, com o journal ja' aplicado e os
+	// orfaos de uma queda liberados
+	if (myFSUnmount(d) < 0)
+		return -1;
+	fs = __myFSGetInfo(d);
+	if (!fs || __myFSGroupsLoadAll(fs) < 0 || __myFSOrphanReclaim(fs, 0) < 0 ||
+		__myFSJournalCheckpoint(fs) < 0 || !(ck = __myFSCheckAlloc(fs)))
+	{
+		__myFSForgetInfo(d);
+		return -1;
+	}
+	// As correcoes atualizam o superbloco; os valores gravados sao guardados
+	sbFreeBlocks = fs->sbFreeBlocks;
+	sbFreeInodes = fs->sbFreeInodes;
+	sbUsedBytes = fs->sbUsedBytes;
+	memset(info, 0, sizeof(FSCheckInfo));
+	__myFSCheckRun(ck, __myFSCheckReadTables);
+	for (unsigned int a = 0; a < ck->numParts; a++)
+		if (ck->parts[a].failed)
+			ret = -1;
+	if (ret == 0)
+		__myFSCheckRun(ck, __myFSCheckRange);
+	for (unsigned int a = 0; a < ck->numParts; a++)
+	{
+		MyFSCheckPart *p = &ck->parts[a];
+		if (p->failed)
+			ret = -1;
+		info->inodes += p->info.inodes;
+		info->badBlocks += p->info.badBlocks;
+		info->badChains += p->info.badChains;
+		info->badSizes += p->info.badSizes;
+		info->badEntries += p->info.badEntries;
+		usedBytes += p->usedBytes;
+	}
+	// Sem o diretorio raiz nao ha o que verificar
+	if (ret == 0 && ck->kind[MYFS_ROOT_INODE] != MYFS_CHECK_DIR)
+		ret = -1;
+	if (ret == 0 && repair)
+	{
+		if (__myFSCheckFixInodes(ck) < 0)
+			ret = -1;
+		else
+			info->fixed += info->badBlocks + info->badChains + info->badSizes;
+		fs->usedBytes = usedBytes;
+	}
+	if (ret == 0 &&
+		(__myFSCheckInodeMap(ck, info, repair, &freeInodes) < 0 ||
+		 __myFSCheckBlockMap(ck, info, repair, &freeBlocks) < 0 ||
+		 __myFSCheckLinks(ck, info, repair) < 0 ||
+		 __myFSOrphanReclaim(fs, 0) < 0))
+		ret = -1;
+	// Contadores de uso do superbloco
+	if (ret == 0)
+	{
+		unsigned int wrong = (sbFreeBlocks != freeBlocks) +
+							 (sbFreeInodes != freeInodes) +
+							 (sbUsedBytes != usedBytes);
+		info->counterErrors += wrong;
+		if (wrong && repair)
+		{
+			if (__myFSWriteSuperblock(fs) < 0)
+				ret = -1;
+			else
+				info->fixed += wrong;
+		}
+	}
+	info->errors = info->badBlocks + info->dupBlocks + info->badChains +
+				   info->badSizes + info->blockMapErrors + info->inodeMapErrors +
+				   info->refCountErrors + info->fragErrors + info->badEntries +
+				   info->linkErrors + info->orphans + info->counterErrors;
+	__myFSCheckFree(ck);
+	if (__myFSJournalCheckpoint(fs) < 0)
+		ret = -1;
+	__myFSForgetInfo(d);
+	return ret;
 }
 
 // Funcao para fechar um arquivo, a partir de um descritor de arquivo
 // existente. Retorna 0 caso bem sucedido, ou -1 caso contrario
 int myFSClose(int fd)
 {
-	return -1;
+	return __myFSFdClose(fd, FILETYPE_REGULAR);
 }
 
 // Funcao para abertura de um diretorio, a partir do caminho
@@ -78,7 +7257,14 @@ int myFSClose(int fd)
 // em caso de sucesso. Retorna -1, caso contrario.
 int myFSOpenDir(Disk *d, const char *path)
 {
-	return -1;
+	MyFSNode *node = __myFSOpenPath(d, path, FILETYPE_DIR);
+	int fd;
+	if (!node)
+		return -1;
+	fd = __myFSFdAlloc(node);
+	if (fd < 0)
+		__myFSNodePut(node);
+	return fd;
 }
 
 // Funcao para a leitura de um diretorio, identificado por um descritor
@@ -90,7 +7276,28 @@ int myFSOpenDir(Disk *d, const char *path)
 // mal sucedido
 int myFSReadDir(int fd, char *filename, unsigned int *inumber)
 {
-	return -1;
+	MyFSFd *f = __myFSFdGet(fd, FILETYPE_DIR);
+	if (!f || !filename || !inumber)
+		return -1;
+	return __myFSDirNext(f->node, &f->cursor, &f->dirOffset, filename,
+						 inumber);
+}
+
+// Funcao para a leitura em lote de um diretorio, identificado por um
+// descritor de arquivo existente: ate' max entradas a partir da posicao atual
+// do cursor sao copiadas para entries, com os atributos de seus i-nodes. Os
+// i-nodes sao lidos em ordem de setor. Retorna o numero de entradas lidas, 0
+// se fim de diretorio ou -1 caso mal sucedido
+int myFSReadDirPlus(int fd, FSDirEntry *entries, unsigned int max)
+{
+	MyFSFd *f = __myFSFdGet(fd, FILETYPE_DIR);
+	int n;
+	if (!f || !entries)
+		return -1;
+	n = __myFSDirNextEntries(f->node, &f->cursor, &f->dirOffset, entries, max);
+	if (n > 0 && __myFSDirFillAttrs(f->node->fs, entries, n) < 0)
+		return -1;
+	return n;
 }
 
 // Funcao para adicionar uma entrada a um diretorio, identificado por um
@@ -99,7 +7306,23 @@ int myFSReadDir(int fd, char *filename, unsigned int *inumber)
 // Retorna 0 caso bem sucedido, ou -1 caso contrario.
 int myFSLink(int fd, const char *filename, unsigned int inumber)
 {
-	return -1;
+	MyFSFd *f = __myFSFdGet(fd, FILETYPE_DIR);
+	MyFSNode *node;
+	if (!f || !__myFSValidName(filename))
+		return -1;
+	node = __myFSNodeGet(f->node->fs, inumber);
+	if (!node)
+		return -1;
+	if (__myFSDirAdd(f->node, filename, inumber) < 0)
+	{
+		__myFSNodePut(node);
+		return -1;
+	}
+	inodeSetRefCount(&node->inode, inodeGetRefCount(&node->inode) + 1);
+	inodeSave(&node->inode);
+	__myFSNodePut(node);
+	__myFSJournalOpEnd(f->node->fs);
+	return 0;
 }
 
 // Funcao para remover uma entrada existente em um diretorio,
@@ -108,14 +7331,90 @@ int myFSLink(int fd, const char *filename, unsigned int inumber)
 // sucedido, ou -1 caso contrario.
 int myFSUnlink(int fd, const char *filename)
 {
-	return -1;
+	MyFSFd *f = __myFSFdGet(fd, FILETYPE_DIR);
+	MyFSNode *node;
+	unsigned int inumber;
+	if (!f || !__myFSValidName(filename) || strcmp(filename, ".") == 0 ||
+		strcmp(filename, "..") == 0 ||
+		__myFSDirLookup(f->node, filename, &inumber) < 0)
+		return -1;
+	node = __myFSNodeGet(f->node->fs, inumber);
+	if (!node)
+		return -1;
+	// Diretorios so' perdem seu ultimo nome se estiverem vazios
+	if (__myFSNodeIsDir(node) && inodeGetRefCount(&node->inode) <= 1 &&
+		__myFSDirIsEmpty(node) != 1)
+	{
+		__myFSNodePut(node);
+		return -1;
+	}
+	if (__myFSDirRemove(f->node, filename, &inumber) < 0)
+	{
+		__myFSNodePut(node);
+		return -1;
+	}
+	// Sem nomes, o arquivo vai para a lista de orfaos quando a ultima
+	// referencia for devolvida (possivelmente por um descritor ainda aberto)
+	if (inodeGetRefCount(&node->inode) > 0)
+		inodeSetRefCount(&node->inode, inodeGetRefCount(&node->inode) - 1);
+	inodeSave(&node->inode);
+	__myFSNodePut(node);
+	__myFSJournalOpEnd(f->node->fs);
+	return 0;
+}
+
+// Funcao para remover, no disco montado d, o arquivo ou diretorio de
+// caminho path e, se for um diretorio, toda a subarvore abaixo dele. Apenas
+// a entrada de path sai de seu diretorio pai; as dos diretorios removidos
+// nao sao apagadas uma a uma. Os contadores dos i-nodes da subarvore sao
+// atualizados em ordem de numero, de modo que i-nodes do mesmo setor sao
+// gravados juntos, e os que ficam sem nomes vao para a lista de orfaos,
+// liberada aos poucos. Falha sem alterar nada se algum diretorio da
+// subarvore estiver aberto ou tiver nomes fora dela. Retorna 0 caso bem
+// sucedido, ou -1 caso contrario.
+int myFSRemoveTree(Disk *d, const char *path)
+{
+	MyFSInfo *fs = __myFSGetInfo(d);
+	char last[MAX_FILENAME_LENGTH + 1];
+	unsigned int parent, inumber;
+	MyFSList links = {0};
+	MyFSNode *dir = NULL;
+	int ret = -1;
+	if (!fs || __myFSResolvePath(fs, path, &parent, last, &inumber) != 0 ||
+		inumber == MYFS_ROOT_INODE)
+		return -1;
+	if (__myFSTreeCollect(fs, inumber, &links) == 0 &&
+		(dir = __myFSNodeGet(fs, parent)) != NULL)
+		ret = __myFSDirRemove(dir, last, &inumber);
+	__myFSNodePut(dir);
+	for (unsigned int a = 0, b; ret == 0 && a < links.count; a = b)
+	{
+		MyFSNode *node = __myFSNodeGet(fs, links.items[a]);
+		unsigned int refs;
+		for (b = a + 1; b < links.count && links.items[b] == links.items[a];
+			 b++)
+			;
+		if (!node)
+		{
+			ret = -1;
+			break;
+		}
+		refs = inodeGetRefCount(&node->inode);
+		inodeSetRefCount(&node->inode, (refs > b - a ? refs - (b - a) : 0));
+		if (inodeSave(&node->inode) < 0)
+			ret = -1;
+		__myFSNodePut(node);
+	}
+	free(links.items);
+	__myFSJournalOpEnd(fs);
+	return ret;
 }
 
 // Funcao para fechar um diretorio, identificado por um descritor de
 // arquivo existente. Retorna 0 caso bem sucedido, ou -1 caso contrario.
 int myFSCloseDir(int fd)
 {
-	return -1;
+	return __myFSFdClose(fd, FILETYPE_DIR);
 }
 
 // Funcao para instalar seu sistema de arquivos no S.O., registrando-o junto
@@ -131,6 +7430,7 @@ int installMyFS(void)
 	fs_info->closedirFn = myFSCloseDir;
 	fs_info->formatFn = myFSFormat;
 	fs_info->isidleFn = myFSIsIdle;
+	fs_info->unmountFn = myFSUnmount;
 	fs_info->linkFn = myFSLink;
 	fs_info->openFn = myFSOpen;
 	fs_info->opendirFn = myFSOpenDir;
@@ -138,6 +7438,16 @@ int installMyFS(void)
 	fs_info->readdirFn = myFSReadDir;
 	fs_info->unlinkFn = myFSUnlink;
 	fs_info->writeFn = myFSWrite;
+	fs_info->allocateFn = myFSAllocate;
+	fs_info->defragFn = myFSDefrag;
+	fs_info->seekFn = myFSSeek;
+	fs_info->readdirplusFn = myFSReadDirPlus;
+	fs_info->cloneFn = myFSClone;
+	fs_info->statfsFn = myFSStatfs;
+	fs_info->checkFn = myFSCheck;
+	fs_info->compressFn = myFSSetCompression;
+	fs_info->dedupFn = myFSSetDedup;
+	fs_info->rmtreeFn = myFSRemoveTree;
 	myFSslot = vfsRegisterFS(fs_info); // identificador unico (slot) do file system
 	return myFSslot;
 }
@@ -57,6 +57,7 @@ int vfsMountRoot (Disk *d, char fsId) {
 int vfsUnmountRoot ( void ) {
 	if ( !rootDisk || !rootFS ) return -1;
 	if ( !rootFS->isidleFn (rootDisk) ) return -1;
+	if ( rootFS->unmountFn && rootFS->unmountFn (rootDisk) < 0 ) return -1;
 	rootFS = NULL;
 	rootDisk = NULL;
 	return 0;
@@ -127,6 +128,18 @@ int vfsReaddir (int fd, char *filename, unsigned int *inumber) {
         return rootFS->readdirFn (fd, filename, inumber);
 }
 
+//Funcao para a leitura em lote de um diretorio, identificado por um descritor
+//de arquivo existente. Ate' max entradas, a partir da posicao atual do cursor
+//no diretorio, sao copiadas para entries, com os atributos (tipo, tamanho,
+//proprietarios, permissoes e referencias) dos i-nodes correspondentes.
+//Retorna o numero de entradas lidas, 0 se fim de diretorio ou -1 caso mal
+//sucedido
+int vfsReaddirPlus (int fd, FSDirEntry *entries, unsigned int max) {
+        if ( !rootDisk || !rootFS || !rootFS->readdirplusFn || !entries )
+                return -1;
+        return rootFS->readdirplusFn (fd, entries, max);
+}
+
 //Funcao para adicionar uma entrada a um diretorio, identificado por um 
 //descritor de arquivo existente. A nova entrada tera' o nome indicado por
 //filename e apontara' para o numero de i-node indicado por inumber. Retorna 0\
@@ -151,6 +164,87 @@ int vfsClosedir (int fd) {
         return rootFS->closedirFn (fd);
 }
 
+//Funcao para reservar espaco para um arquivo, identificado por um descritor
+//de arquivo existente, de modo que ele possa crescer ate' nbytes sem
+//alocacao de novos blocos, preferencialmente contiguos. O tamanho do arquivo
+//nao muda. Retorna 0 caso bem sucedido, ou -1 caso contrario.
+int vfsAllocate (int fd, unsigned int nbytes) {
+        if ( !rootDisk || !rootFS || !rootFS->allocateFn ) return -1;
+        return rootFS->allocateFn (fd, nbytes);
+}
+
+//Funcao para desfragmentar o sistema de arquivos raiz, com os arquivos que
+//nao estejam abertos. O resultado (trechos contiguos antes e depois e seeks
+//estimados) e' escrito em info. Retorna 0 caso bem sucedido, ou -1 caso
+//contrario.
+int vfsDefrag (FSDefragInfo *info) {
+        if ( !rootDisk || !rootFS || !rootFS->defragFn || !info ) return -1;
+        return rootFS->defragFn (rootDisk, info);
+}
+
+//Funcao para posicionar o cursor de um arquivo, identificado por um
+//descritor de arquivo existente, em offset bytes do inicio. O cursor pode
+//ficar alem do fim do arquivo; uma escrita ali deixa um buraco, lido como
+//zeros, sem ocupar espaco. Retorna 0 caso bem sucedido, ou -1 caso contrario.
+int vfsSeek (int fd, unsigned int offset) {
+        if ( !rootDisk || !rootFS || !rootFS->seekFn ) return -1;
+        return rootFS->seekFn (fd, offset);
+}
+
+//Funcao para clonar o arquivo de caminho src em um novo arquivo de caminho
+//dst, que nao pode existir. O clone compartilha os blocos de dados de src,
+//sem copia-los, ate' que um dos dois arquivos seja escrito. Retorna 0 caso
+//bem sucedido, ou -1 caso contrario.
+int vfsClone (const char *src, const char *dst) {
+        if ( !rootDisk || !rootFS || !rootFS->cloneFn ) return -1;
+        return rootFS->cloneFn (rootDisk, src, dst);
+}
+
+//Funcao para obter as estatisticas de uso (blocos e i-nodes livres e bytes
+//em uso) do sistema de arquivos raiz, escritas em info. Barata o bastante
+//para ser consultada com frequencia. Retorna 0 caso bem sucedido, ou -1 caso
+//contrario.
+int vfsStatfs (FSStatInfo *info) {
+        if ( !rootDisk || !rootFS || !rootFS->statfsFn || !info ) return -1;
+        return rootFS->statfsFn (rootDisk, info);
+}
+
+//Funcao para verificar a consistencia do sistema de arquivos indicado pelo
+//identificador fsId em um disco que nao seja a raiz montada, corrigindo as
+//inconsistencias se repair for diferente de 0. Retorna 0 caso a verificacao
+//tenha sido feita, ou -1 caso contrario.
+int vfsCheck (Disk *d, char fsId, FSCheckInfo *info, int repair) {
+        FSInfo *fsInfo = NULL;
+        if ( !d || !info || d == rootDisk ) return -1;
+        fsInfo = __vfsGetFSInfo (fsId);
+        if ( !fsInfo || !fsInfo->checkFn ) return -1;
+        return fsInfo->checkFn (d, info, repair);
+}
+
+//Funcao para ligar (on diferente de 0) ou desligar a compressao transparente
+//dos blocos de um arquivo, identificado por um descritor de arquivo
+//existente. Retorna 0 caso bem sucedido, ou -1 caso contrario.
+int vfsSetCompression (int fd, int on) {
+        if ( !rootDisk || !rootFS || !rootFS->compressFn ) return -1;
+        return rootFS->compressFn (fd, on);
+}
+
+//Funcao para ligar (on diferente de 0) ou desligar a deduplicacao dos blocos
+//de um arquivo, identificado por um descritor de arquivo existente. Retorna
+//0 caso bem sucedido, ou -1 caso contrario.
+int vfsSetDedup (int fd, int on) {
+        if ( !rootDisk || !rootFS || !rootFS->dedupFn ) return -1;
+        return rootFS->dedupFn (fd, on);
+}
+
+//Funcao para remover o arquivo ou diretorio de caminho path e, se for um
+//diretorio, tudo o que houver abaixo dele. Retorna 0 caso bem sucedido, ou
+//-1 caso contrario.
+int vfsRemoveTree (const char *path) {
+        if ( !rootDisk || !rootFS || !rootFS->rmtreeFn ) return -1;
+        return rootFS->rmtreeFn (rootDisk, path);
+}
+
 //Registra novo sistema de arquivos. Retorna um identificador unico (slot),
 //caso o sistema de arquivos tenha sido registrado com sucesso. Caso contrario,
 //retorna -1
@@ -21,6 +21,69 @@
 #define FILETYPE_DIR 128    //Identificador de tipo de arquivo: diretorio
 #define FILETYPE_REGULAR 64 //Identificador de tipo de arquivo: arq regular
 
+//Estrutura com o resultado de uma desfragmentacao. Trechos sao sequencias de
+//blocos fisicamente contiguos; cada trecho alem do primeiro custa um seek na
+//leitura completa de um arquivo
+typedef struct fs_defrag_info {
+	unsigned int files;		//Arquivos regulares examinados
+	unsigned int filesMoved;	//Arquivos realocados
+	unsigned int filesBusy;		//Arquivos abertos, que nao foram movidos
+	unsigned int extentsBefore;	//Trechos dos arquivos antes
+	unsigned int extentsAfter;	//Trechos dos arquivos depois
+	unsigned int freeRunsBefore;	//Trechos de espaco livre antes
+	unsigned int freeRunsAfter;	//Trechos de espaco livre depois
+	unsigned long cylsBefore;	//Cilindros percorridos entre trechos, na
+	unsigned long cylsAfter;	//leitura de todos os arquivos, antes e depois
+} FSDefragInfo;
+
+//Estrutura com uma entrada de diretorio e os atributos do i-node para o qual
+//ela aponta, preenchida pela leitura de diretorio em lote
+typedef struct fs_dir_entry {
+	char name[MAX_FILENAME_LENGTH + 1];	//Nome da entrada
+	unsigned int inumber;			//Numero do i-node
+	unsigned int type;			//Tipo de arquivo (FILETYPE_*)
+	unsigned int size;			//Tamanho, em bytes
+	unsigned int owner;			//Proprietario
+	unsigned int groupOwner;		//Grupo proprietario
+	unsigned int permission;		//Permissoes de acesso
+	unsigned int refCount;			//Contador de referencias
+} FSDirEntry;
+
+//Estrutura com as estatisticas de uso de um sistema de arquivos. Os blocos
+//incluem os de metadados; os i-nodes, os de extensao
+typedef struct fs_stat_info {
+	unsigned int blockSize;		//Tamanho do bloco, em bytes
+	unsigned int totalBlocks;	//Blocos do disco
+	unsigned int freeBlocks;	//Blocos livres
+	unsigned int availBlocks;	//Livres e nao reservados para dados
+					//ainda nao gravados
+	unsigned int totalInodes;	//I-nodes do disco
+	unsigned int freeInodes;	//I-nodes livres
+	unsigned long long usedBytes;	//Bytes em arquivos e diretorios
+} FSStatInfo;
+
+//Estrutura com o resultado de uma verificacao de consistencia. Cada campo
+//conta as inconsistencias de um tipo; errors e' o total e fixed, quantas
+//delas foram corrigidas
+typedef struct fs_check_info {
+	unsigned int inodes;		//Arquivos e diretorios examinados
+	unsigned int errors;		//Inconsistencias encontradas
+	unsigned int fixed;		//Inconsistencias corrigidas
+	unsigned int badBlocks;		//Enderecos de blocos invalidos
+	unsigned int dupBlocks;		//Blocos com mais referencias que o
+					//permitido
+	unsigned int badChains;		//Cadeias de i-nodes de extensao invalidas
+	unsigned int badSizes;		//Tamanhos alem dos blocos do arquivo
+	unsigned int blockMapErrors;	//Bits errados no mapa de blocos
+	unsigned int inodeMapErrors;	//Bits errados no mapa de i-nodes
+	unsigned int refCountErrors;	//Contadores de referencias de blocos
+	unsigned int fragErrors;	//Blocos de fragmentos inconsistentes
+	unsigned int badEntries;	//Entradas de diretorio invalidas
+	unsigned int linkErrors;	//Contadores de nomes de i-nodes errados
+	unsigned int orphans;		//Arquivos e diretorios sem nome
+	unsigned int counterErrors;	//Contadores de grupos e do superbloco
+} FSCheckInfo;
+
 //Estrutura para definicao da API de sistemas de arquivos.
 //Deve ser preenchida com os ponteiros das respectivas funcoes e passada
 //para registro por meio da funcao vfsRegister()
@@ -33,6 +96,12 @@ typedef struct fs_info {
 	//um positivo se ocioso ou, caso contrario, 0.
 	int (*isidleFn) (Disk *d);
 
+	//Funcao para desmontar o sistema de arquivos de um disco ocioso,
+	//gravando o que estiver pendente e descartando as informacoes mantidas
+	//em memoria, que sao relidas do disco na montagem seguinte. Retorna 0
+	//caso bem sucedido, ou -1 caso contrario. Opcional (NULL)
+	int (*unmountFn) (Disk *d);
+
 	//Funcao para formatacao de um disco com o novo sistema de arquivos
 	//com tamanho de blocos igual a blockSize. Retorna o numero total de
 	//blocos disponiveis no disco, se formatado com sucesso. Caso contrario,
@@ -92,6 +161,67 @@ typedef struct fs_info {
 	//arquivo existente. Retorna 0 caso bem sucedido, ou -1 caso contrario.	
 	int (*closedirFn) (int fd);
 
+	//Funcao para reservar espaco para um arquivo, identificado por um
+	//descritor de arquivo existente, de modo que ele possa crescer ate'
+	//nbytes sem alocacao de novos blocos. O tamanho do arquivo nao muda.
+	//Retorna 0 caso bem sucedido, ou -1 caso contrario. Opcional (NULL)
+	int (*allocateFn) (int fd, unsigned int nbytes);
+
+	//Funcao para desfragmentar o sistema de arquivos de um disco montado,
+	//tornando contiguos os blocos dos arquivos que nao estejam abertos e
+	//agrupando o espaco livre. O resultado e' escrito em info. Retorna 0
+	//caso bem sucedido, ou -1 caso contrario. Opcional (NULL)
+	int (*defragFn) (Disk *d, FSDefragInfo *info);
+
+	//Funcao para posicionar o cursor de um arquivo, identificado por um
+	//descritor de arquivo existente, em offset bytes do inicio. O cursor
+	//pode ficar alem do fim do arquivo; uma escrita ali deixa um buraco,
+	//lido como zeros. Retorna 0 caso bem sucedido, ou -1 caso contrario.
+	//Opcional (NULL)
+	int (*seekFn) (int fd, unsigned int offset);
+
+	//Funcao para a leitura em lote de um diretorio, identificado por um
+	//descritor de arquivo existente. Ate' max entradas, a partir da posicao
+	//atual do cursor no diretorio, sao copiadas para entries, com os
+	//atributos dos i-nodes correspondentes. Retorna o numero de entradas
+	//lidas, 0 se fim do diretorio ou -1 caso mal sucedido. Opcional (NULL)
+	int (*readdirplusFn) (int fd, FSDirEntry *entries, unsigned int max);
+
+	//Funcao para clonar o arquivo de caminho src, no disco montado d, em um
+	//novo arquivo de caminho dst, que compartilha os blocos de src ate' que
+	//um dos dois seja escrito (copy-on-write). Retorna 0 caso bem sucedido,
+	//ou -1 caso contrario. Opcional (NULL)
+	int (*cloneFn) (Disk *d, const char *src, const char *dst);
+
+	//Funcao para obter as estatisticas de uso do sistema de arquivos de um
+	//disco montado, escritas em info, sem percorrer o disco. Retorna 0 caso
+	//bem sucedido, ou -1 caso contrario. Opcional (NULL)
+	int (*statfsFn) (Disk *d, FSStatInfo *info);
+
+	//Funcao para verificar a consistencia do sistema de arquivos de um
+	//disco sem arquivos abertos, corrigindo as inconsistencias se repair
+	//for diferente de 0. O resultado e' escrito em info. Retorna 0 caso a
+	//verificacao tenha sido feita, ou -1 caso contrario. Opcional (NULL)
+	int (*checkFn) (Disk *d, FSCheckInfo *info, int repair);
+
+	//Funcao para ligar (on diferente de 0) ou desligar a compressao
+	//transparente dos blocos de um arquivo aberto, identificado por um
+	//descritor de arquivo. Retorna 0 caso bem sucedido, ou -1 caso
+	//contrario. Opcional (NULL)
+	int (*compressFn) (int fd, int on);
+
+	//Funcao para ligar (on diferente de 0) ou desligar a deduplicacao dos
+	//blocos gravados dai' em diante em um arquivo aberto, identificado por
+	//um descritor de arquivo. Retorna 0 caso bem sucedido, ou -1 caso
+	//contrario. Opcional (NULL)
+	int (*dedupFn) (int fd, int on);
+
+	//Funcao para remover, no disco montado d, o arquivo ou diretorio de
+	//caminho path e, se diretorio, toda a subarvore abaixo dele. O espaco
+	//pode ser liberado depois do retorno. Retorna 0 caso bem sucedido, ou
+	//-1 caso contrario. Opcional (NULL)
+	int (*rmtreeFn) (Disk *d, const char *path);
+
 } FSInfo;
 
 //Funcao para inicializacao do sistema de arquivos virtual
@@ -146,6 +276,14 @@ int vfsOpendir (const char *path);
 //foi lida, 0 se fim de diretorio ou -1 caso mal sucedido
 int vfsReaddir (int fd, char *filename, unsigned int *inumber);
 
+//Funcao para a leitura em lote de um diretorio, identificado por um descritor
+//de arquivo existente. Ate' max entradas, a partir da posicao atual do cursor
+//no diretorio, sao copiadas para entries, com os atributos (tipo, tamanho,
+//proprietarios, permissoes e referencias) dos i-nodes correspondentes.
+//Retorna o numero de entradas lidas, 0 se fim de diretorio ou -1 caso mal
+//sucedido
+int vfsReaddirPlus (int fd, FSDirEntry *entries, unsigned int max);
+
 //Funcao para adicionar uma entrada a um diretorio, identificado por um 
 //descritor de arquivo existente. A nova entrada tera' o nome indicado por
 //filename e apontara' para o numero de i-node indicado por inumber. Retorna 0\
@@ -161,6 +299,62 @@ int vfsUnlink (int fd, const char *filename);
 //existente. Retorna 0 caso bem sucedido, ou -1 caso contrario.
 int vfsClosedir (int fd);
 
+//Funcao para reservar espaco para um arquivo, identificado por um descritor
+//de arquivo existente, de modo que ele possa crescer ate' nbytes sem
+//alocacao de novos blocos, preferencialmente contiguos. O tamanho do arquivo
+//nao muda. Retorna 0 caso bem sucedido, ou -1 caso contrario.
+int vfsAllocate (int fd, unsigned int nbytes);
+
+//Funcao para desfragmentar o sistema de arquivos raiz, com os arquivos que
+//nao estejam abertos. O resultado (trechos contiguos antes e depois e seeks
+//estimados) e' escrito em info. Retorna 0 caso bem sucedido, ou -1 caso
+//contrario.
+int vfsDefrag (FSDefragInfo *info);
+
+//Funcao para posicionar o cursor de um arquivo, identificado por um
+//descritor de arquivo existente, em offset bytes do inicio. O cursor pode
+//ficar alem do fim do arquivo; uma escrita ali deixa um buraco, lido como
+//zeros, sem ocupar espaco. Retorna 0 caso bem sucedido, ou -1 caso contrario.
+int vfsSeek (int fd, unsigned int offset);
+
+//Funcao para clonar o arquivo de caminho src em um novo arquivo de caminho
+//dst, que nao pode existir. O clone compartilha os blocos de dados de src,
+//sem copia-los, ate' que um dos dois arquivos seja escrito. Retorna 0 caso
+//bem sucedido, ou -1 caso contrario.
+int vfsClone (const char *src, const char *dst);
+
+//Funcao para obter as estatisticas de uso (blocos e i-nodes livres e bytes
+//em uso) do sistema de arquivos raiz, escritas em info. Barata o bastante
+//para ser consultada com frequencia. Retorna 0 caso bem sucedido, ou -1 caso
+//contrario.
+int vfsStatfs (FSStatInfo *info);
+
+//Funcao para verificar a consistencia do sistema de arquivos indicado pelo
+//identificador fsId em um disco que nao seja a raiz montada (verificacao
+//offline), corrigindo as inconsistencias se repair for diferente de 0. O
+//resultado e' escrito em info. Retorna 0 caso a verificacao tenha sido
+//feita, ou -1 caso contrario.
+int vfsCheck (Disk *d, char fsId, FSCheckInfo *info, int repair);
+
+//Funcao para ligar (on diferente de 0) ou desligar a compressao transparente
+//dos blocos de um arquivo, identificado por um descritor de arquivo
+//existente. O conteudo lido do arquivo nao muda. Retorna 0 caso bem
+//sucedido, ou -1 caso contrario.
+int vfsSetCompression (int fd, int on);
+
+//Funcao para ligar (on diferente de 0) ou desligar a deduplicacao dos blocos
+//de um arquivo, identificado por um descritor de arquivo existente: blocos
+//gravados dai' em diante iguais a blocos ja' existentes passam a
+//compartilha-los. Retorna 0 caso bem sucedido, ou -1 caso contrario.
+int vfsSetDedup (int fd, int on);
+
+//Funcao para remover o arquivo ou diretorio de caminho path e, se for um
+//diretorio, tudo o que houver abaixo dele. Retorna logo depois de remover os
+//nomes; o espaco e' liberado aos poucos pelo sistema de arquivos. Falha se
+//algum diretorio a remover estiver aberto. Retorna 0 caso bem sucedido, ou
+//-1 caso contrario.
+int vfsRemoveTree (const char *path);
+
 //Registra novo sistema de arquivos. Retorna um identificador unico (slot),
 //caso o sistema de arquivos tenha sido registrado com sucesso. Caso contrario,
 //retorna -1